@@ -0,0 +1,64 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file buffer.hpp
+//! Read-only contiguous storage that either owns or views its elements
+//!
+
+#ifndef INCLUDE_BUFFER_HPP_
+#define INCLUDE_BUFFER_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** @class Buffer
+ *
+ *  Immutable contiguous array of `T`. The memory is kept alive by `owner`,
+ *  which is either a vector moved into the buffer or any other object the
+ *  elements live in (e.g. a memory mapped file). Copies are shallow and share
+ *  the same owner.
+ */
+template <class T> class Buffer {
+  std::shared_ptr<const void> _owner;
+  const T *_ptr{nullptr};
+  std::size_t _size{0};
+
+public:
+  using value_type = T;
+  using const_iterator = const T *;
+
+  Buffer() = default;
+
+  /// Takes ownership of a vector, no elements are copied
+  Buffer(std::vector<T> &&v) {
+    auto owner = std::make_shared<const std::vector<T>>(std::move(v));
+    _ptr = owner->data();
+    _size = owner->size();
+    _owner = std::move(owner);
+  }
+
+  /// Views `size` elements at `ptr`, `owner` must keep them alive
+  Buffer(const T *ptr, std::size_t size, std::shared_ptr<const void> owner)
+      : _owner(std::move(owner)), _ptr(ptr), _size(size) {}
+
+  auto data() const -> const T * { return _ptr; }
+  auto size() const -> std::size_t { return _size; }
+  auto empty() const -> bool { return _size == 0; }
+
+  auto begin() const -> const_iterator { return _ptr; }
+  auto end() const -> const_iterator { return _ptr + _size; }
+
+  auto operator[](std::size_t i) const -> const T & { return _ptr[i]; }
+  auto front() const -> const T & { return _ptr[0]; }
+  auto back() const -> const T & { return _ptr[_size - 1]; }
+
+  auto operator==(const Buffer &o) const -> bool {
+    return _size == o._size && std::equal(begin(), end(), o.begin());
+  }
+  auto operator!=(const Buffer &o) const -> bool { return !(*this == o); }
+};
+
+#endif // INCLUDE_BUFFER_HPP_
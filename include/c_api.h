@@ -25,6 +25,13 @@
 
 typedef void *CSRMatrixHandle;
 typedef void *DenseMatrixHandle;
+typedef void *BatchPipelineHandle;
+typedef void *SampledBlocksHandle;
+typedef void *LabelCounterHandle;
+typedef void *ShardedCSRHandle;
+typedef void *ColumnProjectionHandle;
+typedef void *SliceServerHandle;
+typedef void *RemoteCSRHandle;
 
 /// Represents set of arguments to call `DenseMatrixSliceCSRMatrix()`
 typedef struct SliceArgs {
@@ -38,6 +45,211 @@ typedef struct SliceArgs {
   float *data_out;
 } SliceArgs;
 
+/// Represents set of arguments to call `CSRMatrixSliceSparse()`
+typedef struct SparseSliceArgs {
+  /// handle to CSR matrix
+  CSRMatrixHandle handle;
+  /// indices to slice with
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// number of non-zeros in the slice
+  uint64_t nnz;
+  /// caller owned index pointer array of `len + 1` elements
+  int64_t *indptr_out;
+  /// caller owned column indices array of `nnz` elements
+  int64_t *indices_out;
+  /// caller owned values array of `nnz` elements
+  float *data_out;
+} SparseSliceArgs;
+
+/// Represents set of arguments to call `DenseMatrixSliceCSRMatrixIntoAs()`
+typedef struct SliceAsArgs {
+  /// handle to CSR matrix
+  CSRMatrixHandle handle;
+  /// indices to slice with
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// value type of `data_out`: 1 for float32, 4 for float16, 5 for bfloat16
+  int dtype;
+  /// caller owned contiguous data array of Dense matrix
+  void *data_out;
+} SliceAsArgs;
+
+/// Represents set of arguments to call `ColumnProjectionCreate()`
+typedef struct ProjectionArgs {
+  /// number of columns of matrices the projection applies to
+  uint64_t ncols;
+  /// distinct columns in output order, negative ones count from the end
+  const int64_t *columns;
+  /// length of `columns`
+  uint64_t len;
+  /// handle to the projection
+  ColumnProjectionHandle handle_out;
+} ProjectionArgs;
+
+/// Represents set of arguments to call
+/// `DenseMatrixSliceCSRMatrixProjectedInto()`
+typedef struct ProjectedSliceArgs {
+  /// handle to CSR matrix
+  CSRMatrixHandle handle;
+  /// handle to a projection created for the number of columns of `handle`
+  ColumnProjectionHandle projection;
+  /// indices to slice with
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// caller owned contiguous array of `len` rows of projected columns
+  float *data_out;
+} ProjectedSliceArgs;
+
+/// Represents set of arguments to call `CSRMatrixConvert()`
+typedef struct ConvertArgs {
+  /// handle to CSR matrix
+  CSRMatrixHandle handle;
+  /// value type of the new matrix: 1 for float32, 4 for float16, 5 for
+  /// bfloat16, 6 for uint8 or 7 for a pattern, same as dtypes of the binary
+  /// format
+  int dtype;
+  /// multiplier of uint8 values, 0 maps the largest value to 255. The value
+  /// of every non-zero of a pattern, 0 keeps the common one
+  float scale;
+  /// handle to the new CSR matrix
+  CSRMatrixHandle handle_out;
+} ConvertArgs;
+
+/// Represents set of arguments to call `BatchPipelineCreate()`
+typedef struct BatchPipelineArgs {
+  /// handle to CSR matrix
+  CSRMatrixHandle handle;
+  /// concatenated index batches, copied by the pipeline. When NULL, all rows
+  /// are shuffled with `seed` and split into batches of `batch_size`
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// `nbatches + 1` offsets of batches in `idxset`
+  const uint64_t *offsets;
+  /// number of batches in `idxset`
+  uint64_t nbatches;
+  /// size of shuffled batches
+  uint64_t batch_size;
+  /// seed of the shuffle
+  uint64_t seed;
+  /// drop the last shuffled batch if it is smaller than `batch_size`
+  int drop_last;
+  /// number of batches sliced ahead
+  uint64_t depth;
+  /// handle to the created pipeline
+  BatchPipelineHandle handle_out;
+} BatchPipelineArgs;
+
+/// Represents set of arguments to call `BatchPipelineNext()`
+typedef struct BatchArgs {
+  /// handle to batch pipeline
+  BatchPipelineHandle handle;
+  /// wait for the batch to be sliced instead of polling
+  int block;
+  /// 1 when a batch is returned, 0 when it is not ready or there are no more
+  int ready_out;
+  /// 1 when all batches have been returned
+  int done_out;
+  /// indices the batch was sliced with
+  const int *idxset_out;
+  /// number of rows in the batch
+  uint64_t len_out;
+  /// contiguous data array of Dense matrix, valid until the next call
+  const float *data_out;
+} BatchArgs;
+
+/// Represents set of arguments to call `CSRMatrixLabelCounts()`
+typedef struct LabelCountArgs {
+  /// handle to adjacency CSR matrix
+  CSRMatrixHandle adj;
+  /// handle to node label CSR matrix
+  CSRMatrixHandle labels;
+  /// nodes to count labels of, all nodes when NULL
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// caller owned contiguous data array of Dense matrix of `len * nlabels`
+  /// elements, used by `DenseMatrixLabelCountsInto()`
+  float *data_out;
+  /// handle to the created CSR matrix of label counts
+  CSRMatrixHandle handle_out;
+  /// number of rows of the label counts
+  uint64_t nrows_out;
+  /// number of columns of the label counts, i.e. number of labels
+  uint64_t ncols_out;
+} LabelCountArgs;
+
+/// Represents set of arguments to call `CSRMatrixSampleBlocks()`
+typedef struct SampleArgs {
+  /// handle to adjacency CSR matrix
+  CSRMatrixHandle handle;
+  /// seed nodes
+  const int *idxset;
+  /// length of `idxset`
+  uint64_t len;
+  /// number of neighbors sampled at each hop, all of them when negative
+  const int *fanouts;
+  /// length of `fanouts`
+  uint64_t nhops;
+  /// seed of random streams
+  uint64_t seed;
+  /// handle to the sampled blocks
+  SampledBlocksHandle handle_out;
+} SampleArgs;
+
+/// Represents set of arguments to call `SampledBlocksGet()`
+typedef struct SampledBlockArgs {
+  /// handle to sampled blocks
+  SampledBlocksHandle handle;
+  /// hop of the block to get
+  uint64_t hop;
+  /// nodes sampled from
+  const int *dst_nodes_out;
+  /// length of `dst_nodes_out`
+  uint64_t ndst_out;
+  /// `dst_nodes_out` followed by nodes first reached at this hop
+  const int *src_nodes_out;
+  /// length of `src_nodes_out`
+  uint64_t nsrc_out;
+  /// index pointer of `ndst_out + 1` elements over destination nodes
+  const int64_t *indptr_out;
+  /// positions of sampled neighbors in `src_nodes_out`
+  const int64_t *indices_out;
+  /// number of sampled edges
+  uint64_t nnz_out;
+} SampledBlockArgs;
+
+/// Number of operations with statistics, see `StatsArgs`
+#define GSC_NUM_STATS 9
+/// Number of latency histogram buckets of `StatsArgs`
+#define GSC_LATENCY_BUCKETS 40
+
+/// Represents set of arguments to call `StatsGet()`
+typedef struct StatsArgs {
+  /// operation: 0 slice, 1 slice_validate, 2 slice_fill, 3 slice_scatter,
+  /// 4 load, 5 map, 6 save, 7 sort_run or 8 sort_merge (see stats.hpp)
+  int stat;
+  /// name of the operation
+  const char *name_out;
+  /// number of calls, phases of a slice count blocks of rows
+  uint64_t calls_out;
+  /// rows, or records of a sort, processed
+  uint64_t rows_out;
+  /// bytes read or written
+  uint64_t bytes_out;
+  /// total latency in nanoseconds
+  uint64_t total_ns_out;
+  /// largest latency in nanoseconds
+  uint64_t max_ns_out;
+  /// bucket `k` counts calls that took [2^k, 2^(k+1)) nanoseconds, the
+  /// last one longer calls too
+  uint64_t histogram_out[GSC_LATENCY_BUCKETS];
+} StatsArgs;
+
 typedef struct LoadArgs {
   /// name of file to load
   const char *fname;
@@ -47,8 +259,93 @@ typedef struct LoadArgs {
   uint64_t nrows_out;
   /// number of columns in Dense matrix
   uint64_t ncols_out;
+  /// pages of the arrays: 0 regular, 1 transparent huge or 2 reserved huge
+  /// pages (see PageSize of placement.hpp)
+  int pages;
+  /// NUMA placement of the arrays: 0 first touch, 1 interleaved over all
+  /// nodes or 2 replicated on each node (see NumaPolicy of placement.hpp).
+  /// Mapped matrices support neither huge pages nor NUMA placement.
+  int numa;
+  /// non-zero skips validation of arrays of files marked as validated when
+  /// saved, a stored checksum is verified anyway
+  int trusted;
 } LoadArgs;
 
+/// Represents set of arguments to call `ShardedCSRLoad()`
+typedef struct ShardedLoadArgs {
+  /// index file written by `CSRMatrixSaveSharded()`
+  const char *fname;
+  /// most shards kept in memory at once
+  uint64_t max_resident;
+  /// non-zero skips validation of shards, see LoadArgs
+  int trusted;
+  /// handle to the sharded matrix
+  ShardedCSRHandle handle_out;
+  uint64_t nrows_out;
+  uint64_t ncols_out;
+  uint64_t nshards_out;
+} ShardedLoadArgs;
+
+/// Represents set of arguments to call `SliceServerStart()`
+typedef struct SliceServerArgs {
+  /// handle to CSR matrix to serve, kept alive by the server
+  CSRMatrixHandle handle;
+  /// path of the Unix domain socket to listen on
+  const char *path;
+  /// threads slicing for all clients, 0 for all cores
+  int nthreads;
+  /// handle to the server
+  SliceServerHandle handle_out;
+} SliceServerArgs;
+
+/// Represents set of arguments to call `RemoteCSRConnect()`
+typedef struct RemoteCSRArgs {
+  /// path of the socket of a server started by `SliceServerStart()`
+  const char *path;
+  /// number of slots of the shared memory ring, 0 for 4
+  uint64_t slots;
+  /// size of a slot, which bounds rows of a slice, 0 for 64 MiB
+  uint64_t slot_bytes;
+  /// handle to the connection
+  RemoteCSRHandle handle_out;
+  uint64_t nrows_out;
+  uint64_t ncols_out;
+} RemoteCSRArgs;
+
+/// Represents set of arguments to call `CSRMatrixFromArrays()`
+typedef struct FromArraysArgs {
+  /// `nnz` values of `dtype`, null for a pattern
+  const void *data;
+  /// `nnz` column indices of `index_dtype`
+  const void *indices;
+  /// `nrows + 1` row bounds of `indptr_dtype`
+  const void *indptr;
+  uint64_t nrows;
+  uint64_t ncols;
+  uint64_t nnz;
+  /// value type, same codes as ConvertArgs. 64 bit indices need float32.
+  int dtype;
+  /// 2 for uint32 or 3 for uint64 indices, same as dtypes of the binary
+  /// format. Signed arrays of the same width are accepted, negative
+  /// elements fail validation.
+  int index_dtype;
+  /// 2 for uint32 or 3 for uint64 index pointers
+  int indptr_dtype;
+  /// multiplier of uint8 values or the value of every non-zero of a pattern
+  float scale;
+  /// non-zero copies the arrays, otherwise the matrix views them
+  int copy;
+  /// non-zero skips validation of arrays known to be valid
+  int trusted;
+  /// called with `release_ctx` once the matrix and every matrix sharing its
+  /// arrays are freed, or on return when copying or failing. Without it
+  /// the caller keeps viewed arrays alive until the matrix is freed.
+  void (*release)(void *ctx);
+  void *release_ctx;
+  /// handle to CSR matrix
+  CSRMatrixHandle handle_out;
+} FromArraysArgs;
+
 /*!
  * \brief load a CSR matrix
  * \param args pointer to LoadArgs
@@ -56,6 +353,22 @@ typedef struct LoadArgs {
  */
 GSC_DLL int CSRMatrixLoadFromFile(LoadArgs *args);
 
+/*!
+ * \brief map a CSR matrix read-only from a binary file without copying it,
+ *  processes mapping the same file share its pages
+ * \param args pointer to LoadArgs
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixMapFromFile(LoadArgs *args);
+
+/*!
+ * \brief create a CSR matrix from caller owned arrays without copying them
+ *  unless asked to
+ * \param args pointer to FromArraysArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixFromArrays(FromArraysArgs *args);
+
 /*!
  * \brief save a CSR matrix into binary file
  * \param handle an instance of CSR matrix
@@ -64,6 +377,80 @@ GSC_DLL int CSRMatrixLoadFromFile(LoadArgs *args);
  */
 GSC_DLL int CSRMatrixSaveBinary(CSRMatrixHandle handle, const char *fname);
 
+/*!
+ * \brief save a CSR matrix in shards of `shard_rows` rows, files
+ *  `fname.0`, `fname.1`, ... and an index file `fname`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixSaveSharded(CSRMatrixHandle handle, const char *fname,
+                                 uint64_t shard_rows);
+
+/*!
+ * \brief open a sharded CSR matrix, shards are loaded on demand
+ * \param args pointer to ShardedLoadArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int ShardedCSRLoad(ShardedLoadArgs *args);
+
+/*!
+ * \brief slice a sharded CSR matrix into a caller owned Dense matrix,
+ *  loading every shard the rows are in at most once
+ * \param args pointer to SliceArgs with a ShardedCSRHandle
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceShardedCSRInto(SliceArgs *args);
+
+/*!
+ * \brief free sharded CSR matrix and its resident shards
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int ShardedCSRFree(ShardedCSRHandle handle);
+
+/*!
+ * \brief serve slices of a CSR matrix to other processes of the host over
+ *  a Unix domain socket, on a thread pool shared by all of them
+ * \param args pointer to SliceServerArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int SliceServerStart(SliceServerArgs *args);
+
+/*!
+ * \brief disconnect clients, remove the socket and free the server
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int SliceServerStop(SliceServerHandle handle);
+
+/*!
+ * \brief connect to a slice server, slices are written into a ring of
+ *  shared memory slots of this connection
+ * \param args pointer to RemoteCSRArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int RemoteCSRConnect(RemoteCSRArgs *args);
+
+/*!
+ * \brief same as `DenseMatrixSliceCSRMatrix()` for a served matrix,
+ *  `data_out` points into the ring and stays valid until its slot is
+ *  reused `slots` slices later. Rows must fit into a slot.
+ * \param args pointer to SliceArgs
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceRemoteCSR(SliceArgs *args);
+
+/*!
+ * \brief same as `DenseMatrixSliceCSRMatrixInto()` for a served matrix,
+ *  of any number of rows
+ * \param args pointer to SliceArgs
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceRemoteCSRInto(SliceArgs *args);
+
+/*!
+ * \brief disconnect from a slice server
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int RemoteCSRFree(RemoteCSRHandle handle);
+
 /*!
  * \brief create a new Dense matrix as a slice of existing CSR matrix
  * \param args pointer to SliceArgs, output is written back to `args`
@@ -71,6 +458,187 @@ GSC_DLL int CSRMatrixSaveBinary(CSRMatrixHandle handle, const char *fname);
  */
 GSC_DLL int DenseMatrixSliceCSRMatrix(SliceArgs *args);
 
+/*!
+ * \brief slice a CSR matrix into a caller owned Dense matrix, e.g. a
+ *  preallocated NumPy array. Does not touch any state shared between calls,
+ *  so several threads may slice the same handle at once.
+ * \param args pointer to SliceArgs, `data_out` must point to a contiguous
+ *  row-major buffer of `len * ncols` floats, which is overwritten
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceCSRMatrixInto(SliceArgs *args);
+
+/*!
+ * \brief prepare a column subset to slice matrices with, reusable across
+ *  slices of matrices with the same number of columns
+ * \param args pointer to ProjectionArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int ColumnProjectionCreate(ProjectionArgs *args);
+
+/*!
+ * \brief slice rows of a CSR matrix restricted to projected columns into a
+ *  caller owned Dense matrix
+ * \param args pointer to ProjectedSliceArgs
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceCSRMatrixProjectedInto(ProjectedSliceArgs *args);
+
+/*!
+ * \brief free column projection
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int ColumnProjectionFree(ColumnProjectionHandle handle);
+
+/*!
+ * \brief same as `DenseMatrixSliceCSRMatrixInto()`, but writes values of
+ *  `dtype`, converted on the fly. 16 bit outputs halve the bytes written
+ *  and copied to an accelerator.
+ * \param args pointer to SliceAsArgs, `data_out` must point to a contiguous
+ *  row-major buffer of `len * ncols` values of `dtype`, which is overwritten
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceCSRMatrixIntoAs(SliceAsArgs *args);
+
+/*!
+ * \brief create a copy of a CSR matrix storing values as `dtype`, e.g. to
+ *  save it in a reduced precision binary file. Index arrays are shared.
+ * \param args pointer to ConvertArgs, `handle_out` is written back to `args`
+ *  and freed with `CSRMatrixFree()`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixConvert(ConvertArgs *args);
+
+/*!
+ * \brief count non-zeros of a sparse slice of a CSR matrix, so that the
+ *  caller can allocate output arrays for `CSRMatrixSliceSparse()`
+ * \param args pointer to SparseSliceArgs, `nnz` is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixSliceNNZ(SparseSliceArgs *args);
+
+/*!
+ * \brief gather rows of a CSR matrix into a new `len x ncols` CSR matrix,
+ *  written into caller owned arrays without materializing any zeros
+ * \param args pointer to SparseSliceArgs, `nnz` must be the value returned by
+ *  `CSRMatrixSliceNNZ()` for the same indices
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixSliceSparse(SparseSliceArgs *args);
+
+/*!
+ * \brief count labels of neighbors of nodes into a new CSR matrix, row `i`
+ *  of which is the sum of label rows of neighbors of node `idxset[i]`
+ * \param args pointer to LabelCountArgs, output is written back to `args`.
+ *  The created matrix is freed with `CSRMatrixFree()`.
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixLabelCounts(LabelCountArgs *args);
+
+/*!
+ * \brief count labels of neighbors of nodes `idxset` into a caller owned
+ *  Dense matrix
+ * \param args pointer to LabelCountArgs, `data_out` must point to a
+ *  contiguous row-major buffer of `len * nlabels` floats, which is
+ *  overwritten
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixLabelCountsInto(LabelCountArgs *args);
+
+/*!
+ * \brief create incrementally updated neighbor label counts
+ * \param args pointer to LabelCountArgs, `handle_out` is set to a
+ *  LabelCounterHandle, freed with `LabelCounterFree()`, and `nrows_out`,
+ *  `ncols_out` to the shape of the counts. `idxset` is ignored.
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int LabelCounterCreate(LabelCountArgs *args);
+
+/*!
+ * \brief apply label changes to label counts
+ * \param handle an instance of label counter
+ * \param changes `len` triples of (node, old label, new label), a negative
+ *  label stands for none. The old label must be one of the node, the new
+ *  one must not, it takes over the value of the old label or has value one.
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int LabelCounterUpdate(LabelCounterHandle handle,
+                               const int64_t *changes, uint64_t len);
+
+/*!
+ * \brief slice label counts into a caller owned Dense matrix
+ * \param args pointer to SliceArgs with a LabelCounterHandle, `data_out`
+ *  must point to a contiguous row-major buffer of `len * nlabels` floats
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int DenseMatrixSliceLabelCounterInto(SliceArgs *args);
+
+/*!
+ * \brief free label counter
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int LabelCounterFree(LabelCounterHandle handle);
+
+/*!
+ * \brief sample neighbors of seed nodes hop by hop with fixed fanouts
+ * \param args pointer to SampleArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int CSRMatrixSampleBlocks(SampleArgs *args);
+
+/*!
+ * \brief get arrays of a sampled block, valid until the blocks are freed
+ * \param args pointer to SampledBlockArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int SampledBlocksGet(SampledBlockArgs *args);
+
+/*!
+ * \brief free sampled blocks
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int SampledBlocksFree(SampledBlocksHandle handle);
+
+/*!
+ * \brief create a pipeline slicing batches of a CSR matrix in the background
+ * \param args pointer to BatchPipelineArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int BatchPipelineCreate(BatchPipelineArgs *args);
+
+/*!
+ * \brief release the batch returned last and get the next one
+ * \param args pointer to BatchArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int BatchPipelineNext(BatchArgs *args);
+
+/*!
+ * \brief stop a batch pipeline and free its buffers
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int BatchPipelineFree(BatchPipelineHandle handle);
+
+/*!
+ * \brief turn collection of statistics on or off, it is off by default
+ *  unless `GSC_STATS` environment variable is non-zero
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int StatsSetEnabled(int enabled);
+
+/*!
+ * \brief snapshot counters of an operation since the last reset
+ * \param args pointer to StatsArgs, output is written back to `args`
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int StatsGet(StatsArgs *args);
+
+/*!
+ * \brief zero counters of all operations
+ * \return 0 when success, -1 when failure happens
+ */
+GSC_DLL int StatsReset();
+
 /*!
  * \brief free space in CSR matrix
  * \return 0 when success, -1 when failure happens
@@ -0,0 +1,89 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file csr_builder.hpp
+//! Out-of-core construction of CSR matrix files
+//!
+
+#ifndef INCLUDE_CSR_BUILDER_HPP_
+#define INCLUDE_CSR_BUILDER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "csr_format.hpp"
+#include "csr_matrix.hpp"
+
+/** @class CSRFileWriter
+ *
+ *  Streams a matrix into a version 2 CSR file one non-zero at a time, with
+ *  rows in non-decreasing order. Nothing but the current row is held in
+ *  memory: sections are laid out for `max_nnz` non-zeros upfront and each
+ *  one is written sequentially by its own stream. On `close`, once the
+ *  shape is known, sections are moved down over the room left by fewer
+ *  non-zeros, the file is truncated and the header is written. A `pattern`
+ *  writes no values, all of them are one.
+ *
+ *  @param fname File to write
+ *  @param max_nnz Upper bound of the number of non-zeros
+ */
+template <class V, class I, class P> class CSRFileWriter {
+  std::string _fname;
+  CSRFileHeader _h;
+  std::ofstream _data;
+  std::ofstream _indices;
+  std::ofstream _indptr;
+  std::size_t _max_nnz;
+  std::size_t _nnz{0};
+  /// number of rows whose end has been written to `indptr`
+  std::size_t _nrows{0};
+  std::size_t _ncols{0};
+  bool _closed{false};
+
+  /// Write ends of rows up to `row`
+  void end_rows(std::size_t row);
+
+public:
+  using matrix_type = BasicCSR<V, I, P>;
+
+  CSRFileWriter(std::string fname, std::size_t max_nnz);
+
+  /// Appends non-zero `value` at (`row`, `col`), `row` must not be less than
+  /// the row of the previous non-zero
+  void push(std::size_t row, I col, V value);
+
+  /**
+   *  Writes remaining rows and the header.
+   *  @param nrows, ncols Shape, inferred from the non-zeros when zero. Must
+   *  not be less than the inferred one.
+   *  @return number of non-zeros written
+   */
+  auto close(std::size_t nrows = 0, std::size_t ncols = 0) -> std::size_t;
+};
+
+/**
+ *  Builds a CSR adjacency matrix file from a binary edge list of
+ *  `EdgeItem<uint32_t>` that does not have to fit into memory.
+ *  Edges are sorted by `ExternalSorter` in runs of `max_mem` bytes and the
+ *  merged stream is written by `CSRFileWriter` as a `pattern`, since all
+ *  values are one, so only the merge state is held in memory and the file
+ *  has no data section. The index pointer is 64 bit if there are more than
+ *  2^32 edges. The matrix is square, of as many rows and columns as the
+ *  largest node id, source or target, plus one.
+ *
+ *  @param edges_fname Binary edge list, row of an edge is its source
+ *  @param csr_fname CSR file to write
+ *  @param tmp_dir Directory to keep sorted runs in, they are removed after
+ *  @param max_mem Memory used to sort a run, in bytes
+ *  @param dedup Write repeated edges once
+ *  @return number of non-zeros written
+ */
+auto build_csr(const std::string &edges_fname, const std::string &csr_fname,
+               const std::filesystem::path &tmp_dir,
+               std::size_t max_mem = std::size_t{1} << 30U, bool dedup = true)
+    -> std::size_t;
+
+#endif // INCLUDE_CSR_BUILDER_HPP_
@@ -0,0 +1,224 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file csr_format.hpp
+//! Versioned binary file format of CSR matrices
+//!
+//! Version 2 layout, native endian:
+//!
+//!     [CSRFileHeader][data][pad][indices][pad][indptr]
+//!
+//! The header is followed by sections starting at 64-byte aligned offsets,
+//! recorded in the header's offset table together with their length and
+//! dtype. A reader may seek to any section directly or map it in place.
+//!
+//! Version 1 (legacy, read only) has no header: `uint32` nrows and ncols,
+//! then data, indices and indptr, each prefixed by its `uint32` length.
+//!
+//! A sharded matrix is an index file `fname` and version 2 files
+//! `fname.0`, `fname.1`, ... of consecutive ranges of rows:
+//!
+//!     [ShardIndexHeader][row starts][indptr]
+//!
+//! Row starts are `nshards + 1` `uint64` first rows of the shards followed
+//! by `nrows`, indptr is the `uint64` index pointer of the whole matrix.
+//!
+
+#ifndef INCLUDE_CSR_FORMAT_HPP_
+#define INCLUDE_CSR_FORMAT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "half.hpp"
+
+/// Element type tag of a file section
+enum class DType : std::uint8_t {
+  none = 0,
+  float32 = 1,
+  uint32 = 2,
+  uint64 = 3,
+  float16 = 4,
+  bfloat16 = 5,
+  /// values scaled by `CSRFileHeader::scale`
+  uint8 = 6,
+  /// no values stored, every one is `CSRFileHeader::scale`
+  pattern = 7,
+};
+
+/// Size of one element of `dtype` in bytes, zero for `pattern` and unknown
+/// dtypes
+auto dtype_size(DType dtype) -> std::size_t;
+
+/// Printable name of `dtype`
+auto dtype_name(DType dtype) -> const char *;
+
+/** @struct pattern
+ *
+ *  Value type of a matrix that stores only its sparsity pattern, e.g. of an
+ *  unweighted graph or multi-hot labels. All values are the same constant,
+ *  so the data array is empty.
+ */
+struct pattern {
+  auto operator==(const pattern & /*o*/) const -> bool { return true; }
+};
+
+/// Maps a C++ type to its `DType` tag
+template <class T> struct dtype_of;
+template <> struct dtype_of<float> {
+  static constexpr DType value = DType::float32;
+};
+template <> struct dtype_of<float16> {
+  static constexpr DType value = DType::float16;
+};
+template <> struct dtype_of<bfloat16> {
+  static constexpr DType value = DType::bfloat16;
+};
+template <> struct dtype_of<std::uint8_t> {
+  static constexpr DType value = DType::uint8;
+};
+template <> struct dtype_of<pattern> {
+  static constexpr DType value = DType::pattern;
+};
+template <> struct dtype_of<std::uint32_t> {
+  static constexpr DType value = DType::uint32;
+};
+template <> struct dtype_of<std::uint64_t> {
+  static constexpr DType value = DType::uint64;
+};
+
+/** @struct CSRSectionEntry
+ *
+ *  Entry of the offset table: where a section starts, how many elements it
+ *  holds and of which type.
+ */
+struct CSRSectionEntry {
+  std::uint64_t offset;
+  std::uint64_t length;
+  DType dtype;
+  std::uint8_t _reserved[7];
+};
+
+/** @struct CSRFileHeader
+ *
+ *  Fixed size header of a version 2 CSR file.
+ */
+struct CSRFileHeader {
+  static constexpr char MAGIC[8] = {'G', 'S', 'C', 'C', 'S', 'R', '\0', '\0'};
+  static constexpr std::uint32_t VERSION = 2;
+  static constexpr std::uint64_t ALIGNMENT = 64;
+
+  enum Flags : std::uint32_t {
+    /// arrays were checked to form a valid CSR matrix before saving
+    VALIDATED = 1U << 0U,
+    /// `checksum` holds a checksum of all sections
+    CHECKSUM = 1U << 1U,
+  };
+
+  enum Section : std::size_t { DATA = 0, INDICES = 1, INDPTR = 2, NSECTIONS };
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t flags;
+  std::uint64_t nrows;
+  std::uint64_t ncols;
+  CSRSectionEntry sections[NSECTIONS];
+  std::uint64_t checksum;
+  /// multiplier of `uint8` data values or the value of all non-zeros of a
+  /// `pattern`, zero in files written before it existed stands for one
+  float scale;
+  std::uint8_t _reserved[12];
+
+  /// Empty header of the current version with magic filled in
+  static auto make(std::uint64_t nrows, std::uint64_t ncols) -> CSRFileHeader;
+
+  /// Checks whether the first 8 bytes of a file are the version 2 magic
+  static auto is_magic(const char *bytes) -> bool;
+
+  /// Lays sections of `lengths` elements out one after another, starting
+  /// right after the header on aligned offsets. Returns total file size.
+  auto layout(const std::uint64_t (&lengths)[NSECTIONS],
+              const DType (&dtypes)[NSECTIONS]) -> std::uint64_t;
+
+  /// Throws if the version is unknown, sections are misaligned or do not
+  /// fit into a file of `file_size` bytes
+  void check(std::uint64_t file_size) const;
+
+  /// Same as `check` and additionally throws if sections do not have exactly
+  /// `dtypes`, which is required to view them in place
+  void check(const DType (&dtypes)[NSECTIONS], std::uint64_t file_size) const;
+
+  auto has(Flags flag) const -> bool { return (flags & flag) != 0; }
+
+  auto value_scale() const -> float { return scale == 0.F ? 1.F : scale; }
+};
+
+static_assert(sizeof(CSRFileHeader) == 2 * CSRFileHeader::ALIGNMENT,
+              "header must keep the first section aligned");
+
+/// Round `offset` up to a multiple of `CSRFileHeader::ALIGNMENT`
+constexpr auto align_offset(std::uint64_t offset) -> std::uint64_t {
+  return (offset + CSRFileHeader::ALIGNMENT - 1) /
+         CSRFileHeader::ALIGNMENT * CSRFileHeader::ALIGNMENT;
+}
+
+/**
+ *  Fast non-cryptographic 64 bit checksum, processes 8 bytes at a time.
+ *  Checksums of consecutive chunks are chained by passing the previous
+ *  result as `seed`.
+ */
+auto checksum64(const void *data, std::size_t size, std::uint64_t seed = 0)
+    -> std::uint64_t;
+
+/// Sections are checksummed in blocks of this many bytes, so that a reader
+/// streaming a section block by block gets the same checksum
+constexpr std::size_t CHECKSUM_BLOCK = 1U << 20U;
+
+/// `checksum64` chained over consecutive `CHECKSUM_BLOCK` sized blocks
+auto section_checksum(const void *data, std::size_t size,
+                      std::uint64_t seed = 0) -> std::uint64_t;
+
+/**
+ *  Reads a version 2 header if the stream starts with one. Otherwise
+ *  rewinds the stream, so that a legacy file can be read from the start.
+ *  @return true when a version 2 header was read into `header`
+ */
+auto read_csr_header(std::istream &is, CSRFileHeader &header) -> bool;
+
+/// Writes zero bytes until the stream position is aligned
+void write_padding(std::ostream &os);
+
+/** @struct ShardIndexHeader
+ *
+ *  Fixed size header of the index file of a sharded matrix.
+ */
+struct ShardIndexHeader {
+  static constexpr char MAGIC[8] = {'G', 'S', 'C', 'S', 'H', 'R', 'D', '\0'};
+  static constexpr std::uint32_t VERSION = 1;
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t nshards;
+  std::uint64_t nrows;
+  std::uint64_t ncols;
+  std::uint64_t nnz;
+  std::uint8_t _reserved[24];
+
+  static auto make(std::uint64_t nrows, std::uint64_t ncols,
+                   std::uint32_t nshards, std::uint64_t nnz)
+      -> ShardIndexHeader;
+
+  /// Throws if magic or version are unknown or arrays do not fit into a
+  /// file of `file_size` bytes
+  void check(std::uint64_t file_size) const;
+};
+
+static_assert(sizeof(ShardIndexHeader) == CSRFileHeader::ALIGNMENT,
+              "shard index header has a fixed size");
+
+/// Name of the file of shard `shard` of a matrix sharded into `fname`
+auto shard_fname(const std::string &fname, std::size_t shard) -> std::string;
+
+#endif // INCLUDE_CSR_FORMAT_HPP_
@@ -8,10 +8,20 @@
 #ifndef INCLUDE_CSR_MATRIX_HPP_
 #define INCLUDE_CSR_MATRIX_HPP_
 
-#include <vector>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
-/** @struct CSR
+#include "buffer.hpp"
+#include "csr_format.hpp"
+#include "placement.hpp"
+#include "projection.hpp"
+
+/** @struct BasicCSR
  *
  *  Compressed Sparse Row matrix.
  *  Data format same as of scipy.sparse.csr_matrix.
@@ -19,42 +29,183 @@
  *  for row `i` are stored in `indices[indptr[i]:indptr[i+1]]` and
  *  their corresponding values are stored in
  *  `data[indptr[i]:indptr[i+1]]`.
+ *  Arrays are immutable `Buffer`s, so they may be owned by the matrix, be
+ *  views into a memory mapped file (see `load_mmap`) or live in huge pages
+ *  and be replicated across NUMA nodes (see `place`).
+ *
+ *  @param V Value type of `data`: `float` or a reduced precision type of
+ *  half.hpp, `float16`, `bfloat16` or `uint8_t` scaled by `_scale`. With
+ *  `pattern` values `data` is empty and every value is `_scale`.
+ *  @param I Column index type of `indices`, bounds the number of columns
+ *  @param P Index pointer type of `indptr`, bounds the number of non-zeros
  */
-struct CSR {
+template <class V, class I, class P> struct BasicCSR {
+  using value_type = V;
+  using index_type = I;
+  using indptr_type = P;
+
   using vec_f = std::vector<float>;
-  using vec_u = std::vector<std::uint32_t>;
+  /// dense output of `slice`, allocated as placed by `place`
+  using vec_slice = std::vector<float, PageAllocator<float>>;
+  using vec_v = std::vector<V>;
+  using vec_i = std::vector<I>;
+  using vec_p = std::vector<P>;
+  using buf_v = Buffer<V>;
+  using buf_i = Buffer<I>;
+  using buf_p = Buffer<P>;
+
+  /// Section dtypes of a file holding this matrix
+  static constexpr DType DTYPES[CSRFileHeader::NSECTIONS] = {
+      dtype_of<V>::value, dtype_of<I>::value, dtype_of<P>::value};
 
-  vec_f _data;
-  vec_u _indices;
-  vec_u _indptr;
+  buf_v _data;
+  buf_i _indices;
+  buf_p _indptr;
   size_t _nrows;
   size_t _ncols;
+  /// multiplier of `uint8_t` values, the value of all non-zeros of a
+  /// `pattern`, one for floating point values
+  float _scale{1.F};
+  /// arrays were checked by `_validate_rows`, or derived from checked ones,
+  /// only then `save` marks a file as validated
+  bool _validated{false};
 
-  vec_f slice_data;
+  vec_slice slice_data;
 
-  explicit CSR(vec_f &&data, vec_u &&indices, vec_u &&indptr, size_t nrows,
-               size_t ncols);
+  /// Copies of the matrix bound to each NUMA node, `slice` reads the one
+  /// of the node a worker runs on. Empty unless replicated by `place`.
+  std::shared_ptr<const std::vector<BasicCSR>> _replicas;
 
-  /// first read vector size and then vector data
+  /// Checks that arrays form a valid matrix: `indptr` has `nrows + 1`
+  /// non-decreasing elements bounded by `indices`, whose elements are less
+  /// than `ncols`. With `validate` unset only O(1) checks are done, use it
+  /// for arrays known to be valid. Shape is inferred from the arrays when
+  /// `nrows` and `ncols` are zero, a matrix without non-zeros needs an
+  /// explicit shape, which may have zero rows when `ncols` is set.
+  /// `data` of a `pattern` must be empty.
+  explicit BasicCSR(buf_v data, buf_i indices, buf_p indptr, size_t nrows = 0,
+                    size_t ncols = 0, bool validate = true);
+
+  /** @struct RowsCheck
+   *
+   *  Result of `_validate_rows`
+   */
+  struct RowsCheck {
+    /// bounds of every row are non-decreasing and within `indices`
+    bool ordered{true};
+    /// largest column index of rows + 1, zero without non-zeros
+    size_t ncols{0};
+  };
+
+  /// Checks rows in one parallel pass over `indptr` and `indices` of the
+  /// rows, fusing the order check with the search for the largest column
+  auto _validate_rows() const -> RowsCheck;
+
+  /// first read vector size and then vector data (version 1 format)
   template <class T>
   static auto _read_vector(std::istream &is) -> std::vector<T>;
 
-  /// first forward write vector size and then vector data
+  /// read a section of a version 2 file converting its elements to `T`,
+  /// chains checksum of the raw section bytes into `h` if it is set.
+  /// Stored `uint8` values are multiplied by `scale` when read as floats.
+  template <class T>
+  static auto _read_section(std::istream &is, const CSRSectionEntry &section,
+                            std::uint64_t *h, float scale = 1.F)
+      -> std::vector<T>;
+
+  /// pad stream to an aligned offset and then write vector data
   template <class T>
-  static void _write_vector(std::ostream &os, const std::vector<T> &v);
+  static void _write_section(std::ostream &os, const Buffer<T> &v);
+
+  /// construct matrix from sections of a version 2 file, skipping validation
+  /// if `trusted` and the file is marked as validated
+  static auto _from_sections(const CSRFileHeader &h, buf_v data,
+                             buf_i indices, buf_p indptr, bool trusted)
+      -> BasicCSR *;
+
+  /// Load matrix from a binary format, version 2 or legacy version 1.
+  /// Index arrays stored with a different width are converted, as long as
+  /// their values fit into `I` and `P`. Reduced precision values are
+  /// converted when loaded as `float`, otherwise they must be stored as `V`.
+  /// Arrays are moved to memory placed by `placement` (see `place`).
+  /// Arrays are validated, unless `trusted` is set and the file is marked
+  /// as validated by `save`. A stored checksum is verified either way.
+  static auto load(const std::string &fname, Placement placement = {},
+                   bool trusted = false) -> BasicCSR *;
+
+  /// Load only the index pointer array of a matrix saved in a binary format.
+  /// Other sections are skipped without being read.
+  static auto load_indptr(const std::string &fname) -> vec_p;
 
-  /// Load matrix from a binary format.
-  /// First read matrix shape and then each vector with it's forward size.
-  static auto load(const std::string &fname) -> CSR *;
+  /// Map matrix from a binary format written by `save`.
+  /// Arrays are read-only views of the page cache: nothing is copied and
+  /// every process mapping the same file shares one physical copy of it.
+  /// Sections must be stored exactly as `V`, `I` and `P`. Validation of a
+  /// `trusted` file is skipped as by `load`, so that no page is read.
+  static auto load_mmap(const std::string &fname, bool trusted = false)
+      -> BasicCSR *;
 
   /// Saves matrix in a native endian (little endian mostly) binary format.
-  /// First forward write matrix shape and then each vector with it's forward
-  /// size.
-  void save(const std::string &fname);
+  /// Writes version 2 header (see csr_format.hpp) with an offset table and
+  /// then each array as a 64-byte aligned section. The file is marked as
+  /// validated if the arrays were, `checksum` additionally stores a
+  /// checksum of all sections, which guards trusted loads of the file
+  /// against corruption.
+  void save(const std::string &fname, bool checksum = false);
 
-  /// Generate random csr matrix with probability of element being zero equal to
-  /// `prob`
-  static auto random(size_t nrows, size_t ncols, float prob) -> CSR;
+  /// Saves rows in shards of `shard_rows` rows for out-of-core slicing by
+  /// `ShardedCSR` (see sharded.hpp). Shard `k` is a file `fname.k` written
+  /// by `save`, `fname` indexes the shards and holds the index pointer of
+  /// the whole matrix (see csr_format.hpp). Shards are written in parallel.
+  void save_sharded(const std::string &fname, size_t shard_rows,
+                    bool checksum = false) const;
+
+  /// Checksum of all arrays as stored in a binary file
+  auto checksum() const -> std::uint64_t;
+
+  auto nnz() const -> size_t { return _indices.size(); }
+
+  /// Value of non-zero `k` as a float
+  auto value(size_t k) const -> float {
+    if constexpr (std::is_same_v<V, pattern>) {
+      (void)k;
+      return _scale;
+    } else if constexpr (std::is_same_v<V, std::uint8_t>) {
+      return static_cast<float>(_data[k]) * _scale;
+    } else {
+      return static_cast<float>(_data[k]);
+    }
+  }
+
+  /**
+   *  Copy of the matrix with values converted to `V2`, sharing index arrays
+   *  with this one. Conversions to 16 bit floats round to nearest.
+   *  @param scale Multiplier of `uint8_t` values of the result, zero maps
+   *  the largest value to 255. Negative values become zero. For a `pattern`
+   *  the value of all non-zeros, zero requires them to be equal already.
+   */
+  template <class V2>
+  auto astype(float scale = 0.F) const -> BasicCSR<V2, I, P>;
+
+  /**
+   *  Copy of the matrix with arrays in huge pages and placed across NUMA
+   *  nodes, which are first touched by TBB workers copying them rather
+   *  than by the loading thread. `slice_data` is allocated likewise.
+   *  With `NumaPolicy::replicate` each node gets a copy in `_replicas`.
+   */
+  auto place(Placement placement) const -> BasicCSR;
+
+  /// Replica of the NUMA node the calling thread runs on, or this matrix
+  /// if it is not replicated
+  auto _local() const -> const BasicCSR &;
+
+  /// Row index of `ixi`, which counts from the end when negative.
+  /// Throws if it is out of range.
+  auto _row(int ixi) const -> size_t;
+
+  /// Generate random csr matrix with probability of element being non-zero
+  /// equal to `prob`, see `uniform_csr` to make it reproducible
+  static auto random(size_t nrows, size_t ncols, float prob) -> BasicCSR;
 
   /**
    *  Performs parallel slicing on indexes.
@@ -64,10 +215,148 @@ struct CSR {
    */
   auto slice(const int *ixs, size_t size) -> float *;
 
-  auto operator==(const CSR &o) const -> bool {
-    return _ncols == o._ncols && _nrows == o._nrows && _data == o._data &&
-           _indices == o._indices && _indptr == o._indptr;
+  /**
+   *  Same as `slice`, but writes into a caller owned buffer instead of
+   *  `slice_data`, so any number of threads may slice one matrix at once.
+   *  Rows are scattered with AVX-512 when the CPU supports it.
+   *  @param O Output type: `float`, `float16` or `bfloat16`. Values are
+   *  converted on the fly, a 16 bit output halves the bytes written.
+   *  @param ixs List of ixs to slice on, must not be out of range
+   *  @param out Contiguous row-major buffer of `size * _ncols` elements,
+   *  completely overwritten
+   *  @param sorted Visit rows in increasing order, still writing each one
+   *  to its position in `out`. Makes reads of a large matrix mostly
+   *  sequential for random `ixs`, at the cost of sorting them.
+   */
+  template <class O>
+  void slice(const int *ixs, size_t size, O *out, bool sorted = false) const;
+
+  /**
+   *  Same as `slice` into a `float` buffer, but only columns of `proj`,
+   *  which is built for matrices of `_ncols` columns.
+   *  @param out Contiguous row-major buffer of `size * proj.size()`
+   *  elements, completely overwritten
+   */
+  void slice(const int *ixs, size_t size, const ColumnProjection &proj,
+             float *out) const;
+
+  /// Same as `slice` into a `float` buffer, but row `ixs[k]` is written to
+  /// row `to[k]` of `out` and other rows are left intact, e.g. to gather
+  /// one batch from several matrices
+  void slice_to(const int *ixs, const size_t *to, size_t size,
+                float *out) const;
+
+  /// Number of non-zeros in rows `ixs`, i.e. of `slice_csr(ixs, size)`
+  auto slice_nnz(const int *ixs, size_t size) const -> size_t;
+
+  /**
+   *  Performs parallel sparse slicing on indexes: gathers rows `ixs` into a
+   *  new `size x _ncols` matrix without materializing any zeros.
+   *  @param ixs List of ixs to slice on, must not be out of range
+   *  @return row-gathered sub-matrix owning its arrays
+   */
+  auto slice_csr(const int *ixs, size_t size) const -> BasicCSR;
+
+  /**
+   *  Same as `slice_csr`, but writes arrays of the sub-matrix into caller
+   *  owned buffers.
+   *  @param indptr Buffer of `size + 1` elements
+   *  @param indices Buffer of `slice_nnz(ixs, size)` elements
+   *  @param data Buffer of `slice_nnz(ixs, size)` elements
+   */
+  void slice_csr(const int *ixs, size_t size, std::int64_t *indptr,
+                 std::int64_t *indices, float *data) const;
+
+  auto operator==(const BasicCSR &o) const -> bool {
+    return _ncols == o._ncols && _nrows == o._nrows && _scale == o._scale &&
+           _data == o._data && _indices == o._indices && _indptr == o._indptr;
   }
 };
 
+/// Compact layout, up to 2^32 non-zeros and columns
+template <class V> using CSRT = BasicCSR<V, std::uint32_t, std::uint32_t>;
+/// 64 bit index pointer for more than 2^32 non-zeros
+template <class V> using CSRLargeT = BasicCSR<V, std::uint32_t, std::uint64_t>;
+
+using CSR = CSRT<float>;
+using CSRLarge = CSRLargeT<float>;
+/// 64 bit column indices and index pointer for more than 2^32 columns
+using CSRWide = BasicCSR<float, std::uint64_t, std::uint64_t>;
+
+/// A matrix of any of the supported layouts, chosen at runtime. Reduced
+/// precision values and patterns are supported with 32 bit column indices.
+using AnyCSR =
+    std::variant<std::shared_ptr<CSR>, std::shared_ptr<CSRLarge>,
+                 std::shared_ptr<CSRWide>, std::shared_ptr<CSRT<float16>>,
+                 std::shared_ptr<CSRLargeT<float16>>,
+                 std::shared_ptr<CSRT<bfloat16>>,
+                 std::shared_ptr<CSRLargeT<bfloat16>>,
+                 std::shared_ptr<CSRT<std::uint8_t>>,
+                 std::shared_ptr<CSRLargeT<std::uint8_t>>,
+                 std::shared_ptr<CSRT<pattern>>,
+                 std::shared_ptr<CSRLargeT<pattern>>>;
+
+/**
+ *  Load a matrix choosing its layout at runtime.
+ *  When copying, the most compact layout the matrix fits into is used, so
+ *  small matrices keep 32 bit indices no matter how they were stored. A
+ *  mapped matrix has to use the layout it was stored with. Values keep
+ *  their stored type, except for copies of wide matrices which get floats.
+ *  @param fname File name to load
+ *  @param mmap Map file read-only instead of copying it (see `load_mmap`)
+ *  @param placement Pages and NUMA placement of a copy (see `place`),
+ *  mapped matrices can only use the default one
+ *  @param trusted Skip validation of files marked as validated
+ */
+auto load_any(const std::string &fname, bool mmap = false,
+              Placement placement = {}, bool trusted = false) -> AnyCSR;
+
+/**
+ *  Copy of a matrix with values converted to `dtype`, see `BasicCSR::astype`.
+ *  Index arrays are shared with `m`.
+ *  @param dtype One of `float32`, `float16`, `bfloat16`, `uint8` or
+ *  `pattern`, only `float32` is supported for 64 bit column indices
+ *  @param scale Multiplier of `uint8` values, zero maps the largest value
+ *  to 255. Value of all non-zeros of a `pattern`, zero requires them to be
+ *  equal already.
+ */
+auto astype(const AnyCSR &m, DType dtype, float scale = 0.F) -> AnyCSR;
+
+/** @struct CSRArrays
+ *
+ *  Arrays of a matrix owned by the caller, see `from_arrays`. Indices and
+ *  index pointers are `uint32` or `uint64`, signed arrays of the same width
+ *  may be passed since negative elements fail validation.
+ */
+struct CSRArrays {
+  /// `nnz` values, null for a `pattern`
+  const void *data{nullptr};
+  /// `nnz` column indices
+  const void *indices{nullptr};
+  /// `nrows + 1` row bounds
+  const void *indptr{nullptr};
+  size_t nrows{0};
+  size_t ncols{0};
+  size_t nnz{0};
+  /// `float32`, `float16`, `bfloat16`, `uint8` or `pattern`
+  DType dtype{DType::float32};
+  DType index_dtype{DType::uint32};
+  DType indptr_dtype{DType::uint32};
+  /// multiplier of `uint8` values or the value of every non-zero of a
+  /// `pattern`, ignored otherwise
+  float scale{1.F};
+};
+
+/**
+ *  Matrix over arrays owned by the caller, which `owner` keeps alive as
+ *  long as any copy of the matrix or of its arrays (e.g. `astype` shares
+ *  indices). Nothing is copied unless `copy` is set, then the matrix owns
+ *  copies and `owner` is released on return.
+ *  The layout follows index widths: 32 bit indices with 32 or 64 bit
+ *  index pointers, or 64 bit both with `float32` values only.
+ *  Shape is required, arrays are validated unless `trusted`.
+ */
+auto from_arrays(const CSRArrays &arrays, std::shared_ptr<const void> owner,
+                 bool copy = false, bool trusted = false) -> AnyCSR;
+
 #endif // INCLUDE_CSR_MATRIX_HPP_
@@ -12,12 +12,12 @@
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <numeric>
-#include <queue>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,10 +26,45 @@
 #include <execution>
 #endif
 
+#include "stats.hpp"
 #include "tools.hpp"
 
 namespace fs = std::filesystem;
 
+// ----------------------------------------------------------------------------
+// BlockReader
+// ----------------------------------------------------------------------------
+
+/** @class BlockReader
+ *
+ * Reads a stream of records in blocks of `block_size` with
+ * `T::decode_block`, so per-record iostream overhead is paid once per block.
+ * @param is Stream to read, owned by the reader
+ * @param block_size Number of records in a block
+ */
+template <class T> class BlockReader {
+  std::ifstream is;
+  std::vector<T> block;
+  size_t pos{0};
+  size_t size{0};
+
+public:
+  BlockReader(std::ifstream &&is, size_t block_size)
+      : is{std::move(is)}, block(std::max(block_size, size_t{1})) {}
+
+  /// Next record, valid until the next call, or nullptr at the end
+  auto next() -> const T * {
+    if (pos == size) {
+      size = T::decode_block(is, block.data(), block.size());
+      pos = 0;
+      if (size == 0) {
+        return nullptr;
+      }
+    }
+    return &block[pos++];
+  }
+};
+
 // ----------------------------------------------------------------------------
 // KMergeIterator
 // ----------------------------------------------------------------------------
@@ -42,47 +77,74 @@ class KmergeIteratorSentinel {};
 
 /** @class KMergeIterator
  *
- * An iterator doing actual work for merging files using priority queue.
- * @param readers File streams to merge
+ * An iterator doing actual work for merging files using a tournament (loser)
+ * tree. Internal nodes keep the loser of the match played there and the
+ * root keeps the overall winner, so advancing replays only the path of the
+ * winner's run: about log2(k) comparisons per element and no allocations.
+ * Exhausted runs lose every match.
+ * @param readers Block readers of streams to merge
  */
 template <class T> class KMergeIterator {
-  std::vector<std::ifstream> &readers;
+  std::vector<BlockReader<T>> &readers;
+  /// current element of each run, in its reader's block, nullptr when the
+  /// run is exhausted
+  std::vector<const T *> heads;
+  /// `tree[0]` is the winner run, `tree[1:k]` are losers at internal nodes,
+  /// leaves are implicit nodes `k + i`
+  std::vector<size_t> tree;
   bool good;
-  using _t = typename std::pair<T, size_t>;
-  static constexpr auto cmp = [](const _t &l, const _t &r) {
-    return l.first > r.first;
-  };
-  std::priority_queue<_t, std::vector<_t>, decltype(cmp)> q{cmp};
-  T temp;
-
-  auto init_queue() -> bool {
-    for (size_t i = 0; i < readers.size(); ++i) {
-      auto &is = readers.at(i);
-      if (T::decode(is, temp)) {
-        q.emplace(temp, i);
-      }
+
+  auto beats(size_t a, size_t b) const -> bool {
+    if (heads[a] == nullptr || heads[b] == nullptr) {
+      return heads[a] != nullptr;
     }
+    // ties are won by the lower run, merge is stable
+    return *heads[a] < *heads[b] || (!(*heads[b] < *heads[a]) && a < b);
+  }
 
-    return q.empty();
+  /// Plays all matches below `node` and returns the winner
+  auto build(size_t node) -> size_t {
+    auto k = readers.size();
+    if (node >= k) {
+      return node - k;
+    }
+    auto l = build(2 * node);
+    auto r = build(2 * node + 1);
+    if (beats(l, r)) {
+      tree[node] = r;
+      return l;
+    }
+    tree[node] = l;
+    return r;
   }
 
 public:
-  explicit KMergeIterator(std::vector<std::ifstream> &readers)
-      : readers{readers} {
-    good = !init_queue();
+  explicit KMergeIterator(std::vector<BlockReader<T>> &readers)
+      : readers{readers}, heads(readers.size()), tree(readers.size()) {
+    auto k = readers.size();
+    for (size_t i = 0; i < k; ++i) {
+      heads[i] = readers[i].next();
+    }
+    if (k > 0) {
+      tree[0] = build(1);
+    }
+    good = k > 0 && heads[tree[0]] != nullptr;
   }
 
-  auto operator*() -> const T & { return q.top().first; }
+  auto operator*() -> const T & { return *heads[tree[0]]; }
 
   auto operator++() -> KMergeIterator & {
-    auto i = q.top().second;
-    auto &is = readers.at(i);
-    q.pop();
-    if (T::decode(is, temp)) {
-      q.emplace(temp, i); // COPY temp, it's cheap
-    }
+    auto k = readers.size();
+    auto winner = tree[0];
+    heads[winner] = readers[winner].next();
 
-    good = !q.empty() || !init_queue();
+    for (auto node = (winner + k) / 2; node > 0; node /= 2) {
+      if (beats(tree[node], winner)) {
+        std::swap(tree[node], winner);
+      }
+    }
+    tree[0] = winner;
+    good = heads[winner] != nullptr;
 
     return *this;
   }
@@ -94,15 +156,22 @@ public:
 
 /** @class KMerge
  *
- * Iterator that merges multiple sorted iterators. Uses priority queue
+ * Iterator that merges multiple sorted iterators. Uses a loser tree
  * for merging
+ * @param readers File streams to merge
+ * @param block_size Number of records read from a stream at once
  */
 template <class T> class KMerge {
-  std::vector<std::ifstream> readers;
+  std::vector<BlockReader<T>> readers;
 
 public:
-  explicit KMerge(std::vector<std::ifstream> &&readers)
-      : readers{std::move(readers)} {}
+  explicit KMerge(std::vector<std::ifstream> &&streams,
+                  size_t block_size = 4096) {
+    readers.reserve(streams.size());
+    for (auto &is : streams) {
+      readers.emplace_back(std::move(is), block_size);
+    }
+  }
 
   auto begin() -> KMergeIterator<T> { return KMergeIterator<T>{readers}; }
   auto end() -> KmergeIteratorSentinel { return {}; }
@@ -117,16 +186,20 @@ public:
  *  Sorts file on disk using merge sort.
  *  First it splits file on parts, then sorts them (consuming `max_mem` at a
  *  time), saves parts on disk to `save_dir` and then merges those parts while
- *  lazy loading. Uses priority queue for merging (memory consumption is
- *  minimal).
+ *  lazy loading. Uses a loser tree for merging (memory consumption is
+ *  minimal). At most `max_fanin` parts are merged at once, if there are more
+ *  of them, groups of parts are merged into new ones in intermediate passes
+ *  first, which bounds the number of open files.
  *
  *  @param save_dir Name of a directory to save parts in
  *  @param max_mem Maximum size of a part file in bytes, 1073741824 (1Gb) by
  * default. The more memory is available the faster is the sorting
+ *  @param max_fanin Maximum number of parts merged at once, at least 2
  */
 template <class T> class ExternalSorter {
   const fs::path save_dir;
   std::size_t max_mem;
+  std::size_t max_fanin;
   unsigned int nChunks;
 
   auto file_name(unsigned int n) -> fs::path {
@@ -134,6 +207,7 @@ template <class T> class ExternalSorter {
   }
 
   void sort_save(std::vector<T> &buf) {
+    StatTimer timer(Stat::sort_run, buf.size(), buf.size() * sizeof(T));
 #ifdef __clang__
     std::sort(buf.begin(), buf.end());
 #else
@@ -144,17 +218,64 @@ template <class T> class ExternalSorter {
     std::ofstream ofile(fout, std::ios::binary);
     assert(ofile);
 
-    for (auto &item : buf) {
-      item.encode(ofile);
+    T::encode_block(ofile, buf.data(), buf.size());
+    nChunks += 1;
+  }
+
+  /// Records read at once from each of `nparts` merged parts, so that all
+  /// blocks together take about `max_mem` but no more than 1Mb each
+  auto block_size(size_t nparts) const -> size_t {
+    auto bytes = std::min(max_mem / std::max(nparts, size_t{1}),
+                          size_t{1} << 20U);
+    return std::max(bytes / sizeof(T), size_t{1});
+  }
+
+  auto open_parts(unsigned int from, unsigned int to)
+      -> std::vector<std::ifstream> {
+    std::vector<std::ifstream> readers;
+    readers.reserve(to - from);
+    for (auto i = from; i < to; ++i) {
+      readers.emplace_back(file_name(i), std::ios::binary);
+      assert(readers.back()); // check io errors
+    }
+    return readers;
+  }
+
+  /// Merges parts `[from, to)` into a new part and removes them
+  void merge_save(unsigned int from, unsigned int to) {
+    StatTimer timer(Stat::sort_merge);
+    std::uint64_t nrecords = 0;
+    {
+      KMerge<T> merged(open_parts(from, to), block_size(to - from));
+      std::ofstream ofile(file_name(nChunks), std::ios::binary);
+      assert(ofile);
+
+      // merged records are staged and written a block at a time
+      std::vector<T> block;
+      block.reserve(block_size(to - from));
+      for (auto &item : merged) {
+        ++nrecords;
+        block.push_back(item);
+        if (block.size() == block.capacity()) {
+          T::encode_block(ofile, block.data(), block.size());
+          block.clear();
+        }
+      }
+      T::encode_block(ofile, block.data(), block.size());
+    }
+    for (auto i = from; i < to; ++i) {
+      fs::remove(file_name(i));
     }
     nChunks += 1;
+    timer.set(nrecords, nrecords * sizeof(T));
   }
 
   //
 public:
-  explicit ExternalSorter(fs::path save_dir, size_t max_mem = pow(2, 30))
+  explicit ExternalSorter(fs::path save_dir, size_t max_mem = pow(2, 30),
+                          size_t max_fanin = 256)
       : save_dir(std::move(save_dir)), max_mem(std::max(max_mem, sizeof(T))),
-        nChunks(0) {}
+        max_fanin(std::max(max_fanin, size_t{2})), nChunks(0) {}
   /** @fn sort_unstable
    *
    *  @brief Sorts input stream
@@ -163,28 +284,25 @@ public:
    */
   auto sort_unstable(std::istream &is) -> KMerge<T> {
     auto max_size = max_mem / sizeof(T);
-    std::vector<T> buf;
-    buf.reserve(max_size);
-    for (T item; T::decode(is, item);) {
-      buf.push_back(std::move(item));
-      if (buf.size() == max_size) {
-        sort_save(buf);
-        buf.clear();
-      }
-    }
-    if (!buf.empty()) {
+    std::vector<T> buf(max_size);
+    // every part is read with a single block read
+    for (size_t n; (n = T::decode_block(is, buf.data(), max_size)) > 0;) {
+      buf.resize(n);
       sort_save(buf);
+      buf.resize(max_size);
     }
 
     std::vector<T>().swap(buf); // free memory
 
-    std::vector<std::ifstream> readers;
-    for (size_t i = 0; i < nChunks; ++i) {
-      readers.emplace_back(file_name(i), std::ios::binary);
-      assert(readers.back()); // check io errors
+    // parts before `first` are merged already
+    unsigned int first = 0;
+    while (nChunks - first > max_fanin) {
+      auto to = static_cast<unsigned int>(first + max_fanin);
+      merge_save(first, to);
+      first = to;
     }
 
-    return KMerge<T>(std::move(readers));
+    return KMerge<T>(open_parts(first, nChunks), block_size(nChunks - first));
   }
 };
 
@@ -0,0 +1,97 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file generators.hpp
+//! Seeded parallel generators of synthetic matrices and graphs
+//!
+
+#ifndef INCLUDE_GENERATORS_HPP_
+#define INCLUDE_GENERATORS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+//! Generators split their output into fixed blocks of rows or edges, each
+//! drawn from its own random stream derived from the seed. Blocks are
+//! generated in parallel, but the output depends only on the seed and
+//! the parameters, not on the number of threads or scheduling.
+//!
+//! Matrices are built in two passes over the blocks, counting non-zeros and
+//! then filling the arrays in place, so no intermediate copy is made.
+//! Edge streams are pairs of `uint32_t` as read by `ExternalSorter` and
+//! `build_csr`, they are written in rounds of blocks generated in parallel.
+//! Non-zero values of `float` matrices are uniform in [0, 1), `pattern`
+//! matrices store none.
+
+/** @struct PowerLawParams
+ *
+ *  Degrees of rows follow a discretized Pareto distribution
+ *  P(d) ~ d^-exponent on [min_degree, max_degree], columns of a row are
+ *  distinct and uniform.
+ */
+struct PowerLawParams {
+  /// must be greater than one, 2..3 is typical of real graphs
+  double exponent{2.1};
+  std::size_t min_degree{1};
+  /// zero bounds degrees only by the number of columns
+  std::size_t max_degree{0};
+};
+
+/** @struct RMatParams
+ *
+ *  Recursive matrix (R-MAT) graph of 2^scale nodes, a Kronecker graph of
+ *  an initiator matrix [[a, b], [c, 1 - a - b - c]]. Every edge descends
+ *  `scale` levels choosing a quadrant of the adjacency matrix by these
+ *  probabilities. Defaults are those of the Graph500 benchmark.
+ */
+struct RMatParams {
+  /// log2 of the number of nodes, at most 32
+  unsigned scale{16};
+  /// number of edges drawn, duplicates included
+  std::uint64_t nedges{std::uint64_t{1} << 20U};
+  double a{0.57};
+  double b{0.19};
+  double c{0.19};
+  /// permute node ids, so that high degree nodes are not clustered at
+  /// small ids
+  bool scramble{true};
+};
+
+/// Matrix with every element being non-zero with probability `density`.
+/// Positions are drawn by geometric skips between non-zeros, so the cost is
+/// proportional to the number of non-zeros rather than of elements.
+template <class M>
+auto uniform_csr(std::size_t nrows, std::size_t ncols, double density,
+                 std::uint64_t seed) -> M;
+
+/// Matrix with power-law distributed numbers of non-zeros of rows
+template <class M>
+auto power_law_csr(std::size_t nrows, std::size_t ncols,
+                   const PowerLawParams &params, std::uint64_t seed) -> M;
+
+/// Adjacency matrix of an R-MAT graph, non-zeros of `float` matrices are
+/// one. Edges are sorted in parallel in memory, 8 bytes per drawn edge.
+/// @param dedup Merge repeated edges, otherwise the matrix has a non-zero
+/// per drawn edge and repeated column indices
+template <class M>
+auto rmat_csr(const RMatParams &params, std::uint64_t seed, bool dedup = true)
+    -> M;
+
+/// Writes edges of `uniform_csr` as a stream of `EdgeItem<uint32_t>`
+/// @return number of edges written
+auto write_uniform_edges(std::ostream &os, std::size_t nrows,
+                         std::size_t ncols, double density,
+                         std::uint64_t seed) -> std::uint64_t;
+
+/// Writes edges of `power_law_csr` as a stream of `EdgeItem<uint32_t>`
+auto write_power_law_edges(std::ostream &os, std::size_t nrows,
+                           std::size_t ncols, const PowerLawParams &params,
+                           std::uint64_t seed) -> std::uint64_t;
+
+/// Writes drawn R-MAT edges unsorted and with duplicates, the same edges
+/// `rmat_csr` is built from
+auto write_rmat_edges(std::ostream &os, const RMatParams &params,
+                      std::uint64_t seed) -> std::uint64_t;
+
+#endif // INCLUDE_GENERATORS_HPP_
@@ -0,0 +1,65 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file half.hpp
+//! Reduced precision value types and their bulk conversions
+//!
+
+#ifndef INCLUDE_HALF_HPP_
+#define INCLUDE_HALF_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/// IEEE 754 float to half precision bits, rounding to nearest even
+auto float_to_half(float value) -> std::uint16_t;
+
+/// Half precision bits to IEEE 754 float, exact
+auto half_to_float(std::uint16_t bits) -> float;
+
+/// IEEE 754 float to bfloat16 bits, rounding to nearest even
+auto float_to_bfloat(float value) -> std::uint16_t;
+
+/// bfloat16 bits to IEEE 754 float, exact
+auto bfloat_to_float(std::uint16_t bits) -> float;
+
+/** @struct float16
+ *
+ *  IEEE 754 half precision value: 11 significant bits, finite up to 65504.
+ *  Holds small integer counts exactly up to 2048.
+ */
+struct float16 {
+  std::uint16_t bits{0};
+
+  float16() = default;
+  explicit float16(float value) : bits(float_to_half(value)) {}
+  explicit operator float() const { return half_to_float(bits); }
+
+  auto operator==(const float16 &o) const -> bool { return bits == o.bits; }
+};
+
+/** @struct bfloat16
+ *
+ *  Upper half of an IEEE 754 float: same range as float, 8 significant bits.
+ */
+struct bfloat16 {
+  std::uint16_t bits{0};
+
+  bfloat16() = default;
+  explicit bfloat16(float value) : bits(float_to_bfloat(value)) {}
+  explicit operator float() const { return bfloat_to_float(bits); }
+
+  auto operator==(const bfloat16 &o) const -> bool { return bits == o.bits; }
+};
+
+/**
+ *  Converts `n` values between `float`, `float16`, `bfloat16` and scaled
+ *  `uint8_t`, with AVX2 and F16C when the CPU supports them (see simd.hpp).
+ *  An `uint8_t` value `q` stands for `q * scale`. Converting to it rounds
+ *  to nearest and saturates at 0 and 255.
+ *  Converting between equal types copies values as is.
+ */
+template <class F, class T>
+void convert_values(const F *in, std::size_t n, T *out, float scale = 1.F);
+
+#endif // INCLUDE_HALF_HPP_
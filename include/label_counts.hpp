@@ -0,0 +1,120 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file label_counts.hpp
+//! Neighbor label counts, the node features of GraphSage counting
+//!
+
+#ifndef INCLUDE_LABEL_COUNTS_HPP_
+#define INCLUDE_LABEL_COUNTS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "csr_matrix.hpp"
+
+/**
+ *  Counts labels of neighbors of every node. Row `i` of the result is the
+ *  sum of rows `j` of `labels` over neighbors `j` of node `i`, weighted by
+ *  values of `adj`, i.e. the product `adj * labels`.
+ *  Rows are computed in parallel, each one in a per thread sparse
+ *  accumulator of `labels._ncols` elements, so apart from the result only
+ *  its index pointer is allocated. Column indices of each row are sorted.
+ *  The most compact layout the result fits into is used.
+ *
+ *  @param adj Adjacency matrix, `n x m`
+ *  @param labels Node label matrix, `m x nlabels`
+ *  @return `n x nlabels` matrix of label counts
+ */
+auto label_counts(const AnyCSR &adj, const AnyCSR &labels) -> AnyCSR;
+
+/**
+ *  Same as `label_counts`, but only for nodes `ixs`: row `k` of the result
+ *  holds label counts of node `ixs[k]`.
+ *  @param ixs List of nodes, negative ones count from the end
+ *  @return `size x nlabels` matrix of label counts
+ */
+auto label_counts(const AnyCSR &adj, const AnyCSR &labels, const int *ixs,
+                  std::size_t size) -> AnyCSR;
+
+/**
+ *  Same as `label_counts` for nodes `ixs`, but writes counts densely into a
+ *  caller owned buffer, without any intermediate allocations.
+ *  @param out Contiguous row-major buffer of `size * nlabels` elements,
+ *  completely overwritten
+ */
+void label_counts(const AnyCSR &adj, const AnyCSR &labels, const int *ixs,
+                  std::size_t size, float *out);
+
+/** @struct LabelChange
+ *
+ *  One label of `node` changed from `old_label` to `new_label`. A negative
+ *  label stands for none, so a label may be added or removed as well.
+ *  A replaced label passes its value on to the new one, an added label has
+ *  value one.
+ */
+struct LabelChange {
+  std::int64_t node;
+  std::int64_t old_label;
+  std::int64_t new_label;
+};
+
+/** @class LabelCounter
+ *
+ *  Neighbor label counts kept up to date as node labels change, e.g.
+ *  between iterations of label propagation.
+ *  Keeps the adjacency transposed, so that nodes having a changed node as a
+ *  neighbor are found directly, and counts of every node as a row sorted by
+ *  label. An update expands changes into count deltas of affected rows,
+ *  sorts them by row and applies each row's deltas on a TBB worker, so its
+ *  cost depends on the changes and degrees of changed nodes only.
+ *  Current labels of every node are kept too, so that deltas are weighted
+ *  by label values and changes of labels a node does not have are caught.
+ *
+ *  @param adj Adjacency matrix, `n x m`, with node ids below 2^32
+ *  @param labels Initial node label matrix, `m x nlabels`
+ */
+class LabelCounter {
+public:
+  struct Count {
+    std::uint32_t label;
+    float value;
+  };
+
+private:
+  std::size_t _nnodes;
+  std::size_t _nlabels;
+  /// nodes having node `j` as a neighbor are
+  /// `_in_nodes[_in_ptr[j]:_in_ptr[j+1]]`, with edge values `_in_weights`
+  std::vector<std::uint64_t> _in_ptr;
+  std::vector<std::uint32_t> _in_nodes;
+  std::vector<float> _in_weights;
+  /// non-zero label counts of each node, sorted by label
+  std::vector<std::vector<Count>> _rows;
+  /// current labels of each neighbor node and their values, sorted by label
+  std::vector<std::vector<Count>> _labels;
+
+public:
+  LabelCounter(const AnyCSR &adj, const AnyCSR &labels);
+
+  /// Applies label changes in order. Throws before changing anything if a
+  /// node or a label is out of range, `old_label` is not a current label
+  /// of the node or `new_label` already is one.
+  void update(const LabelChange *changes, std::size_t size);
+
+  /// Counts of node `ixi`, which counts from the end when negative
+  auto row(int ixi) const -> const std::vector<Count> &;
+
+  /// Same as `CSR::slice`: writes counts of nodes `ixs` into a contiguous
+  /// row-major buffer of `size * nlabels()` elements
+  void slice(const int *ixs, std::size_t size, float *out) const;
+
+  /// Snapshot of all counts, same as `label_counts` of the current labels
+  auto to_csr() const -> AnyCSR;
+
+  auto nnodes() const -> std::size_t { return _nnodes; }
+  auto nlabels() const -> std::size_t { return _nlabels; }
+};
+
+#endif // INCLUDE_LABEL_COUNTS_HPP_
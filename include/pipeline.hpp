@@ -0,0 +1,117 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file pipeline.hpp
+//! Asynchronous mini-batch slicing that overlaps with training
+//!
+
+#ifndef INCLUDE_PIPELINE_HPP_
+#define INCLUDE_PIPELINE_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "csr_matrix.hpp"
+#include "tbb/task_arena.h"
+
+/** @struct Batch
+ *
+ *  Dense slice of one mini-batch, owned by a `BatchPipeline`.
+ */
+struct Batch {
+  /// row-major `size x ncols` matrix
+  const float *data;
+  /// rows the batch was sliced with
+  const int *ixs;
+  size_t size;
+  /// position of the batch in the sequence
+  size_t index;
+};
+
+/** @class BatchPipeline
+ *
+ *  Slices a sequence of index batches ahead of the consumer.
+ *  A producer thread slices up to `depth` batches in the background into a
+ *  ring of reusable buffers, while the consumer trains on the batch returned
+ *  last. Slicing runs on a dedicated TBB arena, so it does not compete with
+ *  other parallel work of the consumer. A batch stays valid until the next
+ *  call to `next`, which recycles its buffer.
+ *
+ *  @param m Matrix to slice, kept alive by the pipeline
+ *  @param ixs Concatenated index batches
+ *  @param offsets Batch `b` is `ixs[offsets[b]:offsets[b+1]]`
+ *  @param depth Number of batches sliced ahead
+ */
+class BatchPipeline {
+  struct Slot {
+    std::vector<float> data;
+    std::exception_ptr error;
+  };
+
+  AnyCSR _m;
+  size_t _ncols;
+  std::vector<int> _ixs;
+  std::vector<size_t> _offsets;
+
+  /// batch `b` is sliced into `_slots[b % _slots.size()]`
+  std::vector<Slot> _slots;
+  /// number of batches sliced so far
+  size_t _produced{0};
+  /// batch to hand out next
+  size_t _next{0};
+  /// the consumer holds batch `_next - 1`
+  bool _held{false};
+  bool _cancelled{false};
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+  tbb::task_arena _arena;
+  std::thread _producer;
+
+  auto nbatches() const -> size_t { return _offsets.size() - 1; }
+
+  /// Producer loop, slices batches while there are free slots
+  void produce();
+
+public:
+  BatchPipeline(AnyCSR m, std::vector<int> ixs, std::vector<size_t> offsets,
+                size_t depth = 2);
+
+  /**
+   *  All rows in a random order, split into batches of `batch_size`.
+   *  @param seed Seed of the shuffle, the same seed gives the same batches
+   *  @param drop_last Drop the last batch if it is smaller than `batch_size`
+   */
+  static auto shuffled(AnyCSR m, size_t batch_size, std::uint64_t seed,
+                       bool drop_last = false, size_t depth = 2)
+      -> BatchPipeline *;
+
+  /// Stops background slicing
+  ~BatchPipeline();
+
+  BatchPipeline(const BatchPipeline &) = delete;
+  auto operator=(const BatchPipeline &) -> BatchPipeline & = delete;
+
+  /**
+   *  Releases the batch returned last and gets the next one.
+   *  @param out Next batch, set when true is returned
+   *  @param block Wait for the batch to be sliced, otherwise return false
+   *  if it is not ready yet
+   *  @return false when the batch is not ready or there are no more batches,
+   *  tell these apart with `done`. Rethrows errors of slicing the batch.
+   */
+  auto next(Batch &out, bool block = true) -> bool;
+
+  /// All batches have been handed out
+  auto done() const -> bool { return _next == nbatches(); }
+
+  auto ncols() const -> size_t { return _ncols; }
+};
+
+#endif // INCLUDE_PIPELINE_HPP_
@@ -0,0 +1,145 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file placement.hpp
+//! Huge page and NUMA aware memory for matrix arrays
+//!
+
+#ifndef INCLUDE_PLACEMENT_HPP_
+#define INCLUDE_PLACEMENT_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "buffer.hpp"
+
+/// Pages backing matrix arrays. Random row access touches a new page per
+/// row, 2 MiB pages cover the same memory with 512 times fewer TLB entries.
+enum class PageSize : int {
+  /// regular pages of the allocator
+  normal = 0,
+  /// 2 MiB aligned anonymous memory advised to be backed by transparent
+  /// huge pages, silently falls back to regular ones
+  transparent = 1,
+  /// pages of the hugetlbfs pool, which has to be reserved beforehand
+  /// (`vm.nr_hugepages`), allocation throws if it is exhausted
+  huge = 2,
+};
+
+/// Placement of matrix arrays across NUMA nodes
+enum class NumaPolicy : int {
+  /// pages stay where they are first touched
+  local = 0,
+  /// pages are spread over all nodes round robin, so that every node sees
+  /// the same average latency and bandwidth
+  interleave = 1,
+  /// every node gets its own copy, slices read the copy of the node the
+  /// slicing thread runs on. Takes as many times more memory as there are
+  /// nodes.
+  replicate = 2,
+};
+
+/** @struct Placement
+ *
+ *  Where arrays of a loaded matrix live. The default keeps the arrays in
+ *  regular vectors.
+ */
+struct Placement {
+  PageSize pages{PageSize::normal};
+  NumaPolicy numa{NumaPolicy::local};
+
+  auto is_default() const -> bool {
+    return pages == PageSize::normal && numa == NumaPolicy::local;
+  }
+};
+
+/// Number of NUMA nodes of the machine, one if it is not NUMA or unknown
+auto numa_nodes() -> int;
+
+/// NUMA node of the CPU the calling thread runs on
+auto current_numa_node() -> int;
+
+/** @class PagedMemory
+ *
+ *  Anonymous private memory mapping placed according to `PageSize` and
+ *  `NumaPolicy`. Pages are not touched, so placement applies to whichever
+ *  thread touches them first. Binding to nodes is a hint, it is skipped
+ *  when the kernel does not support it.
+ *
+ *  @param size Size in bytes, rounded up to whole pages
+ *  @param node Bind pages to this node instead of following `numa`
+ */
+class PagedMemory {
+  void *_data{nullptr};
+  std::size_t _size{0};
+
+public:
+  PagedMemory(std::size_t size, Placement placement, int node = -1);
+  ~PagedMemory();
+
+  PagedMemory(const PagedMemory &) = delete;
+  auto operator=(const PagedMemory &) -> PagedMemory & = delete;
+
+  auto data() const -> void * { return _data; }
+  auto size() const -> std::size_t { return _size; }
+};
+
+/**
+ *  Copies `n` elements into memory placed by `placement`. Pages are first
+ *  touched by TBB workers copying them.
+ *  @param node Bind pages to this node instead of following the policy
+ */
+template <class T>
+auto place_buffer(const T *data, std::size_t n, Placement placement,
+                  int node = -1) -> Buffer<T>;
+
+/** @class PageAllocator
+ *
+ *  Allocator of standard containers backed by `PagedMemory`, e.g. for
+ *  output buffers that are written by many threads. Allocations smaller
+ *  than a huge page and ones with the default placement use `operator new`.
+ */
+template <class T> class PageAllocator {
+  Placement _placement;
+
+public:
+  using value_type = T;
+  // placement follows the elements, e.g. into a matrix assigned from `place`
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  PageAllocator() = default;
+  explicit PageAllocator(Placement placement) : _placement(placement) {}
+  template <class U>
+  PageAllocator(const PageAllocator<U> &o) : _placement(o.placement()) {}
+
+  auto placement() const -> Placement { return _placement; }
+
+  auto allocate(std::size_t n) -> T *;
+  void deallocate(T *p, std::size_t n);
+
+  /// Leaves elements uninitialized on resize, so that pages are first
+  /// touched by the threads writing them rather than by the resizing one
+  template <class U> void construct(U *p) {
+    ::new (static_cast<void *>(p)) U;
+  }
+  template <class U, class... Args> void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  auto operator==(const PageAllocator<U> &o) const -> bool {
+    return _placement.pages == o.placement().pages &&
+           _placement.numa == o.placement().numa;
+  }
+  template <class U>
+  auto operator!=(const PageAllocator<U> &o) const -> bool {
+    return !(*this == o);
+  }
+};
+
+#endif // INCLUDE_PLACEMENT_HPP_
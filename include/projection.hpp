@@ -0,0 +1,45 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file projection.hpp
+//! Column subsets to slice matrices with
+//!
+
+#ifndef INCLUDE_PROJECTION_HPP_
+#define INCLUDE_PROJECTION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** @class ColumnProjection
+ *
+ *  Selection of `size()` columns of matrices of `ncols()` columns, e.g. the
+ *  labels a head is trained on. Output column `k` of a projected slice is
+ *  column `columns()[k]`. Every column is remapped to its output position
+ *  or to the sink position `size()` if it is not selected, so that slicing
+ *  skips columns with a table lookup instead of a branch. Build it once and
+ *  reuse it for every slice of the same columns.
+ *
+ *  @param columns Distinct columns in output order, negative ones count
+ *  from the end
+ */
+class ColumnProjection {
+  std::size_t _ncols;
+  std::vector<std::uint32_t> _columns;
+  /// output position of each column, `size()` for unselected ones
+  std::vector<std::uint32_t> _remap;
+
+public:
+  ColumnProjection(std::size_t ncols, const std::int64_t *columns,
+                   std::size_t size);
+
+  auto ncols() const -> std::size_t { return _ncols; }
+  auto size() const -> std::size_t { return _columns.size(); }
+  auto columns() const -> const std::vector<std::uint32_t> & {
+    return _columns;
+  }
+  auto remap() const -> const std::uint32_t * { return _remap.data(); }
+};
+
+#endif // INCLUDE_PROJECTION_HPP_
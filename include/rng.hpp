@@ -0,0 +1,50 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file rng.hpp
+//! Random streams that do not depend on how parallel work is scheduled
+//!
+
+#ifndef INCLUDE_RNG_HPP_
+#define INCLUDE_RNG_HPP_
+
+#include <cstdint>
+
+/** @struct SplitMix64
+ *
+ *  SplitMix64 generator, cheap to seed for every node, row or block
+ */
+struct SplitMix64 {
+  std::uint64_t state;
+
+  static auto mix(std::uint64_t z) -> std::uint64_t {
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31U);
+  }
+
+  auto next() -> std::uint64_t {
+    state += 0x9E3779B97F4A7C15ULL;
+    return mix(state);
+  }
+
+  /// Uniform in [0, n), the modulo bias is negligible for n much less
+  /// than 2^64
+  auto below(std::uint64_t n) -> std::uint64_t { return next() % n; }
+
+  /// Uniform in [0, 1) with 53 random bits
+  auto uniform() -> double { return to_unit(next()); }
+
+  static auto to_unit(std::uint64_t x) -> double {
+    return static_cast<double>(x >> 11U) * 0x1.0p-53;
+  }
+};
+
+/// Independent stream of `key`, starting points of streams are scattered
+/// by mixing, so that they do not overlap
+inline auto random_stream(std::uint64_t seed, std::uint64_t key)
+    -> SplitMix64 {
+  return SplitMix64{SplitMix64::mix(seed ^ SplitMix64::mix(key))};
+}
+
+#endif // INCLUDE_RNG_HPP_
@@ -0,0 +1,54 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file sampler.hpp
+//! GraphSage fixed fanout neighbor sampling
+//!
+
+#ifndef INCLUDE_SAMPLER_HPP_
+#define INCLUDE_SAMPLER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "csr_matrix.hpp"
+
+/** @struct SampledBlock
+ *
+ *  Edges sampled at one hop, a bipartite graph from `src_nodes` to
+ *  `dst_nodes`. Edges are stored as a CSR index pointer over destination
+ *  nodes: sampled neighbors of `dst_nodes[i]` are
+ *  `src_nodes[indices[indptr[i]:indptr[i+1]]]`.
+ */
+struct SampledBlock {
+  /// nodes sampled from, the frontier of the hop
+  std::vector<int> dst_nodes;
+  /// `dst_nodes` followed by nodes first reached at this hop, in increasing
+  /// order. Feed them to `CSR::slice` to get features of the block.
+  std::vector<int> src_nodes;
+  std::vector<std::int64_t> indptr;
+  /// positions of sampled neighbors in `src_nodes`
+  std::vector<std::int64_t> indices;
+};
+
+/**
+ *  Samples neighbors of `seeds` hop by hop, as in GraphSage mini-batches.
+ *  At hop `h` up to `fanouts[h]` distinct neighbors of every frontier node
+ *  are sampled without replacement, all of them when it has fewer or the
+ *  fanout is negative. Nodes are sampled in parallel, each from its own
+ *  random stream derived from `seed`, the hop and the node, so samples do
+ *  not depend on how the work is scheduled.
+ *
+ *  @param adj Adjacency matrix, neighbors of a node are its row
+ *  @param seeds Nodes to sample from, negative ones count from the end
+ *  @param fanouts Number of neighbors to sample at each hop
+ *  @param seed Seed of the random streams
+ *  @return a block per hop, `blocks[0].dst_nodes` are `seeds` and
+ *  `blocks[h + 1].dst_nodes` are `blocks[h].src_nodes`
+ */
+auto sample_blocks(const AnyCSR &adj, const int *seeds, std::size_t size,
+                   const std::vector<int> &fanouts, std::uint64_t seed)
+    -> std::vector<SampledBlock>;
+
+#endif // INCLUDE_SAMPLER_HPP_
@@ -0,0 +1,95 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file sharded.hpp
+//! Out-of-core slicing of matrices saved in row range shards
+//!
+
+#ifndef INCLUDE_SHARDED_HPP_
+#define INCLUDE_SHARDED_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "csr_matrix.hpp"
+
+/** @class ShardedCSR
+ *
+ *  Matrix saved by `BasicCSR::save_sharded`, which may exceed memory. Only
+ *  the shard map and the index pointer of the whole matrix stay resident,
+ *  shards are loaded on demand and kept in a least recently used cache of
+ *  a bounded number of shards. Shards keep their stored layout and value
+ *  type (see `load_any`).
+ *
+ *  A slice groups its rows by shard, so that a batch loads every shard it
+ *  touches at most once, however its rows are ordered. Shards in use stay
+ *  alive while they are sliced even if they are evicted meanwhile.
+ *
+ *  @param fname Index file written by `save_sharded`
+ *  @param max_resident Most shards kept in memory, at least one
+ *  @param trusted Skip validation of shards (see `BasicCSR::load`)
+ */
+class ShardedCSR {
+  std::string _fname;
+  std::size_t _nrows;
+  std::size_t _ncols;
+  /// shard `k` holds rows `_row_starts[k]:_row_starts[k+1]`
+  std::vector<std::uint64_t> _row_starts;
+  std::vector<std::uint64_t> _indptr;
+  std::size_t _max_resident;
+  bool _trusted;
+
+  mutable std::mutex _mutex;
+  /// resident shards, the most recently used first
+  mutable std::list<std::pair<std::size_t, AnyCSR>> _lru;
+  mutable std::unordered_map<std::size_t, decltype(_lru)::iterator> _resident;
+  mutable std::uint64_t _loads{0};
+
+public:
+  explicit ShardedCSR(const std::string &fname, std::size_t max_resident = 4,
+                      bool trusted = false);
+
+  ShardedCSR(const ShardedCSR &) = delete;
+  auto operator=(const ShardedCSR &) -> ShardedCSR & = delete;
+
+  auto nrows() const -> std::size_t { return _nrows; }
+  auto ncols() const -> std::size_t { return _ncols; }
+  auto nshards() const -> std::size_t { return _row_starts.size() - 1; }
+  auto nnz() const -> std::size_t { return _indptr.back(); }
+
+  /// Index pointer of the whole matrix
+  auto indptr() const -> const std::vector<std::uint64_t> & {
+    return _indptr;
+  }
+
+  /// Shard holding row `row`
+  auto shard_of(std::size_t row) const -> std::size_t;
+
+  /// Shard `k`, loaded unless it is resident
+  auto shard(std::size_t k) const -> AnyCSR;
+
+  /// Number of resident shards
+  auto resident() const -> std::size_t;
+
+  /// Number of shard loads so far, a measure of cache misses
+  auto loads() const -> std::uint64_t;
+
+  /// Row index of `ixi`, which counts from the end when negative.
+  /// Throws if it is out of range.
+  auto _row(int ixi) const -> std::size_t;
+
+  /// Same as `CSR::slice`: writes rows `ixs` into a contiguous row-major
+  /// buffer of `size * ncols()` floats
+  void slice(const int *ixs, std::size_t size, float *out) const;
+
+  /// Number of non-zeros in rows `ixs`, no shard is loaded
+  auto slice_nnz(const int *ixs, std::size_t size) const -> std::size_t;
+};
+
+#endif // INCLUDE_SHARDED_HPP_
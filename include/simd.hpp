@@ -0,0 +1,21 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file simd.hpp
+//! Runtime dispatch of vectorized kernels
+//!
+
+#ifndef INCLUDE_SIMD_HPP_
+#define INCLUDE_SIMD_HPP_
+
+/// Instruction sets kernels may be specialized for, in increasing order
+enum class SimdLevel : int { scalar = 0, avx2 = 1, avx512 = 2 };
+
+/// Best instruction set supported by the CPU, capped by `set_simd_level`
+auto simd_level() -> SimdLevel;
+
+/// Caps instruction set used by kernels, e.g. to compare their outputs or
+/// speed. Kernels never use instructions the CPU does not support.
+void set_simd_level(SimdLevel level);
+
+#endif // INCLUDE_SIMD_HPP_
@@ -0,0 +1,145 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file slice_server.hpp
+//! Local service slicing one matrix for many processes
+//!
+
+#ifndef INCLUDE_SLICE_SERVER_HPP_
+#define INCLUDE_SLICE_SERVER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "csr_matrix.hpp"
+#include "tbb/task_arena.h"
+
+//! Trainer processes of a host share a matrix through a `SliceServer`
+//! instead of loading a copy each. A client creates a ring of `slots`
+//! shared memory slots, seals it against resizing and passes it to the
+//! server over a Unix domain socket when it connects, the server refuses
+//! rings that may shrink under it. The client then sends batches of row
+//! indices over the socket, each naming a slot, and the server writes dense
+//! rows into the slot and replies once they are there. Requests of a client
+//! are served in order, so a client may have a request in flight per slot.
+
+/** @class SliceServer
+ *
+ *  Serves slices of `m` to clients connecting to a Unix domain socket at
+ *  `path`, which is replaced if it exists and removed when the server
+ *  stops. Every client is served by its own thread, which only waits for
+ *  requests, slicing runs on one TBB arena shared by all clients, so the
+ *  host is not oversubscribed however many clients there are.
+ *
+ *  @param m Matrix to serve, kept alive by the server
+ *  @param path Socket path, at most 107 bytes
+ *  @param nthreads Threads of the slicing arena, zero for all cores
+ */
+class SliceServer {
+  struct Connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  AnyCSR _m;
+  size_t _ncols;
+  std::string _path;
+  int _listen_fd{-1};
+  tbb::task_arena _arena;
+
+  std::mutex _mutex;
+  bool _stopped{false};
+  std::list<Connection> _connections;
+  std::thread _acceptor;
+
+  /// Accepts clients until the server stops
+  void accept_loop();
+
+  /// Serves requests of a client until it disconnects or the server stops
+  void serve(Connection &c);
+
+public:
+  SliceServer(AnyCSR m, const std::string &path, int nthreads = 0);
+
+  /// Stops the server, see `stop`
+  ~SliceServer();
+
+  SliceServer(const SliceServer &) = delete;
+  auto operator=(const SliceServer &) -> SliceServer & = delete;
+
+  /// Disconnects clients, waits for requests being served and removes the
+  /// socket. Clients fail their next requests.
+  void stop();
+
+  /// Number of connected clients
+  auto nclients() -> size_t;
+
+  auto path() const -> const std::string & { return _path; }
+};
+
+/** @class SliceClient
+ *
+ *  Connection to a `SliceServer`, slicing like `CSR::slice` in the server
+ *  process. Calls of a client are serialized, use a client per thread to
+ *  slice concurrently.
+ *
+ *  @param path Socket path of the server
+ *  @param slots Number of slots of the shared memory ring
+ *  @param slot_bytes Size of a slot, bounds rows of a request
+ */
+class SliceClient {
+  int _fd{-1};
+  size_t _nrows{0};
+  size_t _ncols{0};
+  size_t _slots;
+  size_t _slot_bytes;
+  char *_ring{nullptr};
+  /// slot of the next request
+  size_t _next{0};
+  std::mutex _mutex;
+
+  /// Sends a request for rows `ixs` to be written into `slot`
+  void send(const int *ixs, size_t size, size_t slot);
+
+  /// Waits for the reply to the oldest request in flight, returns an
+  /// error message of the server or an empty string. The reply to a hello
+  /// carries the shape of the matrix.
+  auto receive(size_t *nrows = nullptr, size_t *ncols = nullptr)
+      -> std::string;
+
+  /// Disconnects and unmaps the ring
+  void close();
+
+public:
+  explicit SliceClient(const std::string &path, size_t slots = 4,
+                       size_t slot_bytes = size_t{64} << 20U);
+
+  ~SliceClient();
+
+  SliceClient(const SliceClient &) = delete;
+  auto operator=(const SliceClient &) -> SliceClient & = delete;
+
+  auto nrows() const -> size_t { return _nrows; }
+  auto ncols() const -> size_t { return _ncols; }
+  auto slots() const -> size_t { return _slots; }
+
+  /// Most rows a slot holds
+  auto slot_rows() const -> size_t;
+
+  /// Slices rows `ixs` into the next slot of the ring, without a copy.
+  /// The rows stay valid until the slot is reused `slots()` requests later.
+  /// Throws if they do not fit into a slot.
+  auto slice(const int *ixs, size_t size) -> const float *;
+
+  /// Slices rows `ixs` into `size * ncols()` floats at `out`, any number
+  /// of them. Requests of `slot_rows()` rows are pipelined over the ring,
+  /// the server slices one while rows of another are copied out.
+  void slice(const int *ixs, size_t size, float *out);
+};
+
+#endif // INCLUDE_SLICE_SERVER_HPP_
@@ -0,0 +1,116 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file stats.hpp
+//! Runtime counters and latency histograms of library operations
+//!
+
+#ifndef INCLUDE_STATS_HPP_
+#define INCLUDE_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/// Instrumented operations. Phases of a slice are recorded per block of
+/// rows of a worker, so their calls are blocks rather than slices.
+enum class Stat : int {
+  /// `BasicCSR::slice` calls, rows sliced and bytes written
+  slice = 0,
+  /// resolving and range checking of row indices of a slice
+  slice_validate = 1,
+  /// zeroing output rows of a slice
+  slice_fill = 2,
+  /// scattering non-zeros into output rows of a slice
+  slice_scatter = 3,
+  /// `BasicCSR::load` calls, rows and file bytes read
+  load = 4,
+  /// `BasicCSR::load_mmap` calls, rows and file bytes mapped
+  map = 5,
+  /// `BasicCSR::save` calls, rows and file bytes written
+  save = 6,
+  /// sorted runs of `ExternalSorter`, records and bytes written
+  sort_run = 7,
+  /// intermediate merge passes of `ExternalSorter`, records and bytes
+  sort_merge = 8,
+};
+
+constexpr std::size_t NSTATS = 9;
+
+/// Latency histogram buckets: bucket `k` counts latencies in
+/// [2^k, 2^(k+1)) nanoseconds, the last one everything longer
+constexpr std::size_t NLATENCY_BUCKETS = 40;
+
+auto stat_name(Stat stat) -> const char *;
+
+/** @struct StatSnapshot
+ *
+ *  Totals of an operation since the last `reset_stats`
+ */
+struct StatSnapshot {
+  std::uint64_t calls{0};
+  std::uint64_t rows{0};
+  std::uint64_t bytes{0};
+  std::uint64_t total_ns{0};
+  std::uint64_t max_ns{0};
+  std::uint64_t histogram[NLATENCY_BUCKETS]{};
+};
+
+/// Collection is off unless enabled here or by a non-zero `GSC_STATS`
+/// environment variable. When off, instrumented code only reads a flag.
+void set_stats_enabled(bool enabled);
+auto stats_enabled() -> bool;
+
+/// Adds a call of `stat` to its counters, safe to call from any thread
+void record_stat(Stat stat, std::uint64_t ns, std::uint64_t rows,
+                 std::uint64_t bytes);
+
+/// Consistent per counter, but calls recorded concurrently may be counted
+/// by some counters and not yet by others
+auto stats_snapshot(Stat stat) -> StatSnapshot;
+
+void reset_stats();
+
+/** @class StatTimer
+ *
+ *  Records the lifetime of a scope as a call of `stat`, when collection is
+ *  enabled at construction. A scope left by an exception is recorded too.
+ */
+class StatTimer {
+  using clock = std::chrono::steady_clock;
+
+  Stat _stat;
+  bool _enabled;
+  clock::time_point _start;
+  std::uint64_t _rows{0};
+  std::uint64_t _bytes{0};
+
+public:
+  explicit StatTimer(Stat stat, std::uint64_t rows = 0,
+                     std::uint64_t bytes = 0)
+      : _stat(stat), _enabled(stats_enabled()), _rows(rows), _bytes(bytes) {
+    if (_enabled) {
+      _start = clock::now();
+    }
+  }
+  ~StatTimer() {
+    if (_enabled) {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock::now() - _start);
+      record_stat(_stat, static_cast<std::uint64_t>(ns.count()), _rows,
+                  _bytes);
+    }
+  }
+
+  StatTimer(const StatTimer &) = delete;
+  auto operator=(const StatTimer &) -> StatTimer & = delete;
+
+  /// Sets amounts processed when they are known only at the end
+  void set(std::uint64_t rows, std::uint64_t bytes) {
+    _rows = rows;
+    _bytes = bytes;
+  }
+};
+
+#endif // INCLUDE_STATS_HPP_
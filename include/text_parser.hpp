@@ -0,0 +1,69 @@
+// "Copyright 2020 Kirill Konevets"
+
+//!
+//! @file text_parser.hpp
+//! Parallel parsing of text edge and adjacency lists into binary ones
+//!
+
+#ifndef INCLUDE_TEXT_PARSER_HPP_
+#define INCLUDE_TEXT_PARSER_HPP_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** @struct ParseStats
+ *
+ *  Outcome of parsing a text file: counts, malformed lines and timing.
+ */
+struct ParseStats {
+  /// at most that many malformed line numbers are kept
+  static constexpr std::size_t MAX_REPORTED = 100;
+
+  std::size_t bytes{0};
+  std::size_t lines{0};
+  /// number of records written, blank lines are skipped
+  std::size_t records{0};
+  std::size_t malformed{0};
+  /// 1-based numbers of the first `MAX_REPORTED` malformed lines
+  std::vector<std::size_t> malformed_lines;
+  double seconds{0};
+
+  /// Parsed megabytes per second
+  auto throughput() const -> double {
+    return seconds > 0 ? static_cast<double>(bytes) / seconds / 1e6 : 0;
+  }
+
+  friend auto operator<<(std::ostream &os, const ParseStats &stats)
+      -> std::ostream &;
+};
+
+/**
+ *  Parses a text edge list, a "source target" pair of unsigned integers per
+ *  line, into a binary list of `EdgeItem<uint32_t>` read by
+ *  `ExternalSorter`.
+ *  The file is memory mapped and split into newline aligned chunks of about
+ *  `chunk_size` bytes, chunks are parsed on TBB workers with
+ *  `std::from_chars` and written in order. Fields are separated by spaces
+ *  or tabs, blank lines are skipped and malformed lines are counted and
+ *  skipped, not written.
+ *
+ *  @param text_fname Text file to parse
+ *  @param bin_fname Binary file to write
+ *  @param chunk_size Size of a chunk parsed by one task, in bytes
+ */
+auto parse_edges(const std::string &text_fname, const std::string &bin_fname,
+                 std::size_t chunk_size = std::size_t{1} << 24U)
+    -> ParseStats;
+
+/**
+ *  Same as `parse_edges`, but for an adjacency list, a source followed by
+ *  its targets per line, into a binary list of `AdjItem<uint32_t>`.
+ */
+auto parse_adjacency(const std::string &text_fname,
+                     const std::string &bin_fname,
+                     std::size_t chunk_size = std::size_t{1} << 24U)
+    -> ParseStats;
+
+#endif // INCLUDE_TEXT_PARSER_HPP_
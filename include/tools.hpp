@@ -8,8 +8,10 @@
 #ifndef INCLUDE_TOOLS_HPP_
 #define INCLUDE_TOOLS_HPP_
 
-#include <vector>
+#include <cstddef>
 #include <iostream>
+#include <string>
+#include <vector>
 
 /** @struct EdgeItem
  *
@@ -25,6 +27,15 @@ template <class T> struct EdgeItem : std::pair<T, T> {
 
   static auto decode(std::istream &is, EdgeItem<T> &edge) -> bool;
 
+  /// Writes `n` edges with a single write, edges are stored as pairs of `T`
+  static auto encode_block(std::ostream &os, const EdgeItem<T> *edges,
+                           std::size_t n) -> bool;
+
+  /// Reads up to `n` edges into `edges` with a single read
+  /// @return number of edges read, less than `n` at the end of a stream
+  static auto decode_block(std::istream &is, EdgeItem<T> *edges,
+                           std::size_t n) -> std::size_t;
+
   friend auto operator>>(std::istream &is, EdgeItem<T> &edge) -> std::istream &;
 
   friend auto operator<<(std::ostream &os, const EdgeItem<T> &edge)
@@ -51,6 +62,17 @@ template <class T> struct AdjItem {
 
   static auto decode(std::istream &is, AdjItem<T> &row) -> bool;
 
+  /// Writes `n` rows staged in one contiguous buffer with a single write
+  static auto encode_block(std::ostream &os, const AdjItem<T> *rows,
+                           std::size_t n) -> bool;
+
+  /// Reads up to `n` rows into `rows`, reusing storage of `rows`. Rows are
+  /// parsed out of large reads and bytes read past the last row are sought
+  /// back, a stream that cannot seek is read row by row.
+  /// @return number of rows read, less than `n` at the end of a stream
+  static auto decode_block(std::istream &is, AdjItem<T> *rows, std::size_t n)
+      -> std::size_t;
+
   friend auto operator>>(std::istream &is, AdjItem<T> &row) -> std::istream &;
 
   friend auto operator<<(std::ostream &os, const AdjItem<T> &row)
@@ -70,4 +92,27 @@ template <class T> struct AdjItem {
  */
 template <class T> auto read_vec(const std::string &fname) -> std::vector<T>;
 
+/** @class MappedFile
+ *
+ *  @brief Read-only shared memory mapping of a whole file
+ *
+ *  Pages are served straight from the page cache, so several processes
+ *  mapping the same file share one physical copy of it.
+ *  @param fname File name to map
+ */
+class MappedFile {
+  const char *_data{nullptr};
+  std::size_t _size{0};
+
+public:
+  explicit MappedFile(const std::string &fname);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+  auto data() const -> const char * { return _data; }
+  auto size() const -> std::size_t { return _size; }
+};
+
 #endif // INCLUDE_TOOLS_HPP_
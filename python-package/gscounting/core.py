@@ -17,15 +17,219 @@ class SliceArgs(ctypes.Structure):
     ]
 
 
+class ProjectionArgs(ctypes.Structure):
+    _fields_ = [
+        ('ncols', ctypes.c_uint64),
+        ('columns', ctypes.POINTER(ctypes.c_int64)),
+        ('len', ctypes.c_uint64),
+        ('handle_out', ctypes.c_void_p),
+    ]
+
+
+class ProjectedSliceArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('projection', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('data_out', ctypes.POINTER(ctypes.c_float)),
+    ]
+
+
+class SparseSliceArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('nnz', ctypes.c_uint64),
+        ('indptr_out', ctypes.POINTER(ctypes.c_int64)),
+        ('indices_out', ctypes.POINTER(ctypes.c_int64)),
+        ('data_out', ctypes.POINTER(ctypes.c_float)),
+    ]
+
+
+class SliceAsArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('dtype', ctypes.c_int),
+        ('data_out', ctypes.c_void_p),
+    ]
+
+
+class ConvertArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('dtype', ctypes.c_int),
+        ('scale', ctypes.c_float),
+        ('handle_out', ctypes.c_void_p),
+    ]
+
+
+# value dtypes of the binary format
+DTYPES = {'float32': 1, 'float16': 4, 'bfloat16': 5, 'uint8': 6,
+          'pattern': 7}
+# widths of index arrays, signed ones are viewed as unsigned
+INDEX_DTYPES = {4: 2, 8: 3}
+
+
+class BatchPipelineArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('offsets', ctypes.POINTER(ctypes.c_uint64)),
+        ('nbatches', ctypes.c_uint64),
+        ('batch_size', ctypes.c_uint64),
+        ('seed', ctypes.c_uint64),
+        ('drop_last', ctypes.c_int),
+        ('depth', ctypes.c_uint64),
+        ('handle_out', ctypes.c_void_p),
+    ]
+
+
+class BatchArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('block', ctypes.c_int),
+        ('ready_out', ctypes.c_int),
+        ('done_out', ctypes.c_int),
+        ('idxset_out', ctypes.POINTER(ctypes.c_int)),
+        ('len_out', ctypes.c_uint64),
+        ('data_out', ctypes.POINTER(ctypes.c_float)),
+    ]
+
+
+class LabelCountArgs(ctypes.Structure):
+    _fields_ = [
+        ('adj', ctypes.c_void_p),
+        ('labels', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('data_out', ctypes.POINTER(ctypes.c_float)),
+        ('handle_out', ctypes.c_void_p),
+        ('nrows_out', ctypes.c_uint64),
+        ('ncols_out', ctypes.c_uint64),
+    ]
+
+
+class SampleArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('idxset', ctypes.POINTER(ctypes.c_int)),
+        ('len', ctypes.c_uint64),
+        ('fanouts', ctypes.POINTER(ctypes.c_int)),
+        ('nhops', ctypes.c_uint64),
+        ('seed', ctypes.c_uint64),
+        ('handle_out', ctypes.c_void_p),
+    ]
+
+
+class SampledBlockArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('hop', ctypes.c_uint64),
+        ('dst_nodes_out', ctypes.POINTER(ctypes.c_int)),
+        ('ndst_out', ctypes.c_uint64),
+        ('src_nodes_out', ctypes.POINTER(ctypes.c_int)),
+        ('nsrc_out', ctypes.c_uint64),
+        ('indptr_out', ctypes.POINTER(ctypes.c_int64)),
+        ('indices_out', ctypes.POINTER(ctypes.c_int64)),
+        ('nnz_out', ctypes.c_uint64),
+    ]
+
+
 class LoadArgs(ctypes.Structure):
     _fields_ = [
         ('fname', ctypes.c_char_p),
         ('handle_out', ctypes.c_void_p),
         ('nrows_out', ctypes.c_uint64),
         ('ncols_out', ctypes.c_uint64),
+        ('pages', ctypes.c_int),
+        ('numa', ctypes.c_int),
+        ('trusted', ctypes.c_int),
+    ]
+
+
+class SliceServerArgs(ctypes.Structure):
+    _fields_ = [
+        ('handle', ctypes.c_void_p),
+        ('path', ctypes.c_char_p),
+        ('nthreads', ctypes.c_int),
+        ('handle_out', ctypes.c_void_p),
     ]
 
 
+class RemoteCSRArgs(ctypes.Structure):
+    _fields_ = [
+        ('path', ctypes.c_char_p),
+        ('slots', ctypes.c_uint64),
+        ('slot_bytes', ctypes.c_uint64),
+        ('handle_out', ctypes.c_void_p),
+        ('nrows_out', ctypes.c_uint64),
+        ('ncols_out', ctypes.c_uint64),
+    ]
+
+
+RELEASE_FUNC = ctypes.CFUNCTYPE(None, ctypes.c_void_p)
+
+
+class FromArraysArgs(ctypes.Structure):
+    _fields_ = [
+        ('data', ctypes.c_void_p),
+        ('indices', ctypes.c_void_p),
+        ('indptr', ctypes.c_void_p),
+        ('nrows', ctypes.c_uint64),
+        ('ncols', ctypes.c_uint64),
+        ('nnz', ctypes.c_uint64),
+        ('dtype', ctypes.c_int),
+        ('index_dtype', ctypes.c_int),
+        ('indptr_dtype', ctypes.c_int),
+        ('scale', ctypes.c_float),
+        ('copy', ctypes.c_int),
+        ('trusted', ctypes.c_int),
+        ('release', RELEASE_FUNC),
+        ('release_ctx', ctypes.c_void_p),
+        ('handle_out', ctypes.c_void_p),
+    ]
+
+
+class ShardedLoadArgs(ctypes.Structure):
+    _fields_ = [
+        ('fname', ctypes.c_char_p),
+        ('max_resident', ctypes.c_uint64),
+        ('trusted', ctypes.c_int),
+        ('handle_out', ctypes.c_void_p),
+        ('nrows_out', ctypes.c_uint64),
+        ('ncols_out', ctypes.c_uint64),
+        ('nshards_out', ctypes.c_uint64),
+    ]
+
+
+# see GSC_LATENCY_BUCKETS and GSC_NUM_STATS of c_api.h
+LATENCY_BUCKETS = 40
+NUM_STATS = 9
+
+
+class StatsArgs(ctypes.Structure):
+    _fields_ = [
+        ('stat', ctypes.c_int),
+        ('name_out', ctypes.c_char_p),
+        ('calls_out', ctypes.c_uint64),
+        ('rows_out', ctypes.c_uint64),
+        ('bytes_out', ctypes.c_uint64),
+        ('total_ns_out', ctypes.c_uint64),
+        ('max_ns_out', ctypes.c_uint64),
+        ('histogram_out', ctypes.c_uint64 * LATENCY_BUCKETS),
+    ]
+
+
+# placement of loaded arrays, see placement.hpp
+PAGES = {'normal': 0, 'transparent': 1, 'huge': 2}
+NUMA = {'local': 0, 'interleave': 1, 'replicate': 2}
+
+
 def py_str(x):
     """convert c string back to python string"""
     return x.decode('utf-8')
@@ -61,6 +265,48 @@ def _load_lib():
 # load the GSCounting library globally
 _LIB = _load_lib()
 _LIB.DenseMatrixSliceCSRMatrix.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.DenseMatrixSliceCSRMatrixInto.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.DenseMatrixSliceCSRMatrixIntoAs.argtypes = [ctypes.POINTER(SliceAsArgs)]
+_LIB.ColumnProjectionCreate.argtypes = [ctypes.POINTER(ProjectionArgs)]
+_LIB.DenseMatrixSliceCSRMatrixProjectedInto.argtypes = [
+    ctypes.POINTER(ProjectedSliceArgs)
+]
+_LIB.ColumnProjectionFree.argtypes = [ctypes.c_void_p]
+_LIB.CSRMatrixConvert.argtypes = [ctypes.POINTER(ConvertArgs)]
+_LIB.CSRMatrixFromArrays.argtypes = [ctypes.POINTER(FromArraysArgs)]
+_LIB.CSRMatrixSaveBinary.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_LIB.CSRMatrixSaveSharded.argtypes = [
+    ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint64
+]
+_LIB.ShardedCSRLoad.argtypes = [ctypes.POINTER(ShardedLoadArgs)]
+_LIB.DenseMatrixSliceShardedCSRInto.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.ShardedCSRFree.argtypes = [ctypes.c_void_p]
+_LIB.SliceServerStart.argtypes = [ctypes.POINTER(SliceServerArgs)]
+_LIB.SliceServerStop.argtypes = [ctypes.c_void_p]
+_LIB.RemoteCSRConnect.argtypes = [ctypes.POINTER(RemoteCSRArgs)]
+_LIB.DenseMatrixSliceRemoteCSR.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.DenseMatrixSliceRemoteCSRInto.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.RemoteCSRFree.argtypes = [ctypes.c_void_p]
+_LIB.CSRMatrixSliceNNZ.argtypes = [ctypes.POINTER(SparseSliceArgs)]
+_LIB.CSRMatrixSliceSparse.argtypes = [ctypes.POINTER(SparseSliceArgs)]
+_LIB.BatchPipelineCreate.argtypes = [ctypes.POINTER(BatchPipelineArgs)]
+_LIB.BatchPipelineNext.argtypes = [ctypes.POINTER(BatchArgs)]
+_LIB.BatchPipelineFree.argtypes = [ctypes.c_void_p]
+_LIB.CSRMatrixLabelCounts.argtypes = [ctypes.POINTER(LabelCountArgs)]
+_LIB.DenseMatrixLabelCountsInto.argtypes = [ctypes.POINTER(LabelCountArgs)]
+_LIB.LabelCounterCreate.argtypes = [ctypes.POINTER(LabelCountArgs)]
+_LIB.LabelCounterUpdate.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_int64), ctypes.c_uint64
+]
+_LIB.DenseMatrixSliceLabelCounterInto.argtypes = [ctypes.POINTER(SliceArgs)]
+_LIB.LabelCounterFree.argtypes = [ctypes.c_void_p]
+_LIB.CSRMatrixSampleBlocks.argtypes = [ctypes.POINTER(SampleArgs)]
+_LIB.SampledBlocksGet.argtypes = [ctypes.POINTER(SampledBlockArgs)]
+_LIB.SampledBlocksFree.argtypes = [ctypes.c_void_p]
+_LIB.StatsSetEnabled.argtypes = [ctypes.c_int]
+_LIB.StatsGet.argtypes = [ctypes.POINTER(StatsArgs)]
+_LIB.StatsReset.argtypes = []
 
 
 def _check_call(ret):
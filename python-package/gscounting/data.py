@@ -1,7 +1,35 @@
 import ctypes
+import itertools
 import os
 
-from core import _LIB, _check_call, c_str, c_array, ctypes2numpy, SliceArgs, LoadArgs
+import numpy as np
+
+from core import (_LIB, _check_call, c_str, c_array, ctypes2numpy, SliceArgs,
+                  SliceAsArgs, ConvertArgs, DTYPES, PAGES, NUMA,
+                  SparseSliceArgs, LoadArgs, BatchPipelineArgs, BatchArgs,
+                  LabelCountArgs, SampleArgs, SampledBlockArgs,
+                  ShardedLoadArgs, ProjectionArgs, ProjectedSliceArgs,
+                  FromArraysArgs, INDEX_DTYPES, RELEASE_FUNC, SliceServerArgs,
+                  RemoteCSRArgs)
+
+# numpy has no bfloat16, its values are returned as raw uint16 bits
+_SLICE_DTYPES = {
+    'float32': np.float32,
+    'float16': np.float16,
+    'bfloat16': np.uint16,
+}
+
+# arrays viewed by native matrices, released by the library once no matrix
+# uses them any more
+_BORROWED = {}
+_BORROWED_KEYS = itertools.count(1)
+
+
+def _release_borrowed(ctx):
+    _BORROWED.pop(ctx, None)
+
+
+_RELEASE_BORROWED = RELEASE_FUNC(_release_borrowed)
 
 
 class DenseMatrix:
@@ -24,18 +52,287 @@ class DenseMatrix:
             self.handle = None
 
 
+class SparseMatrix:
+    """Row-gathered CSR sub-matrix owning NumPy arrays."""
+    def __init__(self, data, indices, indptr, shape):
+        self.data = data
+        self.indices = indices
+        self.indptr = indptr
+        self._shape = shape
+
+    @property
+    def scipy(self):
+        from scipy.sparse import csr_matrix
+        return csr_matrix((self.data, self.indices, self.indptr),
+                          shape=self.shape)
+
+    @property
+    def shape(self):
+        return self._shape
+
+
+class SampledBlock:
+    """Edges sampled at one hop, from `src_nodes` to `dst_nodes`.
+
+    Sampled neighbors of `dst_nodes[i]` are
+    `src_nodes[indices[indptr[i]:indptr[i+1]]]`, `src_nodes` start with
+    `dst_nodes`.
+    """
+    def __init__(self, dst_nodes, src_nodes, indptr, indices):
+        self.dst_nodes = dst_nodes
+        self.src_nodes = src_nodes
+        self.indptr = indptr
+        self.indices = indices
+
+
+class BatchPipeline:
+    """Iterator over dense batches sliced ahead in the background.
+
+    Yields `(ixs, data)` NumPy arrays. Both are views of a buffer that is
+    recycled on the next iteration, copy them to keep them longer.
+    """
+    def __init__(self, matrix, batches=None, batch_size=None, seed=0,
+                 drop_last=False, depth=2):
+        self._matrix = matrix  # keep the matrix alive
+        self._ncols = matrix.shape[1]
+        args = BatchPipelineArgs(matrix.handle)
+        if batches is not None:
+            batches = [np.asarray(b, dtype=np.int32) for b in batches]
+            offsets = np.cumsum([0] + [len(b) for b in batches],
+                                dtype=np.uint64)
+            idxset = np.concatenate(batches) if batches else np.empty(
+                0, dtype=np.int32)
+            args.idxset = c_array(ctypes.c_int, idxset)
+            args.len = len(idxset)
+            args.offsets = c_array(ctypes.c_uint64, offsets)
+            args.nbatches = len(batches)
+        elif batch_size is None:
+            raise ValueError('either batches or batch_size is required')
+        args.batch_size = batch_size or 0
+        args.seed = seed
+        args.drop_last = int(drop_last)
+        args.depth = depth
+        _check_call(_LIB.BatchPipelineCreate(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+
+    def next(self, block=True):
+        """Next `(ixs, data)` batch, None when it is not ready yet.
+
+        Raises StopIteration when there are no more batches.
+        """
+        args = BatchArgs(self.handle, int(block))
+        _check_call(_LIB.BatchPipelineNext(ctypes.byref(args)))
+        if not args.ready_out:
+            if args.done_out:
+                raise StopIteration
+            return None
+        size = args.len_out
+        ixs = np.ctypeslib.as_array(args.idxset_out, (size, ))
+        data = ctypes2numpy(args.data_out, (size, self._ncols))
+        return ixs, data
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        return self.next()
+
+    def __del__(self):
+        if hasattr(self, "handle") and self.handle:
+            _check_call(_LIB.BatchPipelineFree(self.handle))
+            self.handle = None
+
+
+class LabelCounter:
+    """Neighbor label counts of `adj` updated as labels change.
+
+    Parameters
+    ----------
+    adj : CSRMatrix
+        Adjacency matrix
+    labels : CSRMatrix
+        Initial node label matrix
+    """
+    def __init__(self, adj, labels):
+        args = LabelCountArgs(adj.handle, labels.handle)
+        _check_call(_LIB.LabelCounterCreate(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+        self._shape = (args.nrows_out, args.ncols_out)
+
+    @property
+    def shape(self):
+        return self._shape
+
+    def update(self, changes):
+        """Apply `(node, old_label, new_label)` changes, -1 is no label.
+
+        `old_label` must be a label of `node` and `new_label` must not be
+        one, the new label takes over the value of the old one, or has
+        value one when added."""
+        changes = np.ascontiguousarray(changes, dtype=np.int64).reshape(-1, 3)
+        _check_call(
+            _LIB.LabelCounterUpdate(
+                self.handle,
+                changes.ctypes.data_as(ctypes.POINTER(ctypes.c_int64)),
+                len(changes)))
+
+    def slice(self, ixs, out=None):
+        """Counts of nodes `ixs` as a dense float32 array, see
+        `CSRMatrix.slice`."""
+        shape = (len(ixs), self.shape[1])
+        if out is None:
+            out = np.empty(shape, dtype=np.float32)
+        elif (out.dtype != np.float32 or out.shape != shape
+              or not out.flags['C_CONTIGUOUS']):
+            raise ValueError('out must be a C-contiguous float32 array '
+                             'of shape {}'.format(shape))
+
+        args = SliceArgs(
+            self.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+            out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+        )
+        _check_call(_LIB.DenseMatrixSliceLabelCounterInto(ctypes.byref(args)))
+        return out
+
+    def __del__(self):
+        if hasattr(self, "handle") and self.handle:
+            _check_call(_LIB.LabelCounterFree(self.handle))
+            self.handle = None
+
+
+class ColumnProjection:
+    """Subset of columns of matrices with `ncols` columns, in output order.
+
+    Negative columns count from the end, a column may be selected once.
+    Create it once per label subset and reuse it across slices.
+    """
+    def __init__(self, ncols, columns):
+        columns = np.ascontiguousarray(columns, dtype=np.int64).ravel()
+        args = ProjectionArgs(
+            ctypes.c_uint64(ncols),
+            columns.ctypes.data_as(ctypes.POINTER(ctypes.c_int64)),
+            ctypes.c_uint64(len(columns)),
+        )
+        _check_call(_LIB.ColumnProjectionCreate(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+        self.ncols = ncols
+        self.columns = columns
+
+    def __len__(self):
+        return len(self.columns)
+
+    def __del__(self):
+        if getattr(self, 'handle', None) is not None:
+            _check_call(_LIB.ColumnProjectionFree(self.handle))
+            self.handle = None
+
+
 class CSRMatrix:
-    def __init__(self, fname):
-        args = LoadArgs(c_str(os.fspath(fname)), )
-        _check_call(_LIB.CSRMatrixLoadFromFile(ctypes.byref(args)))
+    """CSR matrix loaded by the native library.
+
+    Indexing with a list of rows returns a `DenseMatrix`, or a `SparseMatrix`
+    when `sparse` is set, which avoids writing zeros for wide matrices.
+
+    A loaded copy may be placed in 'transparent' or reserved 'huge' `pages`,
+    which cut TLB misses of random row access, and `numa` 'interleave'd
+    over all nodes or 'replicate'd on each one, so that slicing threads of
+    every socket read local memory.
+
+    Arrays are validated on load, unless `trusted` is set and the file was
+    marked as validated when saved.
+
+    Indexing with a tuple `m[rows, cols]` returns only columns `cols`, a
+    `ColumnProjection` or an array of columns, as a float32 array. The
+    projection of the last array of columns is reused while it is the same.
+    """
+    def __init__(self, fname, mmap=False, sparse=False, pages='normal',
+                 numa='local', trusted=False):
+        self.sparse = sparse
+        if pages not in PAGES or numa not in NUMA:
+            raise ValueError('unsupported placement {}, {}'.format(pages, numa))
+        args = LoadArgs(c_str(os.fspath(fname)), None, 0, 0, PAGES[pages],
+                        NUMA[numa], int(trusted))
+        load = _LIB.CSRMatrixMapFromFile if mmap else _LIB.CSRMatrixLoadFromFile
+        _check_call(load(ctypes.byref(args)))
         self.handle = ctypes.c_void_p(args.handle_out)
         self._shape = (args.nrows_out, args.ncols_out)
 
+    @classmethod
+    def from_scipy(cls, m, copy=False, trusted=False, sparse=False):
+        """CSR matrix viewing the arrays of a scipy sparse matrix in place.
+
+        float32 and float16 values and 32 or 64 bit indices are viewed as
+        they are, other values are converted to float32 first. The arrays
+        are kept alive for as long as the library uses them, so `m` may be
+        dropped, but it must not be modified meanwhile.
+
+        Parameters
+        ----------
+        m : scipy.sparse matrix
+            Converted to CSR unless it is one already
+        copy : bool
+            Copy the arrays into the library instead of viewing them
+        trusted : bool
+            Skip validation of the arrays
+        """
+        m = m.tocsr()
+        data = m.data
+        if data.dtype not in (np.float32, np.float16):
+            data = data.astype(np.float32)
+        data = np.ascontiguousarray(data)
+        indices = np.ascontiguousarray(m.indices)
+        indptr = np.ascontiguousarray(m.indptr)
+        if indices.dtype.itemsize > indptr.dtype.itemsize:
+            indptr = indptr.astype(np.int64)
+        if (indices.dtype.kind not in 'iu' or indptr.dtype.kind not in 'iu'
+                or indices.dtype.itemsize not in INDEX_DTYPES
+                or indptr.dtype.itemsize not in INDEX_DTYPES):
+            raise ValueError('unsupported index dtypes {}, {}'.format(
+                indices.dtype, indptr.dtype))
+
+        key = next(_BORROWED_KEYS)
+        _BORROWED[key] = (data, indices, indptr)
+        args = FromArraysArgs(
+            data.ctypes.data_as(ctypes.c_void_p),
+            indices.ctypes.data_as(ctypes.c_void_p),
+            indptr.ctypes.data_as(ctypes.c_void_p),
+            m.shape[0],
+            m.shape[1],
+            len(indices),
+            DTYPES['float16' if data.dtype == np.float16 else 'float32'],
+            INDEX_DTYPES[indices.dtype.itemsize],
+            INDEX_DTYPES[indptr.dtype.itemsize],
+            1.,
+            int(copy),
+            int(trusted),
+            _RELEASE_BORROWED,
+            ctypes.c_void_p(key),
+        )
+        _check_call(_LIB.CSRMatrixFromArrays(ctypes.byref(args)))
+        return cls._from_handle(ctypes.c_void_p(args.handle_out), m.shape,
+                                sparse)
+
+    @classmethod
+    def _from_handle(cls, handle, shape, sparse=False):
+        self = cls.__new__(cls)
+        self.sparse = sparse
+        self.handle = handle
+        self._shape = shape
+        return self
+
     @property
     def shape(self):
         return self._shape
 
     def __getitem__(self, ixs):
+        if isinstance(ixs, tuple):
+            rows, cols = ixs
+            return self.slice(rows, columns=cols)
+        if self.sparse:
+            return self.slice_sparse(ixs)
+
         args = SliceArgs(
             self.handle,
             c_array(ctypes.c_int, ixs),
@@ -46,7 +343,348 @@ class CSRMatrix:
 
         return DenseMatrix(args.data_out, (len(ixs), self.shape[1]))
 
+    def project(self, columns):
+        """`ColumnProjection` of `columns` of this matrix."""
+        return ColumnProjection(self.shape[1], columns)
+
+    def _projection(self, columns):
+        if isinstance(columns, ColumnProjection):
+            return columns
+        columns = np.ascontiguousarray(columns, dtype=np.int64).ravel()
+        cached = getattr(self, '_last_projection', None)
+        if cached is None or not np.array_equal(cached.columns, columns):
+            cached = self.project(columns)
+            self._last_projection = cached
+        return cached
+
+    def _slice_projected(self, ixs, proj, out):
+        if proj.ncols != self.shape[1]:
+            raise ValueError('projection of {} columns does not match {} '
+                             'columns'.format(proj.ncols, self.shape[1]))
+        shape = (len(ixs), len(proj))
+        if out is None:
+            out = np.empty(shape, dtype=np.float32)
+        elif (out.dtype != np.float32 or out.shape != shape
+              or not out.flags['C_CONTIGUOUS']):
+            raise ValueError('out must be a C-contiguous float32 array '
+                             'of shape {}'.format(shape))
+
+        args = ProjectedSliceArgs(
+            self.handle,
+            proj.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+            out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+        )
+        _check_call(
+            _LIB.DenseMatrixSliceCSRMatrixProjectedInto(ctypes.byref(args)))
+        return out
+
+    def slice(self, ixs, out=None, dtype='float32', columns=None):
+        """Slice rows `ixs` into a dense array.
+
+        Unlike indexing, the result does not share memory with the matrix,
+        so several threads may slice it at once.
+
+        Parameters
+        ----------
+        ixs : array_like of int
+            Row indices, negative ones count from the end
+        out : numpy.ndarray, optional
+            C-contiguous array of shape (len(ixs), ncols) to write into,
+            e.g. a preallocated pinned buffer or `tensor.numpy()`
+        dtype : str
+            'float32', 'float16' or 'bfloat16', values are converted on the
+            fly. bfloat16 values are written as uint16 bits, view them with
+            `torch.from_numpy(out).view(torch.bfloat16)`.
+        columns : ColumnProjection or array_like of int, optional
+            Only these columns are written, in their order, `out` then has
+            shape (len(ixs), len(columns)). Requires 'float32'.
+
+        Returns
+        -------
+        out : numpy.ndarray
+        """
+        if dtype not in _SLICE_DTYPES:
+            raise ValueError('unsupported dtype {}'.format(dtype))
+        if columns is not None:
+            if dtype != 'float32':
+                raise ValueError('projected slices are float32 only')
+            return self._slice_projected(ixs, self._projection(columns), out)
+        np_dtype = _SLICE_DTYPES[dtype]
+        shape = (len(ixs), self.shape[1])
+        if out is None:
+            out = np.empty(shape, dtype=np_dtype)
+        elif (out.dtype != np_dtype or out.shape != shape
+              or not out.flags['C_CONTIGUOUS']):
+            raise ValueError('out must be a C-contiguous {} array '
+                             'of shape {}'.format(np.dtype(np_dtype), shape))
+
+        args = SliceAsArgs(
+            self.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+            DTYPES[dtype],
+            out.ctypes.data_as(ctypes.c_void_p),
+        )
+        _check_call(_LIB.DenseMatrixSliceCSRMatrixIntoAs(ctypes.byref(args)))
+        return out
+
+    def astype(self, dtype, scale=0.):
+        """Copy of the matrix storing values as `dtype`: 'float32',
+        'float16', 'bfloat16' or 'uint8' multiplied by `scale`, where zero
+        maps the largest value to 255. A 'pattern' stores no values, every
+        one is `scale`, zero requires all values to be equal.
+        Index arrays are shared.
+        """
+        if dtype not in DTYPES:
+            raise ValueError('unsupported dtype {}'.format(dtype))
+        args = ConvertArgs(self.handle, DTYPES[dtype], scale)
+        _check_call(_LIB.CSRMatrixConvert(ctypes.byref(args)))
+        return CSRMatrix._from_handle(ctypes.c_void_p(args.handle_out),
+                                      self.shape, self.sparse)
+
+    def save(self, fname):
+        """Save the matrix in the binary format, keeping its value dtype."""
+        _check_call(
+            _LIB.CSRMatrixSaveBinary(self.handle,
+                                     c_str(os.fspath(fname))))
+
+    def serve(self, path, nthreads=0):
+        """Serve slices of the matrix to `RemoteCSRMatrix` clients of other
+        processes on the host, see `SliceServer`."""
+        return SliceServer(self, path, nthreads)
+
+    def save_sharded(self, fname, shard_rows):
+        """Save the matrix in shards of `shard_rows` rows, which
+        `ShardedCSRMatrix` loads on demand."""
+        _check_call(
+            _LIB.CSRMatrixSaveSharded(self.handle, c_str(os.fspath(fname)),
+                                      ctypes.c_uint64(shard_rows)))
+
+    def slice_sparse(self, ixs):
+        """Gather rows `ixs` into a `SparseMatrix` of int64 indices."""
+        idxset = c_array(ctypes.c_int, ixs)
+        args = SparseSliceArgs(self.handle, idxset, ctypes.c_uint64(len(ixs)))
+        _check_call(_LIB.CSRMatrixSliceNNZ(ctypes.byref(args)))
+
+        indptr = np.empty(len(ixs) + 1, dtype=np.int64)
+        indices = np.empty(args.nnz, dtype=np.int64)
+        data = np.empty(args.nnz, dtype=np.float32)
+        args.indptr_out = indptr.ctypes.data_as(ctypes.POINTER(ctypes.c_int64))
+        args.indices_out = indices.ctypes.data_as(
+            ctypes.POINTER(ctypes.c_int64))
+        args.data_out = data.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+        _check_call(_LIB.CSRMatrixSliceSparse(ctypes.byref(args)))
+
+        return SparseMatrix(data, indices, indptr, (len(ixs), self.shape[1]))
+
+    def label_counts(self, labels, ixs=None, out=None):
+        """Count labels of neighbors, treating this matrix as adjacency.
+
+        Parameters
+        ----------
+        labels : CSRMatrix
+            Node label matrix with a row for every column of this matrix
+        ixs : array_like of int, optional
+            Nodes to count labels of, all nodes when omitted
+        out : numpy.ndarray, optional
+            C-contiguous float32 array of shape (len(ixs), nlabels) to write
+            dense counts of `ixs` into
+
+        Returns
+        -------
+        counts : CSRMatrix or numpy.ndarray
+            Sparse counts, or `out` when it is given
+        """
+        args = LabelCountArgs(self.handle, labels.handle)
+        if ixs is not None:
+            args.idxset = c_array(ctypes.c_int, ixs)
+            args.len = len(ixs)
+        if out is not None:
+            shape = (len(ixs), labels.shape[1])
+            if (out.dtype != np.float32 or out.shape != shape
+                    or not out.flags['C_CONTIGUOUS']):
+                raise ValueError('out must be a C-contiguous float32 array '
+                                 'of shape {}'.format(shape))
+            args.data_out = out.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+            _check_call(_LIB.DenseMatrixLabelCountsInto(ctypes.byref(args)))
+            return out
+
+        _check_call(_LIB.CSRMatrixLabelCounts(ctypes.byref(args)))
+        return CSRMatrix._from_handle(ctypes.c_void_p(args.handle_out),
+                                      (args.nrows_out, args.ncols_out))
+
+    def sample(self, seeds, fanouts, seed=0):
+        """Sample neighbors of `seeds` hop by hop, treating this matrix as
+        adjacency, up to `fanouts[h]` of them at hop `h` (all when negative).
+
+        Returns
+        -------
+        blocks : list of SampledBlock
+            A block per hop, nodes of the last one are the input nodes
+        """
+        args = SampleArgs(self.handle, c_array(ctypes.c_int, seeds),
+                          len(seeds), c_array(ctypes.c_int, fanouts),
+                          len(fanouts), seed)
+        _check_call(_LIB.CSRMatrixSampleBlocks(ctypes.byref(args)))
+        handle = ctypes.c_void_p(args.handle_out)
+
+        def copy(ptr, size):
+            if size == 0:
+                return np.empty(0, dtype=ptr._type_)
+            return np.ctypeslib.as_array(ptr, (size, )).copy()
+
+        blocks = []
+        try:
+            for hop in range(len(fanouts)):
+                b = SampledBlockArgs(handle, hop)
+                _check_call(_LIB.SampledBlocksGet(ctypes.byref(b)))
+                blocks.append(
+                    SampledBlock(copy(b.dst_nodes_out, b.ndst_out),
+                                 copy(b.src_nodes_out, b.nsrc_out),
+                                 copy(b.indptr_out, b.ndst_out + 1),
+                                 copy(b.indices_out, b.nnz_out)))
+        finally:
+            _check_call(_LIB.SampledBlocksFree(handle))
+        return blocks
+
+    def batches(self, batches=None, batch_size=None, seed=0,
+                drop_last=False, depth=2):
+        """Slice `batches` of row indices, or all rows shuffled with `seed`
+        in batches of `batch_size`, `depth` batches ahead of the consumer.
+        """
+        return BatchPipeline(self, batches, batch_size, seed, drop_last,
+                             depth)
+
     def __del__(self):
         if hasattr(self, "handle") and self.handle:
             _check_call(_LIB.CSRMatrixFree(self.handle))
             self.handle = None
+
+
+class ShardedCSRMatrix:
+    """CSR matrix saved by `CSRMatrix.save_sharded`, larger than memory.
+
+    Shards are loaded when rows of a slice are in them, at most
+    `max_resident` least recently used ones are kept in memory. A slice
+    loads each shard it touches once, however its rows are ordered.
+    """
+    def __init__(self, fname, max_resident=4, trusted=False):
+        args = ShardedLoadArgs(c_str(os.fspath(fname)), max_resident,
+                               int(trusted), None, 0, 0, 0)
+        _check_call(_LIB.ShardedCSRLoad(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+        self._shape = (args.nrows_out, args.ncols_out)
+        self.nshards = args.nshards_out
+
+    @property
+    def shape(self):
+        return self._shape
+
+    def __getitem__(self, ixs):
+        return self.slice(ixs)
+
+    def slice(self, ixs, out=None):
+        """Slice rows `ixs` into a dense float32 array, see
+        `CSRMatrix.slice`."""
+        shape = (len(ixs), self.shape[1])
+        if out is None:
+            out = np.empty(shape, dtype=np.float32)
+        elif (out.dtype != np.float32 or out.shape != shape
+              or not out.flags['C_CONTIGUOUS']):
+            raise ValueError('out must be a C-contiguous float32 array '
+                             'of shape {}'.format(shape))
+
+        args = SliceArgs(
+            self.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+            out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+        )
+        _check_call(_LIB.DenseMatrixSliceShardedCSRInto(ctypes.byref(args)))
+        return out
+
+    def __del__(self):
+        if hasattr(self, "handle") and self.handle:
+            _check_call(_LIB.ShardedCSRFree(self.handle))
+            self.handle = None
+
+
+class SliceServer:
+    """Serves slices of a `CSRMatrix` over a Unix domain socket at `path`.
+
+    Trainer processes of a host connect with `RemoteCSRMatrix` instead of
+    loading a copy of the matrix each. Slices of all of them run on one
+    pool of `nthreads` threads, all cores when zero, and are written into
+    shared memory of each client. The server stops when it is deleted.
+    """
+    def __init__(self, matrix, path, nthreads=0):
+        args = SliceServerArgs(matrix.handle, c_str(os.fspath(path)),
+                               nthreads)
+        _check_call(_LIB.SliceServerStart(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+        self.path = path
+
+    def stop(self):
+        """Disconnect clients and remove the socket."""
+        if getattr(self, 'handle', None):
+            _check_call(_LIB.SliceServerStop(self.handle))
+            self.handle = None
+
+    def __del__(self):
+        self.stop()
+
+
+class RemoteCSRMatrix:
+    """Matrix of a `SliceServer`, sliced like a `CSRMatrix`.
+
+    Slices are written by the server into a ring of `slots` shared memory
+    slots of `slot_bytes` each. Indexing returns a `DenseMatrix` viewing a
+    slot, which is reused `slots` slices later, and needs the rows to fit
+    into a slot. `slice` copies any number of rows out, pipelining requests
+    over the ring. Use a matrix per thread to slice concurrently.
+    """
+    def __init__(self, path, slots=4, slot_bytes=64 << 20):
+        args = RemoteCSRArgs(c_str(os.fspath(path)), slots, slot_bytes)
+        _check_call(_LIB.RemoteCSRConnect(ctypes.byref(args)))
+        self.handle = ctypes.c_void_p(args.handle_out)
+        self._shape = (args.nrows_out, args.ncols_out)
+
+    @property
+    def shape(self):
+        return self._shape
+
+    def __getitem__(self, ixs):
+        args = SliceArgs(
+            self.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+        )
+        _check_call(_LIB.DenseMatrixSliceRemoteCSR(ctypes.byref(args)))
+        return DenseMatrix(args.data_out, (len(ixs), self.shape[1]))
+
+    def slice(self, ixs, out=None):
+        """Slice rows `ixs` into a dense float32 array, see
+        `CSRMatrix.slice`."""
+        shape = (len(ixs), self.shape[1])
+        if out is None:
+            out = np.empty(shape, dtype=np.float32)
+        elif (out.dtype != np.float32 or out.shape != shape
+              or not out.flags['C_CONTIGUOUS']):
+            raise ValueError('out must be a C-contiguous float32 array '
+                             'of shape {}'.format(shape))
+
+        args = SliceArgs(
+            self.handle,
+            c_array(ctypes.c_int, ixs),
+            ctypes.c_uint64(len(ixs)),
+            out.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+        )
+        _check_call(_LIB.DenseMatrixSliceRemoteCSRInto(ctypes.byref(args)))
+        return out
+
+    def __del__(self):
+        if hasattr(self, "handle") and self.handle:
+            _check_call(_LIB.RemoteCSRFree(self.handle))
+            self.handle = None
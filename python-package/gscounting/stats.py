@@ -0,0 +1,41 @@
+"""Runtime counters and latency histograms of the native library."""
+import ctypes
+
+from core import _LIB, _check_call, py_str, StatsArgs, NUM_STATS
+
+
+def enable_stats(enabled=True):
+    """Turn collection on or off. It is off by default, unless the GSC_STATS
+    environment variable is non-zero, and costs next to nothing then."""
+    _check_call(_LIB.StatsSetEnabled(1 if enabled else 0))
+
+
+def reset_stats():
+    """Zero counters of all operations."""
+    _check_call(_LIB.StatsReset())
+
+
+def stats():
+    """Snapshot of counters since the last reset.
+
+    Returns
+    -------
+    stats : dict
+        Operation name, e.g. 'slice', 'slice_fill' or 'load', to a dict of
+        'calls', 'rows', 'bytes', 'total_ns', 'max_ns' and 'histogram',
+        a list where item k counts calls that took [2^k, 2^(k+1)) ns.
+        Phases of a slice count blocks of rows rather than slices.
+    """
+    result = {}
+    for stat in range(NUM_STATS):
+        args = StatsArgs(stat)
+        _check_call(_LIB.StatsGet(ctypes.byref(args)))
+        result[py_str(args.name_out)] = {
+            'calls': args.calls_out,
+            'rows': args.rows_out,
+            'bytes': args.bytes_out,
+            'total_ns': args.total_ns_out,
+            'max_ns': args.max_ns_out,
+            'histogram': list(args.histogram_out),
+        }
+    return result
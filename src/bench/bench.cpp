@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "csr_matrix.hpp"
+#include "externalsort.hpp"
+#include "generators.hpp"
+#include "tools.hpp"
+#include <benchmark/benchmark.h>
+
+namespace fs = std::filesystem;
+
+using edge_type = EdgeItem<std::uint32_t>;
+
+/// Scratch files live in the system temporary directory
+static auto scratch(const std::string &fname) -> fs::path {
+  auto dir = fs::temp_directory_path() / "gsc_bench";
+  fs::create_directories(dir);
+  return dir / fname;
+}
+
+/// Random matrix, generated once per shape and density
+static auto matrix(size_t nrows, size_t ncols, int density) -> const CSR & {
+  static std::map<std::tuple<size_t, size_t, int>, std::unique_ptr<CSR>> cache;
+  auto &m = cache[{nrows, ncols, density}];
+  if (!m) {
+    m = std::make_unique<CSR>(
+        uniform_csr<CSR>(nrows, ncols, density / 100., 0));
+  }
+  return *m;
+}
+
+static auto random_rows(size_t n, size_t nrows) -> std::vector<int> {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> uni(0, static_cast<int>(nrows) - 1);
+  std::vector<int> ixs(n);
+  std::generate(ixs.begin(), ixs.end(), [&] { return uni(rng); });
+  return ixs;
+}
+
+/// Writes `n` random edges, unless the file has them already
+static auto edge_list(size_t n) -> fs::path {
+  auto fname = scratch("edges_" + std::to_string(n) + ".bin");
+  if (fs::exists(fname) && fs::file_size(fname) == n * sizeof(edge_type)) {
+    return fname;
+  }
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<std::uint32_t> uni(0, 1000000);
+  std::vector<edge_type> edges(n);
+  std::generate(edges.begin(), edges.end(),
+                [&] { return edge_type(uni(rng), uni(rng)); });
+  std::ofstream os(fname, std::ios::binary);
+  edge_type::encode_block(os, edges.data(), edges.size());
+  return fname;
+}
+
+// ----------------------------------------------------------------------------
+// Slicing
+// ----------------------------------------------------------------------------
+
+/// Args: batch size, number of columns, percent of non-zeros
+static void BM_Slice(benchmark::State &state) {
+  auto batch = static_cast<size_t>(state.range(0));
+  auto ncols = static_cast<size_t>(state.range(1));
+  const auto &m = matrix(100000, ncols, static_cast<int>(state.range(2)));
+  auto ixs = random_rows(batch, m._nrows);
+  std::vector<float> out(batch * ncols);
+
+  for (auto _ : state) {
+    m.slice(ixs.data(), ixs.size(), out.data());
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batch));
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(out.size() * sizeof(float)));
+}
+BENCHMARK(BM_Slice)
+    ->ArgNames({"batch", "ncols", "density"})
+    ->ArgsProduct({{64, 512, 4096}, {128, 1024}, {1, 10, 50}})
+    ->UseRealTime();
+
+// ----------------------------------------------------------------------------
+// Binary format
+// ----------------------------------------------------------------------------
+
+/// Args: number of rows of a 1000 column matrix with 10% non-zeros
+static void BM_Save(benchmark::State &state) {
+  auto m = matrix(static_cast<size_t>(state.range(0)), 1000, 10);
+  auto fname = scratch("m_save.bin");
+  for (auto _ : state) {
+    m.save(fname.string());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(fs::file_size(fname)));
+}
+BENCHMARK(BM_Save)->Arg(10000)->Arg(100000)->UseRealTime();
+
+/// Args: number of rows of a 1000 column matrix with 10% non-zeros
+static void BM_Load(benchmark::State &state) {
+  auto fname = scratch("m_load_" + std::to_string(state.range(0)) + ".bin");
+  auto m = matrix(static_cast<size_t>(state.range(0)), 1000, 10);
+  m.save(fname.string());
+  for (auto _ : state) {
+    std::unique_ptr<CSR> ml(CSR::load(fname.string()));
+    benchmark::DoNotOptimize(ml->_indices.data());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(fs::file_size(fname)));
+}
+BENCHMARK(BM_Load)->Arg(10000)->Arg(100000)->UseRealTime();
+
+// ----------------------------------------------------------------------------
+// External sorting
+// ----------------------------------------------------------------------------
+
+constexpr size_t NEDGES = size_t{1} << 22U;
+
+/// Args: memory of a sorted run in KiB, 4M edges are sorted
+static void BM_SortUnstable(benchmark::State &state) {
+  auto fname = edge_list(NEDGES);
+  auto dir = scratch("sort_runs");
+  auto max_mem = static_cast<size_t>(state.range(0)) << 10U;
+
+  for (auto _ : state) {
+    fs::create_directories(dir);
+    {
+      std::ifstream is(fname, std::ios::binary);
+      ExternalSorter<edge_type> sorter(dir, max_mem);
+      std::uint64_t sum = 0;
+      for (auto &edge : sorter.sort_unstable(is)) {
+        sum += edge.first;
+      }
+      benchmark::DoNotOptimize(sum);
+    }
+    fs::remove_all(dir);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(NEDGES));
+}
+BENCHMARK(BM_SortUnstable)
+    ->ArgName("max_mem_kb")
+    ->RangeMultiplier(8)
+    ->Range(1 << 8, 1 << 14)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/// Args: number of sorted runs merged at once, 4M edges in total
+static void BM_KMerge(benchmark::State &state) {
+  auto fanin = static_cast<size_t>(state.range(0));
+  auto dir = scratch("kmerge_" + std::to_string(fanin));
+  fs::create_directories(dir);
+
+  // sorted runs of an equal share of random edges
+  {
+    std::ifstream is(edge_list(NEDGES), std::ios::binary);
+    std::vector<edge_type> run(NEDGES / fanin);
+    for (size_t i = 0; i < fanin; ++i) {
+      run.resize(edge_type::decode_block(is, run.data(), run.size()));
+      std::sort(run.begin(), run.end());
+      std::ofstream os(dir / (std::to_string(i) + ".bin"), std::ios::binary);
+      edge_type::encode_block(os, run.data(), run.size());
+    }
+  }
+
+  for (auto _ : state) {
+    std::vector<std::ifstream> streams;
+    for (size_t i = 0; i < fanin; ++i) {
+      streams.emplace_back(dir / (std::to_string(i) + ".bin"),
+                           std::ios::binary);
+    }
+    std::uint64_t sum = 0;
+    for (auto &edge : KMerge<edge_type>(std::move(streams))) {
+      sum += edge.first;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(NEDGES / fanin * fanin));
+  fs::remove_all(dir);
+}
+BENCHMARK(BM_KMerge)
+    ->ArgName("fanin")
+    ->RangeMultiplier(4)
+    ->Range(2, 512)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// ----------------------------------------------------------------------------
+// Generators
+// ----------------------------------------------------------------------------
+
+/// Args: number of rows of a 1000 column matrix with 1% non-zeros
+static void BM_UniformCSR(benchmark::State &state) {
+  auto nrows = static_cast<size_t>(state.range(0));
+  size_t nnz = 0;
+  for (auto _ : state) {
+    nnz = uniform_csr<CSRLarge>(nrows, 1000, 0.01, 0).nnz();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nnz));
+}
+BENCHMARK(BM_UniformCSR)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/// Args: R-MAT scale, 16 edges are drawn per node
+static void BM_RMatEdges(benchmark::State &state) {
+  RMatParams params;
+  params.scale = static_cast<unsigned>(state.range(0));
+  params.nedges = std::uint64_t{16} << params.scale;
+  auto fname = scratch("rmat.bin");
+  for (auto _ : state) {
+    std::ofstream os(fname, std::ios::binary);
+    benchmark::DoNotOptimize(write_rmat_edges(os, params, 0));
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(params.nedges));
+}
+BENCHMARK(BM_RMatEdges)
+    ->ArgName("scale")
+    ->DenseRange(16, 20, 2)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -1,18 +1,72 @@
 #include "c_api.h"
 #include "c_api_error.h"
 #include "csr_matrix.hpp"
+#include "label_counts.hpp"
+#include "pipeline.hpp"
+#include "projection.hpp"
+#include "sampler.hpp"
+#include "sharded.hpp"
+#include "slice_server.hpp"
+#include "stats.hpp"
 #include "tools.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+
+/// Load matrix into a new handle and report its shape
+static void load_handle(LoadArgs *args, bool mmap) {
+  if (args->pages < 0 || args->pages > static_cast<int>(PageSize::huge) ||
+      args->numa < 0 || args->numa > static_cast<int>(NumaPolicy::replicate)) {
+    throw std::runtime_error("Unknown pages or NUMA placement");
+  }
+  Placement placement{static_cast<PageSize>(args->pages),
+                      static_cast<NumaPolicy>(args->numa)};
+  auto handle =
+      new AnyCSR(load_any(args->fname, mmap, placement, args->trusted != 0));
+  args->handle_out = handle;
+  std::visit(
+      [args](auto &m) {
+        args->nrows_out = m->_nrows;
+        args->ncols_out = m->_ncols;
+      },
+      *handle);
+}
 
 GSC_DLL auto CSRMatrixLoadFromFile(LoadArgs *args) -> int {
   API_BEGIN();
-  auto handle = new std::shared_ptr<CSR>(CSR::load(args->fname));
-  args->handle_out = handle;
-  auto m = handle->get();
-  args->nrows_out = m->_nrows;
-  args->ncols_out = m->_ncols;
+  load_handle(args, false);
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixMapFromFile(LoadArgs *args) -> int {
+  API_BEGIN();
+  load_handle(args, true);
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixFromArrays(FromArraysArgs *args) -> int {
+  API_BEGIN();
+  std::shared_ptr<const void> owner;
+  if (args->release != nullptr) {
+    owner = std::shared_ptr<const void>(args->release_ctx, args->release);
+  }
+  CSRArrays arrays;
+  arrays.data = args->data;
+  arrays.indices = args->indices;
+  arrays.indptr = args->indptr;
+  arrays.nrows = static_cast<std::size_t>(args->nrows);
+  arrays.ncols = static_cast<std::size_t>(args->ncols);
+  arrays.nnz = static_cast<std::size_t>(args->nnz);
+  arrays.dtype = static_cast<DType>(args->dtype);
+  arrays.index_dtype = static_cast<DType>(args->index_dtype);
+  arrays.indptr_dtype = static_cast<DType>(args->indptr_dtype);
+  arrays.scale = args->scale;
+  args->handle_out = new AnyCSR(from_arrays(
+      arrays, std::move(owner), args->copy != 0, args->trusted != 0));
   API_END();
 }
 
@@ -20,8 +74,110 @@ GSC_DLL auto CSRMatrixSaveBinary(CSRMatrixHandle handle, const char *fname)
     -> int {
   API_BEGIN();
   CHECK_HANDLE();
-  auto m = static_cast<std::shared_ptr<CSR> *>(handle)->get();
-  m->save(fname);
+  std::visit([fname](auto &m) { m->save(fname); },
+             *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixSaveSharded(CSRMatrixHandle handle, const char *fname,
+                                  uint64_t shard_rows) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  std::visit(
+      [fname, shard_rows](auto &m) {
+        m->save_sharded(fname, static_cast<std::size_t>(shard_rows));
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto ShardedCSRLoad(ShardedLoadArgs *args) -> int {
+  API_BEGIN();
+  auto m = new ShardedCSR(args->fname,
+                          static_cast<std::size_t>(args->max_resident),
+                          args->trusted != 0);
+  args->handle_out = m;
+  args->nrows_out = m->nrows();
+  args->ncols_out = m->ncols();
+  args->nshards_out = m->nshards();
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceShardedCSRInto(SliceArgs *args) -> int {
+  ShardedCSRHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  static_cast<const ShardedCSR *>(handle)->slice(
+      args->idxset, static_cast<std::size_t>(args->len), args->data_out);
+  API_END();
+}
+
+GSC_DLL auto ShardedCSRFree(ShardedCSRHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<ShardedCSR *>(handle);
+  API_END();
+}
+
+GSC_DLL auto SliceServerStart(SliceServerArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  args->handle_out = new SliceServer(*static_cast<AnyCSR *>(handle),
+                                     args->path, args->nthreads);
+  API_END();
+}
+
+GSC_DLL auto SliceServerStop(SliceServerHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<SliceServer *>(handle);
+  API_END();
+}
+
+GSC_DLL auto RemoteCSRConnect(RemoteCSRArgs *args) -> int {
+  API_BEGIN();
+  auto slots = args->slots == 0 ? 4 : static_cast<std::size_t>(args->slots);
+  auto slot_bytes = args->slot_bytes == 0
+                        ? std::size_t{64} << 20U
+                        : static_cast<std::size_t>(args->slot_bytes);
+  auto client = new SliceClient(args->path, slots, slot_bytes);
+  args->handle_out = client;
+  args->nrows_out = client->nrows();
+  args->ncols_out = client->ncols();
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceRemoteCSR(SliceArgs *args) -> int {
+  RemoteCSRHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  auto client = static_cast<SliceClient *>(handle);
+  // the ring is only read by the caller
+  args->data_out = const_cast<float *>(
+      client->slice(args->idxset, static_cast<std::size_t>(args->len)));
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceRemoteCSRInto(SliceArgs *args) -> int {
+  RemoteCSRHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  static_cast<SliceClient *>(handle)->slice(
+      args->idxset, static_cast<std::size_t>(args->len), args->data_out);
+  API_END();
+}
+
+GSC_DLL auto RemoteCSRFree(RemoteCSRHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<SliceClient *>(handle);
   API_END();
 }
 
@@ -29,15 +185,331 @@ GSC_DLL auto DenseMatrixSliceCSRMatrix(SliceArgs *args) -> int {
   CSRMatrixHandle handle = args->handle;
   API_BEGIN();
   CHECK_HANDLE();
-  CSR *m = static_cast<std::shared_ptr<CSR> *>(handle)->get();
-  auto dptr = m->slice(args->idxset, static_cast<std::size_t>(args->len));
-  args->data_out = dptr;
+  std::visit(
+      [args](auto &m) {
+        args->data_out =
+            m->slice(args->idxset, static_cast<std::size_t>(args->len));
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceCSRMatrixInto(SliceArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  std::visit(
+      [args](const auto &m) {
+        const auto &cm = *m;
+        cm.slice(args->idxset, static_cast<std::size_t>(args->len),
+                 args->data_out);
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto ColumnProjectionCreate(ProjectionArgs *args) -> int {
+  API_BEGIN();
+  args->handle_out =
+      new ColumnProjection(static_cast<std::size_t>(args->ncols),
+                           args->columns, static_cast<std::size_t>(args->len));
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceCSRMatrixProjectedInto(ProjectedSliceArgs *args)
+    -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->projection == nullptr) {
+    throw std::runtime_error("Invalid ColumnProjectionHandle");
+  }
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  const auto &proj = *static_cast<const ColumnProjection *>(args->projection);
+  std::visit(
+      [args, &proj](const auto &m) {
+        const auto &cm = *m;
+        cm.slice(args->idxset, static_cast<std::size_t>(args->len), proj,
+                 args->data_out);
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto ColumnProjectionFree(ColumnProjectionHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<ColumnProjection *>(handle);
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceCSRMatrixIntoAs(SliceAsArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  std::visit(
+      [args](const auto &m) {
+        const auto &cm = *m;
+        auto len = static_cast<std::size_t>(args->len);
+        switch (static_cast<DType>(args->dtype)) {
+        case DType::float32:
+          cm.slice(args->idxset, len, static_cast<float *>(args->data_out));
+          return;
+        case DType::float16:
+          cm.slice(args->idxset, len, static_cast<float16 *>(args->data_out));
+          return;
+        case DType::bfloat16:
+          cm.slice(args->idxset, len,
+                   static_cast<bfloat16 *>(args->data_out));
+          return;
+        default:
+          throw std::runtime_error("Unsupported output dtype");
+        }
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixConvert(ConvertArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  args->handle_out = new AnyCSR(astype(*static_cast<AnyCSR *>(handle),
+                                       static_cast<DType>(args->dtype),
+                                       args->scale));
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixSliceNNZ(SparseSliceArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  std::visit(
+      [args](const auto &m) {
+        args->nnz = m->slice_nnz(args->idxset, args->len);
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixSliceSparse(SparseSliceArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->indptr_out == nullptr ||
+      (args->nnz != 0 &&
+       (args->indices_out == nullptr || args->data_out == nullptr))) {
+    throw std::runtime_error("output buffers are not provided");
+  }
+  std::visit(
+      [args](const auto &m) {
+        if (m->slice_nnz(args->idxset, args->len) != args->nnz) {
+          throw std::runtime_error("nnz does not match the slice");
+        }
+        m->slice_csr(args->idxset, args->len, args->indptr_out,
+                     args->indices_out, args->data_out);
+      },
+      *static_cast<AnyCSR *>(handle));
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixLabelCounts(LabelCountArgs *args) -> int {
+  API_BEGIN();
+  if (args->adj == nullptr || args->labels == nullptr) {
+    throw std::runtime_error("Invalid CSRMatrixHandle");
+  }
+  const auto &adj = *static_cast<AnyCSR *>(args->adj);
+  const auto &labels = *static_cast<AnyCSR *>(args->labels);
+  auto handle = new AnyCSR(
+      args->idxset == nullptr
+          ? label_counts(adj, labels)
+          : label_counts(adj, labels, args->idxset,
+                         static_cast<std::size_t>(args->len)));
+  args->handle_out = handle;
+  std::visit(
+      [args](auto &m) {
+        args->nrows_out = m->_nrows;
+        args->ncols_out = m->_ncols;
+      },
+      *handle);
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixLabelCountsInto(LabelCountArgs *args) -> int {
+  API_BEGIN();
+  if (args->adj == nullptr || args->labels == nullptr) {
+    throw std::runtime_error("Invalid CSRMatrixHandle");
+  }
+  if (args->idxset == nullptr || args->data_out == nullptr) {
+    throw std::runtime_error("nodes or output buffer are not provided");
+  }
+  label_counts(*static_cast<AnyCSR *>(args->adj),
+               *static_cast<AnyCSR *>(args->labels), args->idxset,
+               static_cast<std::size_t>(args->len), args->data_out);
+  API_END();
+}
+
+GSC_DLL auto LabelCounterCreate(LabelCountArgs *args) -> int {
+  API_BEGIN();
+  if (args->adj == nullptr || args->labels == nullptr) {
+    throw std::runtime_error("Invalid CSRMatrixHandle");
+  }
+  auto counter = new LabelCounter(*static_cast<AnyCSR *>(args->adj),
+                                  *static_cast<AnyCSR *>(args->labels));
+  args->handle_out = counter;
+  args->nrows_out = counter->nnodes();
+  args->ncols_out = counter->nlabels();
+  API_END();
+}
+
+GSC_DLL auto LabelCounterUpdate(LabelCounterHandle handle,
+                                const int64_t *changes, uint64_t len) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  std::vector<LabelChange> v(static_cast<std::size_t>(len));
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    v[i] = {changes[3 * i], changes[3 * i + 1], changes[3 * i + 2]};
+  }
+  static_cast<LabelCounter *>(handle)->update(v.data(), v.size());
+  API_END();
+}
+
+GSC_DLL auto DenseMatrixSliceLabelCounterInto(SliceArgs *args) -> int {
+  LabelCounterHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  if (args->data_out == nullptr) {
+    throw std::runtime_error("output buffer is not provided");
+  }
+  static_cast<const LabelCounter *>(handle)->slice(
+      args->idxset, static_cast<std::size_t>(args->len), args->data_out);
+  API_END();
+}
+
+GSC_DLL auto LabelCounterFree(LabelCounterHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<LabelCounter *>(handle);
+  API_END();
+}
+
+GSC_DLL auto CSRMatrixSampleBlocks(SampleArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  std::vector<int> fanouts(args->fanouts, args->fanouts + args->nhops);
+  args->handle_out = new std::vector<SampledBlock>(
+      sample_blocks(*static_cast<AnyCSR *>(handle), args->idxset,
+                    static_cast<std::size_t>(args->len), fanouts, args->seed));
+  API_END();
+}
+
+GSC_DLL auto SampledBlocksGet(SampledBlockArgs *args) -> int {
+  SampledBlocksHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  const auto &blocks = *static_cast<std::vector<SampledBlock> *>(handle);
+  const auto &b = blocks.at(static_cast<std::size_t>(args->hop));
+  args->dst_nodes_out = b.dst_nodes.data();
+  args->ndst_out = b.dst_nodes.size();
+  args->src_nodes_out = b.src_nodes.data();
+  args->nsrc_out = b.src_nodes.size();
+  args->indptr_out = b.indptr.data();
+  args->indices_out = b.indices.data();
+  args->nnz_out = b.indices.size();
+  API_END();
+}
+
+GSC_DLL auto SampledBlocksFree(SampledBlocksHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<std::vector<SampledBlock> *>(handle);
+  API_END();
+}
+
+GSC_DLL auto BatchPipelineCreate(BatchPipelineArgs *args) -> int {
+  CSRMatrixHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  auto &m = *static_cast<AnyCSR *>(handle);
+  if (args->idxset == nullptr) {
+    args->handle_out = BatchPipeline::shuffled(
+        m, args->batch_size, args->seed, args->drop_last != 0, args->depth);
+  } else {
+    std::vector<int> ixs(args->idxset, args->idxset + args->len);
+    std::vector<size_t> offsets(args->offsets,
+                                args->offsets + args->nbatches + 1);
+    args->handle_out = new BatchPipeline(m, std::move(ixs),
+                                         std::move(offsets), args->depth);
+  }
+  API_END();
+}
+
+GSC_DLL auto BatchPipelineNext(BatchArgs *args) -> int {
+  BatchPipelineHandle handle = args->handle;
+  API_BEGIN();
+  CHECK_HANDLE();
+  auto pipeline = static_cast<BatchPipeline *>(handle);
+  Batch batch{};
+  args->ready_out = pipeline->next(batch, args->block != 0) ? 1 : 0;
+  args->done_out = pipeline->done() ? 1 : 0;
+  args->idxset_out = batch.ixs;
+  args->len_out = batch.size;
+  args->data_out = batch.data;
+  API_END();
+}
+
+GSC_DLL auto BatchPipelineFree(BatchPipelineHandle handle) -> int {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<BatchPipeline *>(handle);
   API_END();
 }
 
 GSC_DLL auto CSRMatrixFree(CSRMatrixHandle handle) -> int {
   API_BEGIN();
   CHECK_HANDLE();
-  delete static_cast<std::shared_ptr<CSR> *>(handle);
+  delete static_cast<AnyCSR *>(handle);
+  API_END();
+}
+
+static_assert(GSC_NUM_STATS == NSTATS, "C API does not cover all stats");
+static_assert(GSC_LATENCY_BUCKETS == NLATENCY_BUCKETS,
+              "C API latency histogram size differs");
+
+GSC_DLL auto StatsSetEnabled(int enabled) -> int {
+  API_BEGIN();
+  set_stats_enabled(enabled != 0);
+  API_END();
+}
+
+GSC_DLL auto StatsGet(StatsArgs *args) -> int {
+  API_BEGIN();
+  if (args->stat < 0 || static_cast<std::size_t>(args->stat) >= NSTATS) {
+    throw std::runtime_error("Unknown stat");
+  }
+  auto stat = static_cast<Stat>(args->stat);
+  auto s = stats_snapshot(stat);
+  args->name_out = stat_name(stat);
+  args->calls_out = s.calls;
+  args->rows_out = s.rows;
+  args->bytes_out = s.bytes;
+  args->total_ns_out = s.total_ns;
+  args->max_ns_out = s.max_ns;
+  std::copy(s.histogram, s.histogram + NLATENCY_BUCKETS, args->histogram_out);
+  API_END();
+}
+
+GSC_DLL auto StatsReset() -> int {
+  API_BEGIN();
+  reset_stats();
   API_END();
 }
@@ -0,0 +1,239 @@
+#include "csr_builder.hpp"
+#include "externalsort.hpp"
+#include "tools.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ----------------------------------------------------------------------------
+// CSRFileWriter
+// ----------------------------------------------------------------------------
+
+/// Moves `size` bytes of `file` at `from` to `to`, which is not after it,
+/// front to back, so that the ranges may overlap
+static void move_down(std::fstream &file, std::uint64_t from,
+                      std::uint64_t to, std::uint64_t size) {
+  if (from == to) {
+    return;
+  }
+  std::vector<char> buf(std::min<std::uint64_t>(size, 1U << 20U));
+  for (std::uint64_t done = 0; done < size;) {
+    auto n = std::min<std::uint64_t>(buf.size(), size - done);
+    file.seekg(static_cast<std::streamoff>(from + done));
+    file.read(buf.data(), static_cast<std::streamsize>(n));
+    file.seekp(static_cast<std::streamoff>(to + done));
+    file.write(buf.data(), static_cast<std::streamsize>(n));
+    done += n;
+  }
+}
+
+template <class V, class I, class P>
+CSRFileWriter<V, I, P>::CSRFileWriter(std::string fname, std::size_t max_nnz)
+    : _fname(std::move(fname)), _h(CSRFileHeader::make(0, 0)),
+      _max_nnz(max_nnz) {
+  if (max_nnz > std::numeric_limits<P>::max()) {
+    throw std::runtime_error("index pointer type is too small for max_nnz");
+  }
+  auto nvalues = std::is_same_v<V, pattern> ? 0 : max_nnz;
+  _h.layout({nvalues, max_nnz, 0}, matrix_type::DTYPES);
+
+  // the first stream creates the file, the others write into it
+  _data.open(_fname, std::ios::binary | std::ios::trunc);
+  _indices.open(_fname, std::ios::binary | std::ios::in | std::ios::out);
+  _indptr.open(_fname, std::ios::binary | std::ios::in | std::ios::out);
+  if (!_data || !_indices || !_indptr) {
+    std::ostringstream ss;
+    ss << "Could not save " << _fname;
+    throw std::runtime_error(ss.str());
+  }
+
+  // placeholder header, rewritten on close
+  _data.write(reinterpret_cast<const char *>(&_h), sizeof(_h));
+  write_padding(_data);
+  _indices.seekp(
+      static_cast<std::streamoff>(_h.sections[CSRFileHeader::INDICES].offset));
+  _indptr.seekp(
+      static_cast<std::streamoff>(_h.sections[CSRFileHeader::INDPTR].offset));
+
+  P zero{0};
+  _indptr.write(reinterpret_cast<const char *>(&zero), sizeof(P));
+}
+
+template <class V, class I, class P>
+void CSRFileWriter<V, I, P>::end_rows(std::size_t row) {
+  auto end = static_cast<P>(_nnz);
+  for (; _nrows < row; ++_nrows) {
+    _indptr.write(reinterpret_cast<const char *>(&end), sizeof(P));
+  }
+}
+
+template <class V, class I, class P>
+void CSRFileWriter<V, I, P>::push(std::size_t row, I col, V value) {
+  if (_closed) {
+    throw std::runtime_error("CSR file writer is closed");
+  }
+  if (row < _nrows) {
+    throw std::runtime_error("rows should be written in non-decreasing order");
+  }
+  if (_nnz == _max_nnz) {
+    throw std::runtime_error("more non-zeros than reserved");
+  }
+
+  end_rows(row);
+  if constexpr (!std::is_same_v<V, pattern>) {
+    _data.write(reinterpret_cast<const char *>(&value), sizeof(V));
+  }
+  _indices.write(reinterpret_cast<const char *>(&col), sizeof(I));
+  _ncols = std::max(_ncols, static_cast<std::size_t>(col) + 1);
+  _nnz++;
+}
+
+template <class V, class I, class P>
+auto CSRFileWriter<V, I, P>::close(std::size_t nrows, std::size_t ncols)
+    -> std::size_t {
+  if (_closed) {
+    throw std::runtime_error("CSR file writer is closed");
+  }
+  _closed = true;
+
+  // the row of the last non-zero is still open
+  auto infered_nrows = _nnz == 0 ? _nrows : _nrows + 1;
+  nrows = nrows == 0 ? infered_nrows : nrows;
+  ncols = ncols == 0 ? _ncols : ncols;
+  if (nrows < infered_nrows || ncols < _ncols) {
+    throw std::runtime_error("shape is too small");
+  }
+  if (nrows == 0 || ncols == 0) {
+    throw std::runtime_error("matrix has no rows or columns");
+  }
+  end_rows(nrows);
+
+  _data.close();
+  _indices.close();
+  _indptr.close();
+  if (!_data || !_indices || !_indptr) {
+    std::ostringstream ss;
+    ss << "Could not save " << _fname;
+    throw std::runtime_error(ss.str());
+  }
+
+  // sections were laid out for `max_nnz` non-zeros, those left out leave
+  // holes, which are closed by moving sections down to their final offsets
+  auto reserved = _h;
+  auto size = _h.layout({std::is_same_v<V, pattern> ? 0 : _nnz, _nnz,
+                         nrows + 1},
+                        matrix_type::DTYPES);
+  _h.nrows = nrows;
+  _h.ncols = ncols;
+  _h.flags = CSRFileHeader::VALIDATED; // rows are sorted, shape is checked
+
+  std::fstream file(_fname, std::ios::binary | std::ios::in | std::ios::out);
+  for (auto s : {CSRFileHeader::INDICES, CSRFileHeader::INDPTR}) {
+    auto &section = _h.sections[s];
+    move_down(file, reserved.sections[s].offset, section.offset,
+              section.length * dtype_size(section.dtype));
+  }
+  // padding after indices may hold moved bytes
+  auto &indices = _h.sections[CSRFileHeader::INDICES];
+  file.seekp(static_cast<std::streamoff>(
+      indices.offset + indices.length * sizeof(I)));
+  write_padding(file);
+  file.seekp(0);
+  file.write(reinterpret_cast<const char *>(&_h), sizeof(_h));
+  file.close();
+  if (!file) {
+    std::ostringstream ss;
+    ss << "Could not save " << _fname;
+    throw std::runtime_error(ss.str());
+  }
+  fs::resize_file(_fname, size);
+  return _nnz;
+}
+
+// Explicit template instantiation
+template class CSRFileWriter<float, std::uint32_t, std::uint32_t>;
+template class CSRFileWriter<float, std::uint32_t, std::uint64_t>;
+template class CSRFileWriter<float, std::uint64_t, std::uint64_t>;
+template class CSRFileWriter<pattern, std::uint32_t, std::uint32_t>;
+template class CSRFileWriter<pattern, std::uint32_t, std::uint64_t>;
+
+// ----------------------------------------------------------------------------
+// Edge list to CSR
+// ----------------------------------------------------------------------------
+
+/// Merge sorted edges into `writer`
+template <class W>
+static auto write_sorted(std::istream &is, const fs::path &run_dir,
+                         std::size_t max_mem, bool dedup, W &&writer)
+    -> std::size_t {
+  using edge_type = EdgeItem<std::uint32_t>;
+  std::size_t nnodes = 0;
+  {
+    ExternalSorter<edge_type> sorter(run_dir, max_mem);
+    auto merged = sorter.sort_unstable(is);
+
+    bool first = true;
+    edge_type prev;
+    for (auto &edge : merged) {
+      if (dedup && !first && edge == prev) {
+        continue;
+      }
+      writer.push(edge.first, edge.second, pattern{});
+      nnodes = std::max<std::size_t>(
+          nnodes, std::size_t{std::max(edge.first, edge.second)} + 1);
+      prev = edge;
+      first = false;
+    }
+  } // close runs before they are removed
+
+  // square, so that nodes with only incoming edges have rows too
+  return writer.close(nnodes, nnodes);
+}
+
+auto build_csr(const std::string &edges_fname, const std::string &csr_fname,
+               const fs::path &tmp_dir, std::size_t max_mem, bool dedup)
+    -> std::size_t {
+  std::ifstream is(edges_fname, std::ios::binary);
+  if (!is) {
+    std::ostringstream ss;
+    ss << "Could not load " << edges_fname;
+    throw std::runtime_error(ss.str());
+  }
+  auto nedges = fs::file_size(edges_fname) / sizeof(EdgeItem<std::uint32_t>);
+
+  auto run_dir = tmp_dir / (fs::path(csr_fname).filename().string() + ".runs");
+  fs::create_directories(run_dir);
+
+  std::size_t nnz = 0;
+  try {
+    if (nedges > std::numeric_limits<std::uint32_t>::max()) {
+      nnz = write_sorted(
+          is, run_dir, max_mem, dedup,
+          CSRFileWriter<pattern, std::uint32_t, std::uint64_t>(csr_fname,
+                                                               nedges));
+    } else {
+      nnz = write_sorted(is, run_dir, max_mem, dedup,
+                         CSRFileWriter<pattern, std::uint32_t, std::uint32_t>(
+                             csr_fname, nedges));
+    }
+  } catch (...) {
+    std::error_code ec;
+    fs::remove_all(run_dir, ec);
+    throw;
+  }
+
+  fs::remove_all(run_dir);
+  return nnz;
+}
@@ -0,0 +1,262 @@
+#include "csr_format.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+auto dtype_size(DType dtype) -> std::size_t {
+  switch (dtype) {
+  case DType::float32:
+    return sizeof(float);
+  case DType::uint32:
+    return sizeof(std::uint32_t);
+  case DType::uint64:
+    return sizeof(std::uint64_t);
+  case DType::float16:
+    return sizeof(float16);
+  case DType::bfloat16:
+    return sizeof(bfloat16);
+  case DType::uint8:
+    return sizeof(std::uint8_t);
+  case DType::pattern:
+  case DType::none:
+    break;
+  }
+  return 0;
+}
+
+auto dtype_name(DType dtype) -> const char * {
+  switch (dtype) {
+  case DType::float32:
+    return "float32";
+  case DType::uint32:
+    return "uint32";
+  case DType::uint64:
+    return "uint64";
+  case DType::float16:
+    return "float16";
+  case DType::bfloat16:
+    return "bfloat16";
+  case DType::uint8:
+    return "uint8";
+  case DType::pattern:
+    return "pattern";
+  case DType::none:
+    break;
+  }
+  return "none";
+}
+
+// ----------------------------------------------------------------------------
+// Header
+// ----------------------------------------------------------------------------
+
+auto CSRFileHeader::make(std::uint64_t nrows, std::uint64_t ncols)
+    -> CSRFileHeader {
+  CSRFileHeader h{};
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.nrows = nrows;
+  h.ncols = ncols;
+  return h;
+}
+
+auto CSRFileHeader::is_magic(const char *bytes) -> bool {
+  return std::memcmp(bytes, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+auto CSRFileHeader::layout(const std::uint64_t (&lengths)[NSECTIONS],
+                           const DType (&dtypes)[NSECTIONS]) -> std::uint64_t {
+  std::uint64_t offset = sizeof(CSRFileHeader);
+  for (std::size_t i = 0; i < NSECTIONS; ++i) {
+    offset = align_offset(offset);
+    sections[i].offset = offset;
+    sections[i].length = lengths[i];
+    sections[i].dtype = dtypes[i];
+    offset += lengths[i] * dtype_size(dtypes[i]);
+  }
+  return offset;
+}
+
+static const char *SECTION_NAMES[CSRFileHeader::NSECTIONS] = {
+    "data", "indices", "indptr"};
+
+void CSRFileHeader::check(std::uint64_t file_size) const {
+  auto &names = SECTION_NAMES;
+
+  if (version != VERSION) {
+    std::ostringstream ss;
+    ss << "Unsupported CSR file version " << version;
+    throw std::runtime_error(ss.str());
+  }
+  for (std::size_t i = 0; i < NSECTIONS; ++i) {
+    auto &s = sections[i];
+    if (s.dtype == DType::pattern ? i != DATA : dtype_size(s.dtype) == 0) {
+      std::ostringstream ss;
+      ss << "Section " << names[i] << " has unknown dtype";
+      throw std::runtime_error(ss.str());
+    }
+    if (s.offset % ALIGNMENT != 0) {
+      std::ostringstream ss;
+      ss << "Section " << names[i] << " is not aligned";
+      throw std::runtime_error(ss.str());
+    }
+    // bound the length before multiplying, a crafted one could wrap
+    auto size = std::max<std::uint64_t>(dtype_size(s.dtype), 1);
+    if (s.offset > file_size || s.length > (file_size - s.offset) / size) {
+      std::ostringstream ss;
+      ss << "Section " << names[i] << " does not fit into the file";
+      throw std::runtime_error(ss.str());
+    }
+  }
+}
+
+void CSRFileHeader::check(const DType (&dtypes)[NSECTIONS],
+                          std::uint64_t file_size) const {
+  check(file_size);
+  for (std::size_t i = 0; i < NSECTIONS; ++i) {
+    if (sections[i].dtype != dtypes[i]) {
+      std::ostringstream ss;
+      ss << "Section " << SECTION_NAMES[i] << " has dtype "
+         << dtype_name(sections[i].dtype) << ", expected "
+         << dtype_name(dtypes[i]);
+      throw std::runtime_error(ss.str());
+    }
+  }
+}
+
+auto read_csr_header(std::istream &is, CSRFileHeader &header) -> bool {
+  auto start = is.tellg();
+  char magic[sizeof(CSRFileHeader::MAGIC)];
+  if (!is.read(magic, sizeof(magic)) || !CSRFileHeader::is_magic(magic)) {
+    is.clear();
+    is.seekg(start);
+    return false;
+  }
+
+  is.seekg(start);
+  if (!is.read(reinterpret_cast<char *>(&header), sizeof(CSRFileHeader))) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+  return true;
+}
+
+void write_padding(std::ostream &os) {
+  static const char zeros[CSRFileHeader::ALIGNMENT] = {};
+  auto pos = static_cast<std::uint64_t>(os.tellp());
+  os.write(zeros, static_cast<std::streamsize>(align_offset(pos) - pos));
+}
+
+// ----------------------------------------------------------------------------
+// Shard index
+// ----------------------------------------------------------------------------
+
+auto ShardIndexHeader::make(std::uint64_t nrows, std::uint64_t ncols,
+                            std::uint32_t nshards, std::uint64_t nnz)
+    -> ShardIndexHeader {
+  ShardIndexHeader h{};
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.nshards = nshards;
+  h.nrows = nrows;
+  h.ncols = ncols;
+  h.nnz = nnz;
+  return h;
+}
+
+void ShardIndexHeader::check(std::uint64_t file_size) const {
+  if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("Not a shard index file");
+  }
+  if (version != VERSION) {
+    std::ostringstream ss;
+    ss << "Unsupported shard index version " << version;
+    throw std::runtime_error(ss.str());
+  }
+  auto nbytes = (std::uint64_t{nshards} + 1 + nrows + 1) *
+                sizeof(std::uint64_t);
+  if (nrows >= file_size || nbytes != file_size - sizeof(ShardIndexHeader)) {
+    throw std::runtime_error("Shard index does not match its file size");
+  }
+}
+
+auto shard_fname(const std::string &fname, std::size_t shard)
+    -> std::string {
+  return fname + "." + std::to_string(shard);
+}
+
+// ----------------------------------------------------------------------------
+// Checksum
+// ----------------------------------------------------------------------------
+
+namespace {
+
+constexpr std::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+
+constexpr auto rotl(std::uint64_t x, unsigned r) -> std::uint64_t {
+  return (x << r) | (x >> (64U - r));
+}
+
+inline auto load64(const unsigned char *p) -> std::uint64_t {
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline auto round(std::uint64_t acc, std::uint64_t input) -> std::uint64_t {
+  return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+} // namespace
+
+auto checksum64(const void *data, std::size_t size, std::uint64_t seed)
+    -> std::uint64_t {
+  auto p = static_cast<const unsigned char *>(data);
+  auto end = p + size;
+  std::uint64_t h;
+
+  // four independent lanes keep the multiplier pipeline busy
+  if (size >= 32) {
+    std::uint64_t v[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed,
+                          seed - PRIME1};
+    for (; p + 32 <= end; p += 32) {
+      for (unsigned i = 0; i < 4; ++i) {
+        v[i] = round(v[i], load64(p + 8 * i));
+      }
+    }
+    h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+    for (auto lane : v) {
+      h = (h ^ round(0, lane)) * PRIME1 + PRIME4;
+    }
+  } else {
+    h = seed + PRIME3;
+  }
+
+  h += static_cast<std::uint64_t>(size);
+  for (; p + 8 <= end; p += 8) {
+    h = rotl(h ^ round(0, load64(p)), 27) * PRIME1 + PRIME4;
+  }
+  for (; p < end; ++p) {
+    h = rotl(h ^ (*p * PRIME3), 11) * PRIME1;
+  }
+
+  h ^= h >> 33U;
+  h *= PRIME2;
+  h ^= h >> 29U;
+  h *= PRIME3;
+  h ^= h >> 32U;
+  return h;
+}
+
+auto section_checksum(const void *data, std::size_t size, std::uint64_t seed)
+    -> std::uint64_t {
+  auto p = static_cast<const char *>(data);
+  for (std::size_t i = 0; i < size; i += CHECKSUM_BLOCK) {
+    seed = checksum64(p + i, std::min(CHECKSUM_BLOCK, size - i), seed);
+  }
+  return seed;
+}
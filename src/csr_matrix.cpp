@@ -1,6 +1,11 @@
 #define TBB_SUPPRESS_DEPRECATED_MESSAGES 1
 
 #include "csr_matrix.hpp"
+#include "csr_format.hpp"
+#include "generators.hpp"
+#include "half.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
 #include "tbb/tbb.h"
 #include "tools.hpp"
 
@@ -8,23 +13,34 @@
 #include <cassert>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
-CSR::CSR(vec_f &&data, vec_u &&indices, vec_u &&indptr, size_t nrows = 0,
-         size_t ncols = 0)
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+template <class V, class I, class P>
+BasicCSR<V, I, P>::BasicCSR(buf_v data, buf_i indices, buf_p indptr,
+                            size_t nrows, size_t ncols, bool validate)
     : _data(std::move(data)), _indices(std::move(indices)),
       _indptr(std::move(indptr)), _nrows(nrows), _ncols(ncols) {
-  if (_indices.empty()) {
+  if (_indices.empty() && _ncols == 0) {
     throw std::runtime_error("indices array is empty");
   }
   if (_indptr.empty()) {
@@ -33,74 +49,404 @@ CSR::CSR(vec_f &&data, vec_u &&indices, vec_u &&indptr, size_t nrows = 0,
   if (_indptr[0] != 0) {
     throw std::runtime_error("index pointer array should start with 0");
   }
-  if (_data.size() != _indices.size()) {
+  if constexpr (std::is_same_v<V, pattern>) {
+    if (!_data.empty()) {
+      throw std::runtime_error("data array of a pattern should be empty");
+    }
+  } else if (_data.size() != _indices.size()) {
     throw std::runtime_error("indices and data arrays should have same size");
   }
   if (_indptr.back() > _indices.size()) {
     throw std::runtime_error("Last value of index pointer should be less than "
                              "the size of index and data arrays");
   }
-  if (!std::is_sorted(_indptr.begin(), _indptr.end())) {
-    throw std::runtime_error("index pointer values must form a "
-                             "non-decreasing sequence");
+  if (_nrows != 0 && _ncols == 0) { // zero rows of `ncols` are a shape
+    throw std::runtime_error("both nrows and ncols should be provided or none");
+  }
+  if (_ncols != 0 && _indptr.size() - 1 != _nrows) {
+    std::ostringstream ss;
+    ss << "index pointer array should have " << _nrows + 1
+       << " elements, got " << _indptr.size();
+    throw std::runtime_error(ss.str());
+  }
+  if (!validate && _ncols != 0) {
+    return; // skip passes over whole arrays
   }
 
-  auto infered_nrows = _indptr.size() - 1;
-  auto it = std::max_element(_indices.begin(), _indices.end());
-  auto infered_ncols = static_cast<size_t>(*it) + 1;
-  if ((!_ncols != !_nrows) != 0) { // logical XOR
-    throw std::runtime_error("both nrows and ncols should be provided or none");
+  auto rows = _validate_rows();
+  if (!rows.ordered) {
+    throw std::runtime_error("index pointer values must form a "
+                             "non-decreasing sequence");
   }
-  if (_ncols != 0 && _nrows != 0) {
-    if (infered_nrows > _nrows || infered_ncols > _ncols) {
-      throw std::runtime_error("shape is too small");
-    }
+  if (_ncols != 0 && rows.ncols > _ncols) {
+    std::ostringstream ss;
+    ss << "column index " << rows.ncols - 1 << " is out of range of "
+       << _ncols << " columns";
+    throw std::runtime_error(ss.str());
   }
-  if (_ncols == 0 && _nrows == 0) {
-    _ncols = infered_ncols;
-    _nrows = infered_nrows;
+  if (_ncols == 0) {
+    _ncols = rows.ncols;
+    _nrows = _indptr.size() - 1;
   }
+  _validated = true;
 }
 
-template <class T> auto CSR::_read_vector(std::istream &is) -> std::vector<T> {
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::_validate_rows() const -> RowsCheck {
+  using range = tbb::blocked_range<size_t>;
+  constexpr size_t grain = 1U << 12U;
+  auto nnz = _indices.size();
+  const auto *indptr = _indptr.data();
+  const auto *indices = _indices.data();
+
+  return tbb::parallel_reduce(
+      range(0, _indptr.size() - 1, grain), RowsCheck{},
+      [=](const range &r, RowsCheck check) {
+        I max = 0;
+        bool empty = true;
+        for (auto i = r.begin(); i < r.end(); ++i) {
+          auto begin = indptr[i];
+          auto end = indptr[i + 1];
+          // bounds of a row are checked before it is read, as other chunks
+          // may not have checked the rows before it yet
+          if (begin > end || static_cast<size_t>(end) > nnz) {
+            check.ordered = false;
+            return check;
+          }
+          for (auto k = begin; k < end; ++k) {
+            max = std::max(max, indices[k]);
+          }
+          empty = empty && begin == end;
+        }
+        if (!empty) {
+          check.ncols = std::max(check.ncols, static_cast<size_t>(max) + 1);
+        }
+        return check;
+      },
+      [](RowsCheck a, const RowsCheck &b) {
+        a.ordered = a.ordered && b.ordered;
+        a.ncols = std::max(a.ncols, b.ncols);
+        return a;
+      });
+}
+
+template <class V, class I, class P>
+template <class T>
+auto BasicCSR<V, I, P>::_read_vector(std::istream &is) -> std::vector<T> {
   std::uint32_t _v_size(0);
   is.read(reinterpret_cast<char *>(&_v_size), sizeof(std::uint32_t));
 
   std::vector<T> v;
   v.resize(_v_size);
-  is.read(reinterpret_cast<char *>(v.data()), _v_size * sizeof(T));
+  if constexpr (std::is_same_v<T, float> || std::is_same_v<T, std::uint32_t>) {
+    is.read(reinterpret_cast<char *>(v.data()), _v_size * sizeof(T));
+  } else { // version 1 stores 32 bit indices only
+    std::vector<std::uint32_t> v32(_v_size);
+    is.read(reinterpret_cast<char *>(v32.data()),
+            _v_size * sizeof(std::uint32_t));
+    std::copy(v32.begin(), v32.end(), v.begin());
+  }
   return v;
 }
 
+/// Read `n` elements stored as `F` into `out` converting them to `T`, one
+/// checksum block at a time. Values are converted by `convert_values`.
+template <class F, class T>
+static void read_converted(std::istream &is, T *out, size_t n,
+                           std::uint64_t *h, float scale = 1.F) {
+  constexpr size_t block = CHECKSUM_BLOCK / sizeof(F);
+  std::vector<F> buf;
+  for (size_t i = 0; i < n; i += block) {
+    auto len = std::min(block, n - i);
+    F *dst = nullptr;
+    if constexpr (std::is_same_v<F, T>) {
+      dst = out + i;
+    } else {
+      buf.resize(len);
+      dst = buf.data();
+    }
+
+    auto nbytes = static_cast<std::streamsize>(len * sizeof(F));
+    if (!is.read(reinterpret_cast<char *>(dst), nbytes)) {
+      throw std::runtime_error("Unexpected end of file");
+    }
+    if (h != nullptr) {
+      *h = checksum64(dst, len * sizeof(F), *h);
+    }
+
+    if constexpr (std::is_same_v<T, float> && !std::is_same_v<F, T>) {
+      convert_values(buf.data(), len, out + i, scale);
+    } else if constexpr (!std::is_same_v<F, T>) {
+      for (size_t k = 0; k < len; ++k) {
+        if (buf[k] > std::numeric_limits<T>::max()) {
+          throw std::runtime_error("Stored index does not fit into the "
+                                   "index type of the matrix");
+        }
+        out[i + k] = static_cast<T>(buf[k]);
+      }
+    }
+  }
+}
+
+template <class V, class I, class P>
+template <class T>
+auto BasicCSR<V, I, P>::_read_section(std::istream &is,
+                                      const CSRSectionEntry &section,
+                                      std::uint64_t *h, float scale)
+    -> std::vector<T> {
+  std::vector<T> v;
+  v.resize(section.length);
+  is.seekg(static_cast<std::streamoff>(section.offset));
+
+  if (section.dtype == dtype_of<T>::value) {
+    read_converted<T>(is, v.data(), v.size(), h);
+    return v;
+  }
+  if constexpr (std::is_integral_v<T>) {
+    switch (section.dtype) {
+    case DType::uint32:
+      read_converted<std::uint32_t>(is, v.data(), v.size(), h);
+      return v;
+    case DType::uint64:
+      read_converted<std::uint64_t>(is, v.data(), v.size(), h);
+      return v;
+    default:
+      break;
+    }
+  }
+  if constexpr (std::is_same_v<T, float>) {
+    switch (section.dtype) {
+    case DType::float16:
+      read_converted<float16>(is, v.data(), v.size(), h);
+      return v;
+    case DType::bfloat16:
+      read_converted<bfloat16>(is, v.data(), v.size(), h);
+      return v;
+    case DType::uint8:
+      read_converted<std::uint8_t>(is, v.data(), v.size(), h, scale);
+      return v;
+    default:
+      break;
+    }
+  }
+
+  std::ostringstream ss;
+  ss << "Can not read section of dtype " << dtype_name(section.dtype)
+     << " as " << dtype_name(dtype_of<T>::value);
+  throw std::runtime_error(ss.str());
+}
+
+template <class V, class I, class P>
 template <class T>
-void CSR::_write_vector(std::ostream &os, const std::vector<T> &v) {
-  auto _v_size(static_cast<std::uint32_t>(v.size()));
-  os.write(reinterpret_cast<const char *>(&(_v_size)), sizeof(std::uint32_t));
-  os.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+void BasicCSR<V, I, P>::_write_section(std::ostream &os, const Buffer<T> &v) {
+  write_padding(os);
+  os.write(reinterpret_cast<const char *>(v.data()),
+           static_cast<std::streamsize>(v.size() * sizeof(T)));
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::checksum() const -> std::uint64_t {
+  auto h = section_checksum(_data.data(), _data.size() * sizeof(V));
+  h = section_checksum(_indices.data(), _indices.size() * sizeof(I), h);
+  return section_checksum(_indptr.data(), _indptr.size() * sizeof(P), h);
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::_from_sections(const CSRFileHeader &h, buf_v data,
+                                       buf_i indices, buf_p indptr,
+                                       bool trusted) -> BasicCSR * {
+  auto validate = !trusted || !h.has(CSRFileHeader::VALIDATED);
+  auto m = new BasicCSR(std::move(data), std::move(indices), std::move(indptr),
+                        h.nrows, h.ncols, validate);
+  if constexpr (std::is_same_v<V, std::uint8_t> ||
+                std::is_same_v<V, pattern>) {
+    m->_scale = h.value_scale();
+  }
+  return m;
+}
+
+/// Read data section of a version 2 file, values of a pattern are filled in
+/// when it is read as floats
+template <class M>
+static auto read_values(std::istream &is, const CSRFileHeader &h,
+                        std::uint64_t *psum) -> typename M::vec_v {
+  const auto &values = h.sections[CSRFileHeader::DATA];
+  if constexpr (std::is_same_v<typename M::value_type, float>) {
+    if (values.dtype == DType::pattern) { // no bytes to read or checksum
+      return typename M::vec_v(h.sections[CSRFileHeader::INDICES].length,
+                               h.value_scale());
+    }
+  }
+  return M::template _read_section<typename M::value_type>(is, values, psum,
+                                                           h.value_scale());
+}
+
+/// Moves arrays of a loaded matrix to memory placed by `placement`
+template <class M> static auto placed(M *loaded, Placement placement) -> M * {
+  std::unique_ptr<M> m(loaded);
+  if (!placement.is_default()) {
+    *m = m->place(placement);
+  }
+  return m.release();
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::load(const std::string &fname, Placement placement,
+                             bool trusted) -> BasicCSR * {
+  StatTimer timer(Stat::load);
+  std::ifstream is(fname, std::ios::binary);
+  if (!is) {
+    std::ostringstream ss;
+    ss << "Could not load " << fname;
+    throw std::runtime_error(ss.str());
+  }
+  auto file_size = std::filesystem::file_size(fname);
+
+  CSRFileHeader h{};
+  if (read_csr_header(is, h)) {
+    h.check(file_size);
+    timer.set(h.nrows, file_size);
+
+    // checksum is chained over raw bytes, as sections are read
+    std::uint64_t sum = 0;
+    auto psum = h.has(CSRFileHeader::CHECKSUM) ? &sum : nullptr;
+    auto data = read_values<BasicCSR>(is, h, psum);
+    auto indices =
+        _read_section<I>(is, h.sections[CSRFileHeader::INDICES], psum);
+    auto indptr = _read_section<P>(is, h.sections[CSRFileHeader::INDPTR], psum);
+    if (psum != nullptr && sum != h.checksum) {
+      throw std::runtime_error("CSR file checksum mismatch");
+    }
+    return placed(_from_sections(h, std::move(data), std::move(indices),
+                                 std::move(indptr), trusted),
+                  placement);
+  }
+
+  // legacy version 1 file
+  if constexpr (!std::is_same_v<V, float>) {
+    throw std::runtime_error("Version 1 files can only be loaded as float");
+  } else {
+    std::uint32_t nrows(0);
+    std::uint32_t ncols(0);
+    is.read(reinterpret_cast<char *>(&nrows), sizeof(std::uint32_t));
+    is.read(reinterpret_cast<char *>(&ncols), sizeof(std::uint32_t));
+    timer.set(nrows, file_size);
+
+    auto data = _read_vector<V>(is);
+    auto indices = _read_vector<I>(is);
+    auto indptr = _read_vector<P>(is);
+
+    return placed(new BasicCSR(std::move(data), std::move(indices),
+                               std::move(indptr), nrows, ncols),
+                  placement);
+  }
 }
 
-auto CSR::load(const std::string &fname) -> CSR * {
-  std::ifstream is(fname);
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::load_indptr(const std::string &fname) -> vec_p {
+  std::ifstream is(fname, std::ios::binary);
   if (!is) {
     std::ostringstream ss;
     ss << "Could not load " << fname;
     throw std::runtime_error(ss.str());
   }
 
-  std::uint32_t nrows(0);
-  std::uint32_t ncols(0);
-  is.read(reinterpret_cast<char *>(&nrows), sizeof(std::uint32_t));
-  is.read(reinterpret_cast<char *>(&ncols), sizeof(std::uint32_t));
+  CSRFileHeader h{};
+  if (read_csr_header(is, h)) {
+    h.check(std::filesystem::file_size(fname));
+    return _read_section<P>(is, h.sections[CSRFileHeader::INDPTR], nullptr);
+  }
 
-  auto data = CSR::_read_vector<float>(is);
-  auto indices = CSR::_read_vector<std::uint32_t>(is);
-  auto indptr = CSR::_read_vector<std::uint32_t>(is);
+  // legacy version 1 file, skip shape, data and indices
+  is.seekg(2 * sizeof(std::uint32_t));
+  std::uint32_t _v_size(0);
+  is.read(reinterpret_cast<char *>(&_v_size), sizeof(std::uint32_t));
+  is.seekg(_v_size * sizeof(float), std::ios::cur);
+  is.read(reinterpret_cast<char *>(&_v_size), sizeof(std::uint32_t));
+  is.seekg(_v_size * sizeof(std::uint32_t), std::ios::cur);
+  return _read_vector<P>(is);
+}
 
-  return new CSR(std::move(data), std::move(indices), std::move(indptr), nrows,
-                 ncols);
+/// View a vector written by version 1 `save` at `offset` of a mapped file and
+/// advance `offset` past it
+template <class T>
+static auto view_vector(const std::shared_ptr<const MappedFile> &file,
+                        std::size_t &offset) -> Buffer<T> {
+  std::uint32_t _v_size(0);
+  if (offset + sizeof(std::uint32_t) > file->size()) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+  std::memcpy(&_v_size, file->data() + offset, sizeof(std::uint32_t));
+  offset += sizeof(std::uint32_t);
+
+  auto nbytes = static_cast<std::size_t>(_v_size) * sizeof(T);
+  if (offset + nbytes > file->size()) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+  auto ptr = reinterpret_cast<const T *>(file->data() + offset);
+  offset += nbytes;
+  return Buffer<T>(ptr, _v_size, file);
+}
+
+/// View a section of a mapped file, `CSRFileHeader::check` must have passed
+template <class T>
+static auto view_section(const std::shared_ptr<const MappedFile> &file,
+                         const CSRSectionEntry &section) -> Buffer<T> {
+  auto ptr = reinterpret_cast<const T *>(file->data() + section.offset);
+  return Buffer<T>(ptr, section.length, file);
 }
 
-void CSR::save(const std::string &fname) {
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::load_mmap(const std::string &fname, bool trusted)
+    -> BasicCSR * {
+  StatTimer timer(Stat::map);
+  auto file = std::make_shared<const MappedFile>(fname);
+
+  CSRFileHeader h{};
+  if (file->size() >= sizeof(h) && CSRFileHeader::is_magic(file->data())) {
+    std::memcpy(&h, file->data(), sizeof(h));
+    h.check(DTYPES, file->size());
+    timer.set(h.nrows, file->size());
+    auto data = view_section<V>(file, h.sections[CSRFileHeader::DATA]);
+    auto indices = view_section<I>(file, h.sections[CSRFileHeader::INDICES]);
+    auto indptr = view_section<P>(file, h.sections[CSRFileHeader::INDPTR]);
+    if (h.has(CSRFileHeader::CHECKSUM)) {
+      auto sum = section_checksum(data.data(), data.size() * sizeof(V));
+      sum = section_checksum(indices.data(), indices.size() * sizeof(I), sum);
+      sum = section_checksum(indptr.data(), indptr.size() * sizeof(P), sum);
+      if (sum != h.checksum) {
+        throw std::runtime_error("CSR file checksum mismatch");
+      }
+    }
+    return _from_sections(h, std::move(data), std::move(indices),
+                          std::move(indptr), trusted);
+  }
+
+  // legacy version 1 file
+  if constexpr (!std::is_same_v<V, float> ||
+                !std::is_same_v<I, std::uint32_t> ||
+                !std::is_same_v<P, std::uint32_t>) {
+    throw std::runtime_error("Version 1 files can only be mapped as CSR");
+  }
+  std::uint32_t shape[2] = {0, 0};
+  if (file->size() < sizeof(shape)) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+  std::memcpy(shape, file->data(), sizeof(shape));
+  std::size_t offset = sizeof(shape);
+  timer.set(shape[0], file->size());
+
+  auto data = view_vector<V>(file, offset);
+  auto indices = view_vector<I>(file, offset);
+  auto indptr = view_vector<P>(file, offset);
+
+  return new BasicCSR(std::move(data), std::move(indices), std::move(indptr),
+                      shape[0], shape[1]);
+}
+
+template <class V, class I, class P>
+void BasicCSR<V, I, P>::save(const std::string &fname, bool checksum) {
+  StatTimer timer(Stat::save);
   std::ofstream os(fname, std::ios::binary);
   if (!os) {
     std::ostringstream ss;
@@ -108,69 +454,835 @@ void CSR::save(const std::string &fname) {
     throw std::runtime_error(ss.str());
   }
 
-  // forward write matrix shape
-  os.write(reinterpret_cast<const char *>(&_nrows), sizeof(std::uint32_t));
-  os.write(reinterpret_cast<const char *>(&_ncols), sizeof(std::uint32_t));
+  auto h = CSRFileHeader::make(_nrows, _ncols);
+  if (_validated) {
+    h.flags = CSRFileHeader::VALIDATED;
+  }
+  h.scale = _scale;
+  h.layout({_data.size(), _indices.size(), _indptr.size()}, DTYPES);
+  if (checksum) {
+    h.flags |= CSRFileHeader::CHECKSUM;
+    h.checksum = this->checksum();
+  }
+
+  os.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  _write_section(os, _data);
+  _write_section(os, _indices);
+  _write_section(os, _indptr);
+  if (!os) {
+    std::ostringstream ss;
+    ss << "Could not save " << fname;
+    throw std::runtime_error(ss.str());
+  }
+  timer.set(_nrows, static_cast<std::uint64_t>(os.tellp()));
+}
+
+template <class V, class I, class P>
+void BasicCSR<V, I, P>::save_sharded(const std::string &fname,
+                                     size_t shard_rows, bool checksum) const {
+  // rows of a shard are sliced with `int` indices
+  if (shard_rows == 0 ||
+      shard_rows > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    std::ostringstream ss;
+    ss << "Shard of " << shard_rows << " rows is empty or too large";
+    throw std::runtime_error(ss.str());
+  }
+  auto nshards = (_nrows + shard_rows - 1) / shard_rows;
+  if (nshards > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::runtime_error("Too many shards");
+  }
 
-  _write_vector(os, _data);
-  _write_vector(os, _indices);
-  _write_vector(os, _indptr);
+  // shards view arrays of this matrix, only their index pointer is rebased
+  tbb::parallel_for(size_t{0}, nshards, [&](size_t k) {
+    auto first = k * shard_rows;
+    auto last = std::min(_nrows, first + shard_rows);
+    auto begin = static_cast<size_t>(_indptr[first]);
+    auto end = static_cast<size_t>(_indptr[last]);
+    buf_v data;
+    if constexpr (!std::is_same_v<V, pattern>) {
+      data = buf_v(_data.data() + begin, end - begin, nullptr);
+    }
+    vec_p indptr(last - first + 1);
+    for (auto i = first; i <= last; ++i) {
+      indptr[i - first] = _indptr[i] - _indptr[first];
+    }
+    BasicCSR shard(std::move(data),
+                   buf_i(_indices.data() + begin, end - begin, nullptr),
+                   std::move(indptr), last - first, _ncols, false);
+    shard._scale = _scale;
+    shard._validated = _validated;
+    shard.save(shard_fname(fname, k), checksum);
+  });
+
+  std::ofstream os(fname, std::ios::binary);
+  auto h = ShardIndexHeader::make(_nrows, _ncols,
+                                  static_cast<std::uint32_t>(nshards),
+                                  _indptr[_nrows]);
+  os.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  std::vector<std::uint64_t> starts(nshards + 1);
+  for (size_t k = 0; k < nshards; ++k) {
+    starts[k] = k * shard_rows;
+  }
+  starts[nshards] = _nrows;
+  os.write(reinterpret_cast<const char *>(starts.data()),
+           static_cast<std::streamsize>(starts.size() * sizeof(starts[0])));
+  if constexpr (std::is_same_v<P, std::uint64_t>) {
+    os.write(reinterpret_cast<const char *>(_indptr.data()),
+             static_cast<std::streamsize>((_nrows + 1) * sizeof(P)));
+  } else {
+    std::vector<std::uint64_t> indptr(_indptr.begin(),
+                                      _indptr.begin() + _nrows + 1);
+    os.write(reinterpret_cast<const char *>(indptr.data()),
+             static_cast<std::streamsize>(indptr.size() * sizeof(indptr[0])));
+  }
+  if (!os) {
+    std::ostringstream ss;
+    ss << "Could not save " << fname;
+    throw std::runtime_error(ss.str());
+  }
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::random(size_t nrows, size_t ncols, float prob)
+    -> BasicCSR {
+  auto seed = static_cast<std::uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+  // values are in [0, 1)
+  auto m = uniform_csr<BasicCSR<float, I, P>>(nrows, ncols, prob, seed);
+  if constexpr (std::is_same_v<V, float>) {
+    return m;
+  } else {
+    auto scale = std::is_same_v<V, std::uint8_t> ? 1.F / 255 : 1.F;
+    vec_v data;
+    if constexpr (!std::is_same_v<V, pattern>) {
+      data.resize(m.nnz());
+      convert_values(m._data.data(), m.nnz(), data.data(), scale);
+    }
+    BasicCSR r(std::move(data), m._indices, m._indptr, nrows, ncols, false);
+    r._scale = scale;
+    return r;
+  }
 }
 
-auto CSR::random(size_t nrows, size_t ncols, float prob) -> CSR {
-  std::vector<float> data;
-  std::vector<std::uint32_t> indices;
-  std::vector<std::uint32_t> indptr{0};
+template <class V, class I, class P>
+template <class V2>
+auto BasicCSR<V, I, P>::astype(float scale) const -> BasicCSR<V2, I, P> {
+  using range = tbb::blocked_range<size_t>;
+  constexpr size_t grain = 1U << 16U;
+
+  auto reduce = [this](float init, auto &&op) {
+    return tbb::parallel_reduce(
+        range(0, nnz(), grain), init,
+        [this, &op](const range &r, float m) {
+          for (auto k = r.begin(); k != r.end(); ++k) {
+            m = op(m, value(k));
+          }
+          return m;
+        },
+        op);
+  };
 
-  auto seed(std::chrono::steady_clock::now().time_since_epoch().count());
-  std::mt19937 rng(seed);
+  auto min = [](float a, float b) { return std::min(a, b); };
+  auto max = [](float a, float b) { return std::max(a, b); };
 
-  auto threshold = static_cast<unsigned int>(prob * 100);
-  size_t iptr = 0;
-  for (size_t _i = 0; _i < nrows; ++_i) {
-    for (size_t j = 0; j < ncols; ++j) {
-      auto r = rng();
-      if (r % 100 < threshold) {
-        auto v = static_cast<float>(r) / static_cast<float>(rng.max());
-        data.push_back(v);
-        indices.push_back(j);
-        iptr++;
+  std::vector<V2> data;
+  if constexpr (std::is_same_v<V2, pattern>) {
+    if (scale == 0.F && nnz() != 0) { // values must be equal already
+      auto lo = reduce(value(0), min);
+      if (lo != reduce(value(0), max)) {
+        throw std::runtime_error("Values of a pattern should be equal");
+      }
+      scale = lo;
+    }
+    scale = scale == 0.F ? 1.F : scale;
+  } else {
+    if constexpr (std::is_same_v<V2, std::uint8_t>) {
+      if (scale == 0.F) { // largest value maps to 255
+        auto hi = reduce(0.F, max);
+        scale = hi > 0.F ? hi / 255 : 1.F;
       }
+    } else {
+      scale = 1.F;
     }
-    indptr.push_back(iptr);
+
+    data.resize(nnz());
+    tbb::parallel_for(range(0, nnz(), grain), [&](const range &r) {
+      auto n = r.size();
+      auto out = data.data() + r.begin();
+      if constexpr (std::is_same_v<V, pattern>) {
+        V2 v{};
+        convert_values(&_scale, 1, &v, scale);
+        std::fill(out, out + n, v);
+      } else if constexpr (std::is_same_v<V, std::uint8_t> &&
+                           std::is_same_v<V2, std::uint8_t>) { // requantize
+        vec_f values(n);
+        convert_values(_data.data() + r.begin(), n, values.data(), _scale);
+        convert_values(values.data(), n, out, scale);
+      } else if constexpr (std::is_same_v<V, std::uint8_t>) {
+        convert_values(_data.data() + r.begin(), n, out, _scale);
+      } else {
+        convert_values(_data.data() + r.begin(), n, out, scale);
+      }
+    });
   }
-  return CSR(std::move(data), std::move(indices), std::move(indptr));
+
+  BasicCSR<V2, I, P> m(std::move(data), _indices, _indptr, _nrows, _ncols,
+                       false);
+  m._scale = scale;
+  m._validated = _validated;
+  return m;
 }
 
-auto CSR::slice(const int *ixs, size_t size) -> float * {
-  auto prev_size = slice_data.size();
-  auto new_size = size * _ncols;
-  slice_data.resize(new_size, 0);
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::slice(const int *ixs, size_t size) -> float * {
+  slice_data.resize(size * _ncols);
+  slice(ixs, size, slice_data.data());
+  return slice_data.data();
+}
 
-  auto begin = slice_data.begin();
-  auto end = begin + std::min(prev_size, new_size);
-  std::fill(begin, end, 0);
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::place(Placement placement) const -> BasicCSR {
+  auto copy = [&](int node) {
+    BasicCSR m(place_buffer(_data.data(), _data.size(), placement, node),
+               place_buffer(_indices.data(), _indices.size(), placement, node),
+               place_buffer(_indptr.data(), _indptr.size(), placement, node),
+               _nrows, _ncols, false);
+    m._scale = _scale;
+    m._validated = _validated;
+    m.slice_data = vec_slice(PageAllocator<float>(placement));
+    return m;
+  };
 
-  auto worker = [&](const tbb::blocked_range<size_t> &r) {
+  if (placement.numa != NumaPolicy::replicate) {
+    return copy(-1);
+  }
+  auto replicas = std::make_shared<std::vector<BasicCSR>>();
+  for (int node = 0; node < numa_nodes(); ++node) {
+    replicas->push_back(copy(node));
+  }
+  auto m = replicas->front(); // shares arrays of the first node
+  m._replicas = std::move(replicas);
+  return m;
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::_local() const -> const BasicCSR & {
+  if (!_replicas) {
+    return *this;
+  }
+  auto node = static_cast<size_t>(current_numa_node());
+  return (*_replicas)[node % _replicas->size()];
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::_row(int ixi) const -> size_t {
+  auto ix = ixi < 0 ? static_cast<size_t>(ixi + static_cast<long>(_nrows))
+                    : static_cast<size_t>(ixi);
+  if (ix >= _nrows) {
+    std::ostringstream ss;
+    ss << "Index " << ixi << " is out of range (0, " << _nrows << ")";
+    throw std::runtime_error(ss.str());
+  }
+  return ix;
+}
+
+// ----------------------------------------------------------------------------
+// Scatter kernels
+// ----------------------------------------------------------------------------
+
+/// Writes `n` values of a row to their columns of a dense row `out`,
+/// `scale` is the multiplier of `uint8_t` values or the value of a
+/// `pattern`, whose `data` is null
+template <class V, class I, class O>
+using scatter_fn = void (*)(const V *data, const I *indices, size_t n,
+                            float scale, O *out);
+
+template <class V, class I, class O>
+static void scatter_scalar(const V *data, const I *indices, size_t n,
+                           float scale, O *out) {
+  if constexpr (std::is_same_v<V, pattern>) {
+    (void)data;
+    auto value = static_cast<O>(scale);
+    for (size_t j = 0; j < n; ++j) {
+      out[indices[j]] = value;
+    }
+  } else if constexpr (std::is_same_v<V, O>) {
+    (void)scale;
+    for (size_t j = 0; j < n; ++j) {
+      out[indices[j]] = data[j];
+    }
+  } else { // convert a block of values at a time with vectorized routines
+    constexpr size_t block = 64;
+    O buf[block];
+    for (size_t j = 0; j < n; j += block) {
+      auto len = std::min(block, n - j);
+      convert_values(data + j, len, buf, scale);
+      for (size_t k = 0; k < len; ++k) {
+        out[indices[j + k]] = buf[k];
+      }
+    }
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// Lanes are scattered from the lowest to the highest one, so repeated
+// columns end up with the last value, same as with `scatter_scalar`
+
+// GCC 12 takes the undefined pass-through operand of unmasked conversions
+// for an uninitialized variable
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/// Loads 16 values as floats
+__attribute__((target("avx512f"))) static auto load16(const float *data,
+                                                      float /*scale*/)
+    -> __m512 {
+  return _mm512_loadu_ps(data);
+}
+
+__attribute__((target("avx512f"))) static auto load16(const float16 *data,
+                                                      float /*scale*/)
+    -> __m512 {
+  return _mm512_cvtph_ps(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)));
+}
+
+__attribute__((target("avx512f"))) static auto load16(const bfloat16 *data,
+                                                      float /*scale*/)
+    -> __m512 {
+  auto x = _mm512_cvtepu16_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(x, 16));
+}
+
+__attribute__((target("avx512f"))) static auto load16(const std::uint8_t *data,
+                                                      float scale) -> __m512 {
+  auto x = _mm512_cvtepu8_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+  return _mm512_mul_ps(_mm512_cvtepi32_ps(x), _mm512_set1_ps(scale));
+}
+
+template <class V>
+__attribute__((target("avx512f"))) static void
+scatter_avx512(const V *data, const std::uint32_t *indices, size_t n,
+               float scale, float *out) {
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    auto ix = _mm512_loadu_si512(indices + j);
+    _mm512_i32scatter_ps(out, ix, load16(data + j, scale), 4);
+  }
+  if (j < n) {
+    // values are staged, so that loads do not read past the row
+    V tail[16]{};
+    std::copy(data + j, data + n, tail);
+    auto mask = static_cast<__mmask16>((1U << (n - j)) - 1);
+    auto ix = _mm512_maskz_loadu_epi32(mask, indices + j);
+    _mm512_mask_i32scatter_ps(out, mask, ix, load16(tail, scale), 4);
+  }
+}
+
+template <class V>
+__attribute__((target("avx512f"))) static void
+scatter_avx512(const V *data, const std::uint64_t *indices, size_t n,
+               float scale, float *out) {
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    auto v = load16(data + j, scale);
+    auto hi = _mm512_extractf64x4_pd(_mm512_castps_pd(v), 1);
+    _mm512_i64scatter_ps(out, _mm512_loadu_si512(indices + j),
+                         _mm512_castps512_ps256(v), 4);
+    _mm512_i64scatter_ps(out, _mm512_loadu_si512(indices + j + 8),
+                         _mm256_castpd_ps(hi), 4);
+  }
+  scatter_scalar(data + j, indices + j, n - j, scale, out);
+}
+
+__attribute__((target("avx512f"))) static void
+scatter_avx512(const pattern * /*data*/, const std::uint32_t *indices,
+               size_t n, float scale, float *out) {
+  auto v = _mm512_set1_ps(scale);
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    _mm512_i32scatter_ps(out, _mm512_loadu_si512(indices + j), v, 4);
+  }
+  if (j < n) {
+    auto mask = static_cast<__mmask16>((1U << (n - j)) - 1);
+    auto ix = _mm512_maskz_loadu_epi32(mask, indices + j);
+    _mm512_mask_i32scatter_ps(out, mask, ix, v, 4);
+  }
+}
+#pragma GCC diagnostic pop
+#endif
+
+/// Best scatter kernel for rows of `ncols` columns. AVX2 has no scatter
+/// instruction, so it gets the scalar kernel.
+template <class V, class I, class O>
+static auto scatter_kernel(size_t ncols) -> scatter_fn<V, I, O> {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if constexpr (std::is_same_v<O, float>) {
+    // 32 bit lanes hold signed indices
+    auto fits = sizeof(I) == 8 || ncols <= size_t{1} << 31U;
+    if (simd_level() == SimdLevel::avx512 && fits) {
+      return [](const V *data, const I *indices, size_t n, float scale,
+                float *out) { scatter_avx512(data, indices, n, scale, out); };
+    }
+  }
+#endif
+  (void)ncols;
+  return scatter_scalar<V, I, O>;
+}
+
+template <class V, class I, class P>
+template <class O>
+void BasicCSR<V, I, P>::slice(const int *ixs, size_t size, O *out,
+                              bool sorted) const {
+  using range = tbb::blocked_range<size_t>;
+
+  auto scatter = scatter_kernel<V, I, O>(_ncols);
+  // a chunk reads arrays of the NUMA node its worker runs on
+  auto write_row = [&](const BasicCSR &m, size_t i, size_t ix) {
+    auto begin = static_cast<size_t>(m._indptr[ix]);
+    auto end = static_cast<size_t>(m._indptr[ix + 1]);
+    const V *values = nullptr;
+    if constexpr (!std::is_same_v<V, pattern>) {
+      values = m._data.data() + begin;
+    }
+    scatter(values, m._indices.data() + begin, end - begin, _scale,
+            out + i * _ncols);
+  };
+
+  auto row_bytes = _ncols * sizeof(O);
+  StatTimer timer(Stat::slice, size, size * row_bytes);
+
+  // a worker handles its rows a block at a time: each one is zeroed just
+  // before it is written, while it is hot in cache, and phases are timed
+  constexpr size_t block = 256;
+  if (!sorted) {
+    parallel_for(range(0, size), [&](const range &r) {
+      const auto &m = _local();
+      size_t rows[block];
+      for (auto b = r.begin(); b < r.end(); b += block) {
+        auto e = std::min(b + block, r.end());
+        {
+          StatTimer validate(Stat::slice_validate, e - b);
+          for (auto i = b; i != e; ++i) {
+            rows[i - b] = _row(ixs[i]);
+          }
+        }
+        {
+          StatTimer fill(Stat::slice_fill, e - b, (e - b) * row_bytes);
+          std::fill(out + b * _ncols, out + e * _ncols, O{});
+        }
+        StatTimer scatter(Stat::slice_scatter, e - b);
+        for (auto i = b; i != e; ++i) {
+          write_row(m, i, rows[i - b]);
+        }
+      }
+    });
+    return;
+  }
+
+  // visit rows in increasing order, so that arrays are read mostly
+  // sequentially, but write them to their original positions
+  std::vector<std::pair<size_t, size_t>> order(size);
+  parallel_for(range(0, size), [&](const range &r) {
+    StatTimer validate(Stat::slice_validate, r.size());
     for (auto i = r.begin(); i != r.end(); ++i) {
-      auto ixi{ixs[i]};
-      if (ixi < 0) {
-        ixi += _nrows;
+      order[i] = {_row(ixs[i]), i};
+    }
+  });
+  tbb::parallel_sort(order.begin(), order.end());
+
+  parallel_for(range(0, size), [&](const range &r) {
+    const auto &m = _local();
+    for (auto b = r.begin(); b < r.end(); b += block) {
+      auto e = std::min(b + block, r.end());
+      {
+        StatTimer fill(Stat::slice_fill, e - b, (e - b) * row_bytes);
+        for (auto k = b; k != e; ++k) {
+          auto i = order[k].second;
+          std::fill(out + i * _ncols, out + (i + 1) * _ncols, O{});
+        }
       }
-      size_t ix = static_cast<size_t>(ixi);
-      if (ix >= _nrows) {
-        std::ostringstream ss;
-        ss << "Index " << ix << " is out of range (0, " << _nrows << ")";
-        throw std::runtime_error(ss.str());
+      StatTimer scatter(Stat::slice_scatter, e - b);
+      for (auto k = b; k != e; ++k) {
+        write_row(m, order[k].second, order[k].first);
       }
-      auto _i = i * _ncols;
-      for (size_t j = _indptr[ix]; j < _indptr[ix + 1]; ++j) {
-        slice_data[_i + _indices[j]] = _data[j];
+    }
+  });
+}
+
+template <class V, class I, class P>
+void BasicCSR<V, I, P>::slice(const int *ixs, size_t size,
+                              const ColumnProjection &proj, float *out) const {
+  using range = tbb::blocked_range<size_t>;
+
+  if (proj.ncols() != _ncols) {
+    std::ostringstream ss;
+    ss << "Projection of " << proj.ncols()
+       << " columns does not apply to a matrix of " << _ncols << " columns";
+    throw std::runtime_error(ss.str());
+  }
+  auto k = proj.size();
+  const auto *remap = proj.remap();
+  // rows are scattered into a buffer with a sink column for unselected ones
+  auto scatter = scatter_kernel<V, std::uint32_t, float>(k + 1);
+  StatTimer timer(Stat::slice, size, size * k * sizeof(float));
+  parallel_for(range(0, size), [&](const range &r) {
+    const auto &m = _local();
+    constexpr size_t block = 64;
+    std::uint32_t cols[block];
+    std::vector<float> row(k + 1);
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto ix = _row(ixs[i]);
+      std::fill(row.begin(), row.end(), 0.F);
+      auto begin = static_cast<size_t>(m._indptr[ix]);
+      auto end = static_cast<size_t>(m._indptr[ix + 1]);
+      for (auto j = begin; j < end; j += block) {
+        auto len = std::min(block, end - j);
+        for (size_t c = 0; c < len; ++c) {
+          cols[c] = remap[m._indices[j + c]];
+        }
+        const V *values = nullptr;
+        if constexpr (!std::is_same_v<V, pattern>) {
+          values = m._data.data() + j;
+        }
+        scatter(values, cols, len, _scale, row.data());
       }
+      std::copy(row.begin(), row.begin() + static_cast<std::ptrdiff_t>(k),
+                out + i * k);
     }
+  });
+}
+
+template <class V, class I, class P>
+void BasicCSR<V, I, P>::slice_to(const int *ixs, const size_t *to, size_t size,
+                                 float *out) const {
+  using range = tbb::blocked_range<size_t>;
+
+  auto scatter = scatter_kernel<V, I, float>(_ncols);
+  StatTimer timer(Stat::slice, size, size * _ncols * sizeof(float));
+  parallel_for(range(0, size), [&](const range &r) {
+    const auto &m = _local();
+    for (auto k = r.begin(); k != r.end(); ++k) {
+      auto ix = _row(ixs[k]);
+      auto row = out + to[k] * _ncols;
+      std::fill(row, row + _ncols, 0.F);
+      auto begin = static_cast<size_t>(m._indptr[ix]);
+      auto end = static_cast<size_t>(m._indptr[ix + 1]);
+      const V *values = nullptr;
+      if constexpr (!std::is_same_v<V, pattern>) {
+        values = m._data.data() + begin;
+      }
+      scatter(values, m._indices.data() + begin, end - begin, _scale, row);
+    }
+  });
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::slice_nnz(const int *ixs, size_t size) const
+    -> size_t {
+  return tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, size), size_t{0},
+      [&](const tbb::blocked_range<size_t> &r, size_t nnz) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          auto ix = _row(ixs[i]);
+          nnz += _indptr[ix + 1] - _indptr[ix];
+        }
+        return nnz;
+      },
+      std::plus<>());
+}
+
+/**
+ *  Gather rows `ixs` of `m` into `indptr`, `indices` and `data`.
+ *  Row lengths are prefix summed into `indptr` in parallel first, so that
+ *  every row can then be copied to its place independently.
+ */
+template <class M, class OI, class OP, class OV>
+static void gather_rows(const M &m, const int *ixs, size_t size, OP *indptr,
+                        OI *indices, OV *data) {
+  using range = tbb::blocked_range<size_t>;
+
+  indptr[0] = 0;
+  tbb::parallel_scan(
+      range(0, size), OP{0},
+      [&](const range &r, OP sum, bool is_final) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          auto ix = m._row(ixs[i]);
+          sum += static_cast<OP>(m._indptr[ix + 1] - m._indptr[ix]);
+          if (is_final) {
+            indptr[i + 1] = sum;
+          }
+        }
+        return sum;
+      },
+      std::plus<>());
+
+  tbb::parallel_for(range(0, size), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto ix = m._row(ixs[i]);
+      auto begin = m._indptr[ix];
+      auto end = m._indptr[ix + 1];
+      auto pos = static_cast<size_t>(indptr[i]);
+      std::copy(m._indices.begin() + begin, m._indices.begin() + end,
+                indices + pos);
+      if constexpr (std::is_same_v<typename M::value_type, pattern>) {
+        if constexpr (!std::is_same_v<OV, pattern>) {
+          std::fill(data + pos, data + pos + (end - begin), m._scale);
+        }
+      } else {
+        convert_values(m._data.data() + begin, end - begin, data + pos,
+                       m._scale);
+      }
+    }
+  });
+}
+
+template <class V, class I, class P>
+auto BasicCSR<V, I, P>::slice_csr(const int *ixs, size_t size) const
+    -> BasicCSR {
+  auto nnz = slice_nnz(ixs, size);
+  vec_p indptr(size + 1);
+  vec_i indices(nnz);
+  vec_v data(std::is_same_v<V, pattern> ? 0 : nnz);
+  gather_rows(*this, ixs, size, indptr.data(), indices.data(), data.data());
+  // rows of a valid matrix form a valid matrix
+  BasicCSR m(std::move(data), std::move(indices), std::move(indptr), size,
+             _ncols, false);
+  m._scale = _scale;
+  m._validated = _validated;
+  return m;
+}
+
+template <class V, class I, class P>
+void BasicCSR<V, I, P>::slice_csr(const int *ixs, size_t size,
+                                  std::int64_t *indptr, std::int64_t *indices,
+                                  float *data) const {
+  gather_rows(*this, ixs, size, indptr, indices, data);
+}
+
+// Explicit template instantiation
+#define INSTANTIATE_CSR(V, I, P)                                              \
+  template struct BasicCSR<V, I, P>;                                          \
+  template void BasicCSR<V, I, P>::slice(const int *, size_t, float *, bool)  \
+      const;                                                                  \
+  template void BasicCSR<V, I, P>::slice(const int *, size_t, float16 *,      \
+                                         bool) const;                         \
+  template void BasicCSR<V, I, P>::slice(const int *, size_t, bfloat16 *,     \
+                                         bool) const;                         \
+  template auto BasicCSR<V, I, P>::astype(float) const->BasicCSR<float, I, P>;
+
+// layouts having reduced precision variants convert between all of them
+#define INSTANTIATE_REDUCED_CSR(V, I, P)                                      \
+  INSTANTIATE_CSR(V, I, P)                                                    \
+  template auto BasicCSR<V, I, P>::astype(float)                              \
+      const->BasicCSR<float16, I, P>;                                         \
+  template auto BasicCSR<V, I, P>::astype(float)                              \
+      const->BasicCSR<bfloat16, I, P>;                                        \
+  template auto BasicCSR<V, I, P>::astype(float)                              \
+      const->BasicCSR<std::uint8_t, I, P>;                                    \
+  template auto BasicCSR<V, I, P>::astype(float)                              \
+      const->BasicCSR<pattern, I, P>;
+
+INSTANTIATE_REDUCED_CSR(float, std::uint32_t, std::uint32_t)
+INSTANTIATE_REDUCED_CSR(float, std::uint32_t, std::uint64_t)
+INSTANTIATE_CSR(float, std::uint64_t, std::uint64_t)
+INSTANTIATE_REDUCED_CSR(float16, std::uint32_t, std::uint32_t)
+INSTANTIATE_REDUCED_CSR(float16, std::uint32_t, std::uint64_t)
+INSTANTIATE_REDUCED_CSR(bfloat16, std::uint32_t, std::uint32_t)
+INSTANTIATE_REDUCED_CSR(bfloat16, std::uint32_t, std::uint64_t)
+INSTANTIATE_REDUCED_CSR(std::uint8_t, std::uint32_t, std::uint32_t)
+INSTANTIATE_REDUCED_CSR(std::uint8_t, std::uint32_t, std::uint64_t)
+INSTANTIATE_REDUCED_CSR(pattern, std::uint32_t, std::uint32_t)
+INSTANTIATE_REDUCED_CSR(pattern, std::uint32_t, std::uint64_t)
+
+// ----------------------------------------------------------------------------
+// Runtime dispatch
+// ----------------------------------------------------------------------------
+
+template <class M>
+static auto load_as(const std::string &fname, bool mmap, Placement placement,
+                    bool trusted) {
+  return std::shared_ptr<M>(mmap ? M::load_mmap(fname, trusted)
+                                 : M::load(fname, placement, trusted));
+}
+
+/// Load a matrix of `V` values with 32 bit column indices
+template <class V>
+static auto load_values(const std::string &fname, bool mmap, bool large,
+                        Placement placement, bool trusted) -> AnyCSR {
+  if (large) {
+    return load_as<CSRLargeT<V>>(fname, mmap, placement, trusted);
+  }
+  return load_as<CSRT<V>>(fname, mmap, placement, trusted);
+}
+
+auto load_any(const std::string &fname, bool mmap, Placement placement,
+              bool trusted) -> AnyCSR {
+  if (mmap && !placement.is_default()) {
+    throw std::runtime_error("Mapped matrices are views of the page cache, "
+                             "they can not be placed");
+  }
+  CSRFileHeader h{};
+  {
+    std::ifstream is(fname, std::ios::binary);
+    if (!is) {
+      std::ostringstream ss;
+      ss << "Could not load " << fname;
+      throw std::runtime_error(ss.str());
+    }
+    if (!read_csr_header(is, h)) { // version 1 is compact
+      return load_as<CSR>(fname, mmap, placement, trusted);
+    }
+  }
+
+  constexpr auto max32 = std::numeric_limits<std::uint32_t>::max();
+  auto wide = h.ncols > size_t{max32} + 1;
+  auto large = h.sections[CSRFileHeader::INDICES].length > max32;
+  if (mmap) { // views can not be narrowed, use stored layout
+    wide = h.sections[CSRFileHeader::INDICES].dtype == DType::uint64;
+    large = h.sections[CSRFileHeader::INDPTR].dtype == DType::uint64;
+  }
+
+  if (wide) { // copies get float values, views must have stored them
+    return load_as<CSRWide>(fname, mmap, placement, trusted);
+  }
+  switch (h.sections[CSRFileHeader::DATA].dtype) {
+  case DType::float16:
+    return load_values<float16>(fname, mmap, large, placement, trusted);
+  case DType::bfloat16:
+    return load_values<bfloat16>(fname, mmap, large, placement, trusted);
+  case DType::uint8:
+    return load_values<std::uint8_t>(fname, mmap, large, placement, trusted);
+  case DType::pattern:
+    return load_values<pattern>(fname, mmap, large, placement, trusted);
+  default:
+    return load_values<float>(fname, mmap, large, placement, trusted);
+  }
+}
+
+/// View of `size` elements at `ptr` kept alive by `owner`, or a copy
+template <class T>
+static auto borrow(const void *ptr, size_t size,
+                   const std::shared_ptr<const void> &owner, bool copy)
+    -> Buffer<T> {
+  const auto *p = static_cast<const T *>(ptr);
+  if (p == nullptr && size != 0) {
+    throw std::runtime_error("array is not provided");
+  }
+  if (copy) {
+    return std::vector<T>(p, p + size);
+  }
+  return Buffer<T>(p, size, owner);
+}
+
+template <class M>
+static auto from_arrays_as(const CSRArrays &a,
+                           const std::shared_ptr<const void> &owner, bool copy,
+                           bool trusted) -> AnyCSR {
+  using V = typename M::value_type;
+  typename M::buf_v data;
+  if constexpr (!std::is_same_v<V, pattern>) {
+    data = borrow<V>(a.data, a.nnz, owner, copy);
+  }
+  auto m = std::make_shared<M>(
+      std::move(data),
+      borrow<typename M::index_type>(a.indices, a.nnz, owner, copy),
+      borrow<typename M::indptr_type>(a.indptr, a.nrows + 1, owner, copy),
+      a.nrows, a.ncols, !trusted);
+  if constexpr (std::is_same_v<V, std::uint8_t> || std::is_same_v<V, pattern>) {
+    m->_scale = a.scale;
+  }
+  return m;
+}
+
+/// Matrix of `V` values with 32 bit column indices
+template <class V>
+static auto from_arrays_values(const CSRArrays &a,
+                               const std::shared_ptr<const void> &owner,
+                               bool copy, bool trusted) -> AnyCSR {
+  if (a.indptr_dtype == DType::uint64) {
+    return from_arrays_as<CSRLargeT<V>>(a, owner, copy, trusted);
+  }
+  return from_arrays_as<CSRT<V>>(a, owner, copy, trusted);
+}
+
+auto from_arrays(const CSRArrays &arrays, std::shared_ptr<const void> owner,
+                 bool copy, bool trusted) -> AnyCSR {
+  const auto &a = arrays;
+  auto is_index = [](DType t) {
+    return t == DType::uint32 || t == DType::uint64;
   };
+  if (!is_index(a.index_dtype) || !is_index(a.indptr_dtype)) {
+    std::ostringstream ss;
+    ss << "Unsupported index dtypes " << dtype_name(a.index_dtype) << ", "
+       << dtype_name(a.indptr_dtype);
+    throw std::runtime_error(ss.str());
+  }
+  if (a.nrows == 0 || a.ncols == 0) {
+    throw std::runtime_error("shape of the matrix should be provided");
+  }
+
+  if (a.index_dtype == DType::uint64) {
+    if (a.indptr_dtype != DType::uint64 || a.dtype != DType::float32) {
+      throw std::runtime_error("64 bit column indices need 64 bit index "
+                               "pointers and float32 values");
+    }
+    return from_arrays_as<CSRWide>(a, owner, copy, trusted);
+  }
+  switch (a.dtype) {
+  case DType::float32:
+    return from_arrays_values<float>(a, owner, copy, trusted);
+  case DType::float16:
+    return from_arrays_values<float16>(a, owner, copy, trusted);
+  case DType::bfloat16:
+    return from_arrays_values<bfloat16>(a, owner, copy, trusted);
+  case DType::uint8:
+    return from_arrays_values<std::uint8_t>(a, owner, copy, trusted);
+  case DType::pattern:
+    return from_arrays_values<pattern>(a, owner, copy, trusted);
+  default:
+    break;
+  }
+  std::ostringstream ss;
+  ss << "Unsupported value dtype " << dtype_name(a.dtype);
+  throw std::runtime_error(ss.str());
+}
 
-  parallel_for(tbb::blocked_range<size_t>(0, size), worker);
+template <class V2, class M>
+static auto astype_any(const M &m, float scale) -> AnyCSR {
+  using I = typename M::index_type;
+  if constexpr (!std::is_same_v<V2, float> && sizeof(I) == 8) {
+    throw std::runtime_error("Reduced precision values need 32 bit column "
+                             "indices");
+  } else {
+    using P = typename M::indptr_type;
+    return std::make_shared<BasicCSR<V2, I, P>>(
+        m.template astype<V2>(scale));
+  }
+}
 
-  return slice_data.data();
+auto astype(const AnyCSR &m, DType dtype, float scale) -> AnyCSR {
+  return std::visit(
+      [dtype, scale](const auto &pm) -> AnyCSR {
+        switch (dtype) {
+        case DType::float32:
+          return astype_any<float>(*pm, scale);
+        case DType::float16:
+          return astype_any<float16>(*pm, scale);
+        case DType::bfloat16:
+          return astype_any<bfloat16>(*pm, scale);
+        case DType::uint8:
+          return astype_any<std::uint8_t>(*pm, scale);
+        case DType::pattern:
+          return astype_any<pattern>(*pm, scale);
+        default:
+          break;
+        }
+        std::ostringstream ss;
+        ss << "Unsupported value dtype " << dtype_name(dtype);
+        throw std::runtime_error(ss.str());
+      },
+      m);
 }
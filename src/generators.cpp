@@ -0,0 +1,484 @@
+#define TBB_SUPPRESS_DEPRECATED_MESSAGES 1
+
+#include "generators.hpp"
+#include "csr_matrix.hpp"
+#include "rng.hpp"
+#include "tbb/tbb.h"
+#include "tools.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using edge_type = EdgeItem<std::uint32_t>;
+
+// ----------------------------------------------------------------------------
+// Generators of blocks
+// ----------------------------------------------------------------------------
+
+/// Non-zeros of each element with the same probability. Positions within a
+/// block of rows are drawn by geometric skips over its elements, values from
+/// a stream of their own, so that counting does not draw them.
+class UniformGenerator {
+  std::size_t _nrows;
+  std::size_t _ncols;
+  double _density;
+  std::uint64_t _seed;
+  std::size_t _block_rows;
+  /// log of the probability of a zero
+  double _log_q;
+
+public:
+  UniformGenerator(std::size_t nrows, std::size_t ncols, double density,
+                   std::uint64_t seed)
+      : _nrows(nrows), _ncols(ncols), _density(density), _seed(seed),
+        _block_rows(std::max<std::size_t>(1, (std::size_t{1} << 20U) /
+                                                 std::max<std::size_t>(ncols,
+                                                                       1))),
+        _log_q(std::log1p(-density)) {
+    if (!(density >= 0 && density <= 1)) {
+      std::ostringstream ss;
+      ss << "Density " << density << " is not in [0, 1]";
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  auto nblocks() const -> std::size_t {
+    return (_nrows + _block_rows - 1) / _block_rows;
+  }
+
+  auto rows(std::size_t b) const -> std::pair<std::size_t, std::size_t> {
+    return {b * _block_rows, std::min(_nrows, (b + 1) * _block_rows)};
+  }
+
+  template <class F> void positions(std::size_t b, F &&f) const {
+    auto [first, last] = rows(b);
+    std::uint64_t cells = (last - first) * _ncols;
+    if (_density >= 1) {
+      for (std::uint64_t pos = 0; pos < cells; ++pos) {
+        f(first + pos / _ncols, pos % _ncols);
+      }
+      return;
+    }
+    if (_density <= 0) {
+      return;
+    }
+    auto rng = random_stream(_seed, 2 * b);
+    for (std::uint64_t pos = 0;; ++pos) {
+      // zeros before the next non-zero, 1 - u is in (0, 1]
+      auto gap = std::floor(std::log(1. - rng.uniform()) / _log_q);
+      if (gap >= static_cast<double>(cells - pos)) {
+        break;
+      }
+      pos += static_cast<std::uint64_t>(gap);
+      f(first + pos / _ncols, pos % _ncols);
+    }
+  }
+
+  auto count(std::size_t b) const -> std::size_t {
+    std::size_t n = 0;
+    positions(b, [&n](std::size_t, std::size_t) { ++n; });
+    return n;
+  }
+
+  template <class F> void each(std::size_t b, F &&emit) const {
+    auto values = random_stream(_seed, 2 * b + 1);
+    positions(b, [&](std::size_t row, std::size_t col) {
+      emit(row, col, values.uniform());
+    });
+  }
+};
+
+/// Distinct sorted columns of a row, chosen uniformly
+static void sample_columns(std::size_t d, std::size_t ncols, SplitMix64 &rng,
+                           std::vector<std::size_t> &cols) {
+  cols.clear();
+  if (d * 2 > ncols) {
+    // selection sampling (Knuth's algorithm S) of dense rows
+    for (std::size_t j = 0; j < ncols && cols.size() < d; ++j) {
+      if (static_cast<double>(ncols - j) * rng.uniform() <
+          static_cast<double>(d - cols.size())) {
+        cols.push_back(j);
+      }
+    }
+    return;
+  }
+  // draws repeat rarely in sparse rows, so redraw the missing ones
+  while (cols.size() < d) {
+    for (auto k = cols.size(); k < d; ++k) {
+      cols.push_back(rng.below(ncols));
+    }
+    std::sort(cols.begin(), cols.end());
+    cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+  }
+}
+
+/// Power-law degrees of rows. Every row has a stream for its degree and one
+/// for its columns and values, so that counting draws only degrees.
+class PowerLawGenerator {
+  static constexpr std::size_t BLOCK_ROWS = std::size_t{1} << 10U;
+
+  std::size_t _nrows;
+  std::size_t _ncols;
+  double _min_degree;
+  std::size_t _max_degree;
+  double _power;
+  std::uint64_t _seed;
+
+public:
+  PowerLawGenerator(std::size_t nrows, std::size_t ncols,
+                    const PowerLawParams &params, std::uint64_t seed)
+      : _nrows(nrows), _ncols(ncols),
+        _min_degree(static_cast<double>(params.min_degree)),
+        _max_degree(params.max_degree == 0
+                        ? ncols
+                        : std::min(params.max_degree, ncols)),
+        _power(-1. / (params.exponent - 1.)), _seed(seed) {
+    if (!(params.exponent > 1)) {
+      std::ostringstream ss;
+      ss << "Power law exponent " << params.exponent
+         << " should be greater than one";
+      throw std::runtime_error(ss.str());
+    }
+    if (params.min_degree == 0 || params.min_degree > _max_degree) {
+      std::ostringstream ss;
+      ss << "Minimum degree " << params.min_degree << " is not in [1, "
+         << _max_degree << "]";
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  auto nblocks() const -> std::size_t {
+    return (_nrows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+  }
+
+  auto rows(std::size_t b) const -> std::pair<std::size_t, std::size_t> {
+    return {b * BLOCK_ROWS, std::min(_nrows, (b + 1) * BLOCK_ROWS)};
+  }
+
+  /// Inverse transform sampling of a Pareto distribution, truncated to
+  /// the maximum degree
+  auto degree(std::size_t row) const -> std::size_t {
+    auto rng = random_stream(_seed, 2 * static_cast<std::uint64_t>(row));
+    auto d = _min_degree * std::pow(1. - rng.uniform(), _power);
+    return d >= static_cast<double>(_max_degree) ? _max_degree
+                                                 : static_cast<std::size_t>(d);
+  }
+
+  auto count(std::size_t b) const -> std::size_t {
+    auto [first, last] = rows(b);
+    std::size_t n = 0;
+    for (auto row = first; row < last; ++row) {
+      n += degree(row);
+    }
+    return n;
+  }
+
+  template <class F> void each(std::size_t b, F &&emit) const {
+    auto [first, last] = rows(b);
+    std::vector<std::size_t> cols;
+    for (auto row = first; row < last; ++row) {
+      auto rng = random_stream(_seed, 2 * static_cast<std::uint64_t>(row) + 1);
+      sample_columns(degree(row), _ncols, rng, cols);
+      for (auto col : cols) {
+        emit(row, col, rng.uniform());
+      }
+    }
+  }
+};
+
+/// Edges of an R-MAT graph in blocks of a fixed number of edges
+class RMatGenerator {
+  RMatParams _params;
+  std::uint64_t _seed;
+  /// cumulative quadrant probabilities scaled to 32 bits
+  std::uint64_t _a;
+  std::uint64_t _ab;
+  std::uint64_t _abc;
+  std::uint64_t _mask;
+  std::uint64_t _mul1;
+  std::uint64_t _mul2;
+
+  static auto threshold(double p) -> std::uint64_t {
+    return static_cast<std::uint64_t>(std::ldexp(std::min(p, 1.), 32));
+  }
+
+  /// Bijection of node ids: odd multipliers and xorshifts are invertible
+  /// modulo 2^scale
+  auto scramble(std::uint64_t x) const -> std::uint64_t {
+    auto shift = _params.scale / 2 + 1;
+    x = (x * _mul1) & _mask;
+    x ^= x >> shift;
+    x = (x * _mul2) & _mask;
+    return x ^ (x >> shift);
+  }
+
+public:
+  static constexpr std::size_t BLOCK = std::size_t{1} << 16U;
+
+  RMatGenerator(const RMatParams &params, std::uint64_t seed)
+      : _params(params), _seed(seed), _a(threshold(params.a)),
+        _ab(threshold(params.a + params.b)),
+        _abc(threshold(params.a + params.b + params.c)),
+        _mask((std::uint64_t{1} << params.scale) - 1),
+        _mul1(SplitMix64::mix(seed ^ 0xA5A5A5A5A5A5A5A5ULL) | 1U),
+        _mul2(SplitMix64::mix(seed ^ 0x5A5A5A5A5A5A5A5AULL) | 1U) {
+    if (params.scale > 32) {
+      std::ostringstream ss;
+      ss << "R-MAT scale " << params.scale << " is greater than 32";
+      throw std::runtime_error(ss.str());
+    }
+    if (!(params.a >= 0 && params.b >= 0 && params.c >= 0 &&
+          params.a + params.b + params.c <= 1)) {
+      throw std::runtime_error(
+          "R-MAT probabilities should be non-negative and sum up to at most 1");
+    }
+  }
+
+  auto nnodes() const -> std::uint64_t {
+    return std::uint64_t{1} << _params.scale;
+  }
+
+  auto nblocks() const -> std::size_t {
+    return (_params.nedges + BLOCK - 1) / BLOCK;
+  }
+
+  template <class F> void each(std::size_t b, F &&emit) const {
+    auto rng = random_stream(_seed, b);
+    auto last = std::min<std::uint64_t>(_params.nedges, (b + 1) * BLOCK);
+    for (auto i = b * BLOCK; i < last; ++i) {
+      std::uint64_t src = 0;
+      std::uint64_t dst = 0;
+      std::uint64_t r = 0;
+      for (unsigned level = 0; level < _params.scale; ++level) {
+        // a 64 bit draw chooses quadrants of two levels
+        std::uint64_t u = 0;
+        if (level % 2 == 0) {
+          r = rng.next();
+          u = r & 0xFFFFFFFFU;
+        } else {
+          u = r >> 32U;
+        }
+        src <<= 1U;
+        dst <<= 1U;
+        if (u >= _abc) {
+          src |= 1U;
+          dst |= 1U;
+        } else if (u >= _ab) {
+          src |= 1U;
+        } else if (u >= _a) {
+          dst |= 1U;
+        }
+      }
+      if (_params.scramble && _params.scale > 0) {
+        src = scramble(src);
+        dst = scramble(dst);
+      }
+      emit(src, dst, 1.);
+    }
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Matrices and edge streams
+// ----------------------------------------------------------------------------
+
+template <class I, class P>
+static void check_fits(std::size_t ncols, std::uint64_t nnz) {
+  if (ncols > 0 && ncols - 1 > std::numeric_limits<I>::max()) {
+    std::ostringstream ss;
+    ss << ncols << " columns do not fit into " << sizeof(I)
+       << " byte indices";
+    throw std::runtime_error(ss.str());
+  }
+  if (nnz > std::numeric_limits<P>::max()) {
+    std::ostringstream ss;
+    ss << nnz << " non-zeros do not fit into a " << sizeof(P)
+       << " byte index pointer, use a larger matrix type";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+/// Counts non-zeros of blocks and then fills blocks in place at their
+/// offsets, both in parallel
+template <class M, class Gen>
+static auto build_rows(const Gen &gen, std::size_t nrows, std::size_t ncols)
+    -> M {
+  using V = typename M::value_type;
+  using I = typename M::index_type;
+  using P = typename M::indptr_type;
+
+  auto nblocks = gen.nblocks();
+  std::vector<std::size_t> offsets(nblocks + 1, 0);
+  tbb::parallel_for(std::size_t{0}, nblocks,
+                    [&](std::size_t b) { offsets[b + 1] = gen.count(b); });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  auto nnz = offsets.back();
+  check_fits<I, P>(ncols, nnz);
+
+  typename M::vec_v data(std::is_same_v<V, pattern> ? 0 : nnz);
+  typename M::vec_i indices(nnz);
+  typename M::vec_p indptr(nrows + 1);
+  tbb::parallel_for(std::size_t{0}, nblocks, [&](std::size_t b) {
+    auto pos = offsets[b];
+    auto [next, last] = gen.rows(b);
+    gen.each(b, [&](std::size_t row, std::size_t col, double value) {
+      for (; next <= row; ++next) {
+        indptr[next] = static_cast<P>(pos);
+      }
+      indices[pos] = static_cast<I>(col);
+      if constexpr (!std::is_same_v<V, pattern>) {
+        data[pos] = static_cast<V>(value);
+      }
+      ++pos;
+    });
+    for (; next < last; ++next) {
+      indptr[next] = static_cast<P>(pos);
+    }
+  });
+  indptr[nrows] = static_cast<P>(nnz);
+  return M(std::move(data), std::move(indices), std::move(indptr), nrows,
+           ncols, false);
+}
+
+static void check_edge_ids(std::uint64_t nrows, std::uint64_t ncols) {
+  constexpr auto limit = std::uint64_t{1} << 32U;
+  if (nrows > limit || ncols > limit) {
+    std::ostringstream ss;
+    ss << "Node ids of a " << nrows << "x" << ncols
+       << " matrix do not fit into 4 byte edges";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+/// Generates rounds of blocks in parallel and writes each round in order
+template <class Gen>
+static auto write_edges(std::ostream &os, const Gen &gen) -> std::uint64_t {
+  auto nblocks = gen.nblocks();
+  auto round = static_cast<std::size_t>(
+      4 * std::max(1, tbb::this_task_arena::max_concurrency()));
+  std::vector<std::vector<edge_type>> edges(std::min(round, nblocks));
+
+  std::uint64_t total = 0;
+  for (std::size_t first = 0; first < nblocks; first += round) {
+    auto last = std::min(nblocks, first + round);
+    tbb::parallel_for(first, last, [&](std::size_t b) {
+      auto &out = edges[b - first];
+      out.clear();
+      gen.each(b, [&out](std::uint64_t src, std::uint64_t dst, double) {
+        out.emplace_back(static_cast<std::uint32_t>(src),
+                         static_cast<std::uint32_t>(dst));
+      });
+    });
+    for (auto b = first; b < last; ++b) {
+      const auto &out = edges[b - first];
+      if (!edge_type::encode_block(os, out.data(), out.size())) {
+        throw std::runtime_error("Could not write edges");
+      }
+      total += out.size();
+    }
+  }
+  return total;
+}
+
+template <class M>
+auto uniform_csr(std::size_t nrows, std::size_t ncols, double density,
+                 std::uint64_t seed) -> M {
+  return build_rows<M>(UniformGenerator(nrows, ncols, density, seed), nrows,
+                       ncols);
+}
+
+template <class M>
+auto power_law_csr(std::size_t nrows, std::size_t ncols,
+                   const PowerLawParams &params, std::uint64_t seed) -> M {
+  return build_rows<M>(PowerLawGenerator(nrows, ncols, params, seed), nrows,
+                       ncols);
+}
+
+template <class M>
+auto rmat_csr(const RMatParams &params, std::uint64_t seed, bool dedup) -> M {
+  using V = typename M::value_type;
+  using I = typename M::index_type;
+  using P = typename M::indptr_type;
+  using range = tbb::blocked_range<std::size_t>;
+
+  RMatGenerator gen(params, seed);
+  // an edge is a key of source and target ids, which are at most 32 bits
+  std::vector<std::uint64_t> keys(params.nedges);
+  tbb::parallel_for(std::size_t{0}, gen.nblocks(), [&](std::size_t b) {
+    auto i = b * RMatGenerator::BLOCK;
+    gen.each(b, [&](std::uint64_t src, std::uint64_t dst, double) {
+      keys[i++] = (src << 32U) | dst;
+    });
+  });
+  tbb::parallel_sort(keys.begin(), keys.end());
+  if (dedup) {
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+
+  auto nnodes = gen.nnodes();
+  auto nnz = keys.size();
+  check_fits<I, P>(nnodes, nnz);
+
+  typename M::vec_v data;
+  if constexpr (!std::is_same_v<V, pattern>) {
+    data.assign(nnz, V(1));
+  }
+  typename M::vec_i indices(nnz);
+  typename M::vec_p indptr(nnodes + 1);
+  tbb::parallel_for(range(0, nnz), [&](const range &r) {
+    for (auto i = r.begin(); i < r.end(); ++i) {
+      indices[i] = static_cast<I>(keys[i] & 0xFFFFFFFFU);
+      // the first edge of a row starts it and rows skipped before it
+      auto row = keys[i] >> 32U;
+      auto prev = i == 0 ? 0 : (keys[i - 1] >> 32U) + 1;
+      for (auto k = prev; k <= row; ++k) {
+        indptr[k] = static_cast<P>(i);
+      }
+    }
+  });
+  auto tail = nnz == 0 ? 0 : (keys.back() >> 32U) + 1;
+  std::fill(indptr.begin() + static_cast<std::ptrdiff_t>(tail), indptr.end(),
+            static_cast<P>(nnz));
+  return M(std::move(data), std::move(indices), std::move(indptr), nnodes,
+           nnodes, false);
+}
+
+auto write_uniform_edges(std::ostream &os, std::size_t nrows,
+                         std::size_t ncols, double density,
+                         std::uint64_t seed) -> std::uint64_t {
+  check_edge_ids(nrows, ncols);
+  return write_edges(os, UniformGenerator(nrows, ncols, density, seed));
+}
+
+auto write_power_law_edges(std::ostream &os, std::size_t nrows,
+                           std::size_t ncols, const PowerLawParams &params,
+                           std::uint64_t seed) -> std::uint64_t {
+  check_edge_ids(nrows, ncols);
+  return write_edges(os, PowerLawGenerator(nrows, ncols, params, seed));
+}
+
+auto write_rmat_edges(std::ostream &os, const RMatParams &params,
+                      std::uint64_t seed) -> std::uint64_t {
+  return write_edges(os, RMatGenerator(params, seed));
+}
+
+// Explicit template instantiation
+#define INSTANTIATE_GENERATORS(M)                                              \
+  template auto uniform_csr<M>(std::size_t, std::size_t, double,               \
+                              std::uint64_t) -> M;                             \
+  template auto power_law_csr<M>(std::size_t, std::size_t,                     \
+                                 const PowerLawParams &, std::uint64_t) -> M;  \
+  template auto rmat_csr<M>(const RMatParams &, std::uint64_t, bool) -> M;
+
+INSTANTIATE_GENERATORS(CSR)
+INSTANTIATE_GENERATORS(CSRLarge)
+INSTANTIATE_GENERATORS(CSRWide)
+INSTANTIATE_GENERATORS(CSRT<pattern>)
+INSTANTIATE_GENERATORS(CSRLargeT<pattern>)
@@ -0,0 +1,250 @@
+#include "half.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// Scalar conversions
+// ----------------------------------------------------------------------------
+
+static auto float_bits(float value) -> std::uint32_t {
+  std::uint32_t x = 0;
+  std::memcpy(&x, &value, sizeof(x));
+  return x;
+}
+
+static auto bits_float(std::uint32_t x) -> float {
+  float value = 0;
+  std::memcpy(&value, &x, sizeof(x));
+  return value;
+}
+
+/// `x >> shift` rounded to nearest even
+static auto shift_round(std::uint32_t x, unsigned shift) -> std::uint32_t {
+  auto q = x >> shift;
+  auto rem = x & ((1U << shift) - 1);
+  auto half = 1U << (shift - 1);
+  return rem > half || (rem == half && (q & 1U) != 0) ? q + 1 : q;
+}
+
+auto float_to_half(float value) -> std::uint16_t {
+  auto x = float_bits(value);
+  auto sign = (x >> 16U) & 0x8000U;
+  auto absx = x & 0x7fffffffU;
+
+  if (absx >= 0x7f800000U) { // inf or nan, keeping nan a nan
+    auto nan = absx > 0x7f800000U ? 0x200U | ((absx >> 13U) & 0x3ffU) : 0U;
+    return static_cast<std::uint16_t>(sign | 0x7c00U | nan);
+  }
+  if (absx >= 0x477ff000U) { // rounds past 65504
+    return static_cast<std::uint16_t>(sign | 0x7c00U);
+  }
+  if (absx < 0x38800000U) { // below 2^-14, a subnormal half
+    auto e = absx >> 23U;
+    if (e < 102) { // below 2^-25, rounds to zero
+      return static_cast<std::uint16_t>(sign);
+    }
+    auto mant = (absx & 0x7fffffU) | 0x800000U;
+    return static_cast<std::uint16_t>(sign | shift_round(mant, 126 - e));
+  }
+  // rebias exponent from 127 to 15, a mantissa carry bumps the exponent
+  return static_cast<std::uint16_t>(sign |
+                                    shift_round(absx - 0x38000000U, 13));
+}
+
+auto half_to_float(std::uint16_t bits) -> float {
+  auto sign = static_cast<std::uint32_t>(bits & 0x8000U) << 16U;
+  auto e = (bits >> 10U) & 0x1fU;
+  auto m = static_cast<std::uint32_t>(bits & 0x3ffU);
+
+  if (e == 0) { // zero or subnormal, m * 2^-24
+    auto value = static_cast<float>(m) * 5.9604645e-8F;
+    return sign != 0 ? -value : value;
+  }
+  if (e == 0x1f) {
+    return bits_float(sign | 0x7f800000U | (m << 13U));
+  }
+  return bits_float(sign | ((e + 112) << 23U) | (m << 13U));
+}
+
+auto float_to_bfloat(float value) -> std::uint16_t {
+  auto x = float_bits(value);
+  if ((x & 0x7fffffffU) > 0x7f800000U) { // quiet nan
+    return static_cast<std::uint16_t>((x >> 16U) | 0x40U);
+  }
+  return static_cast<std::uint16_t>((x + 0x7fffU + ((x >> 16U) & 1U)) >> 16U);
+}
+
+auto bfloat_to_float(std::uint16_t bits) -> float {
+  return bits_float(static_cast<std::uint32_t>(bits) << 16U);
+}
+
+static auto quantize(float value, float scale) -> std::uint8_t {
+  auto q = std::nearbyint(value / scale);
+  return q > 0.F ? static_cast<std::uint8_t>(std::min(q, 255.F)) : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Vectorized conversions, each handles a multiple of 8 or 16 values and
+// returns how many it has converted
+// ----------------------------------------------------------------------------
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2,f16c"))) static auto
+half_avx2(const float *in, std::size_t n, float16 *out) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_loadu_ps(in + i);
+    auto h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), h);
+  }
+  return i;
+}
+
+__attribute__((target("avx2,f16c"))) static auto
+half_avx2(const float16 *in, std::size_t n, float *out) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+  }
+  return i;
+}
+
+/// Rounds 8 floats to bfloat16 bits in the low halves of 32 bit lanes
+__attribute__((target("avx2"))) static auto bfloat_lanes(__m256 v)
+    -> __m256i {
+  auto x = _mm256_castps_si256(v);
+  auto hi = _mm256_srli_epi32(x, 16);
+  auto odd = _mm256_and_si256(hi, _mm256_set1_epi32(1));
+  auto bias = _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff));
+  auto rounded = _mm256_srli_epi32(_mm256_add_epi32(x, bias), 16);
+  auto nan = _mm256_or_si256(hi, _mm256_set1_epi32(0x40));
+  auto is_nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+  return _mm256_blendv_epi8(rounded, nan, is_nan);
+}
+
+__attribute__((target("avx2"))) static auto
+half_avx2(const float *in, std::size_t n, bfloat16 *out) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto lo = bfloat_lanes(_mm256_loadu_ps(in + i));
+    auto hi = bfloat_lanes(_mm256_loadu_ps(in + i + 8));
+    // packing works within 128 bit halves, restore the order of quadwords
+    auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto
+half_avx2(const bfloat16 *in, std::size_t n, float *out) -> std::size_t {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    auto x = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+    _mm256_storeu_ps(out + i, _mm256_castsi256_ps(x));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static auto
+scaled_avx2(const std::uint8_t *in, std::size_t n, float *out, float scale)
+    -> std::size_t {
+  auto s = _mm256_set1_ps(scale);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto q = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i));
+    auto v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(v, s));
+  }
+  return i;
+}
+#endif
+
+/// Number of leading values converted by a vectorized kernel, if any
+template <class F, class T>
+static auto convert_simd(const F *in, std::size_t n, T *out, float scale)
+    -> std::size_t {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (simd_level() >= SimdLevel::avx2) {
+    if constexpr (std::is_same_v<F, std::uint8_t>) {
+      return scaled_avx2(in, n, out, scale);
+    } else if constexpr (!std::is_same_v<T, std::uint8_t>) {
+      return half_avx2(in, n, out);
+    }
+  }
+#endif
+  (void)in, (void)n, (void)out, (void)scale;
+  return 0;
+}
+
+template <class T> static auto scalar_to_float(T value, float scale) -> float {
+  if constexpr (std::is_same_v<T, std::uint8_t>) {
+    return static_cast<float>(value) * scale;
+  } else {
+    return static_cast<float>(value);
+  }
+}
+
+template <class T>
+static auto scalar_from_float(float value, float scale) -> T {
+  if constexpr (std::is_same_v<T, std::uint8_t>) {
+    return quantize(value, scale);
+  } else {
+    return T(value);
+  }
+}
+
+template <class F, class T>
+void convert_values(const F *in, std::size_t n, T *out, float scale) {
+  if constexpr (std::is_same_v<F, T>) {
+    std::copy(in, in + n, out);
+  } else if constexpr (std::is_same_v<F, float> || std::is_same_v<T, float>) {
+    auto i = convert_simd(in, n, out, scale);
+    for (; i < n; ++i) {
+      out[i] = scalar_from_float<T>(scalar_to_float(in[i], scale), scale);
+    }
+  } else { // through floats, a block at a time
+    constexpr std::size_t block = 256;
+    float buf[block];
+    for (std::size_t i = 0; i < n; i += block) {
+      auto len = std::min(block, n - i);
+      convert_values(in + i, len, buf, scale);
+      convert_values(buf, len, out + i, scale);
+    }
+  }
+}
+
+// Explicit template instantiation
+template void convert_values(const float *, std::size_t, float *, float);
+template void convert_values(const float *, std::size_t, float16 *, float);
+template void convert_values(const float *, std::size_t, bfloat16 *, float);
+template void convert_values(const float *, std::size_t, std::uint8_t *,
+                             float);
+template void convert_values(const float16 *, std::size_t, float *, float);
+template void convert_values(const float16 *, std::size_t, float16 *, float);
+template void convert_values(const float16 *, std::size_t, bfloat16 *, float);
+template void convert_values(const float16 *, std::size_t, std::uint8_t *,
+                             float);
+template void convert_values(const bfloat16 *, std::size_t, float *, float);
+template void convert_values(const bfloat16 *, std::size_t, float16 *, float);
+template void convert_values(const bfloat16 *, std::size_t, bfloat16 *,
+                             float);
+template void convert_values(const bfloat16 *, std::size_t, std::uint8_t *,
+                             float);
+template void convert_values(const std::uint8_t *, std::size_t, float *,
+                             float);
+template void convert_values(const std::uint8_t *, std::size_t, float16 *,
+                             float);
+template void convert_values(const std::uint8_t *, std::size_t, bfloat16 *,
+                             float);
+template void convert_values(const std::uint8_t *, std::size_t,
+                             std::uint8_t *, float);
@@ -0,0 +1,511 @@
+#include "label_counts.hpp"
+#include "csr_matrix.hpp"
+#include "tbb/tbb.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+/// Sparse accumulator of label counts of one row
+struct Accumulator {
+  std::vector<float> values;
+  std::vector<char> seen;
+  /// labels with a count in the current row
+  std::vector<std::size_t> touched;
+
+  explicit Accumulator(std::size_t nlabels)
+      : values(nlabels, 0.F), seen(nlabels, 0) {}
+
+  void add(std::size_t label, float value) {
+    if (seen[label] == 0) {
+      seen[label] = 1;
+      touched.push_back(label);
+    }
+    values[label] += value;
+  }
+
+  /// Clears counts of the current row only
+  void reset() {
+    for (auto label : touched) {
+      values[label] = 0.F;
+      seen[label] = 0;
+    }
+    touched.clear();
+  }
+};
+} // namespace
+
+template <class A, class L>
+static void check_shapes(const A &adj, const L &labels) {
+  if (adj._ncols != labels._nrows) {
+    std::ostringstream ss;
+    ss << "Adjacency matrix has " << adj._ncols << " columns, but labels have "
+       << labels._nrows << " rows";
+    throw std::runtime_error(ss.str());
+  }
+}
+
+/// Calls `f(label, count)` for every label of every neighbor of `node`
+template <class A, class L, class F>
+static void for_each_label(const A &adj, const L &labels, std::size_t node,
+                           F &&f) {
+  for (auto k = adj._indptr[node]; k < adj._indptr[node + 1]; ++k) {
+    auto neighbor = adj._indices[k];
+    auto weight = adj.value(k);
+    for (auto t = labels._indptr[neighbor]; t < labels._indptr[neighbor + 1];
+         ++t) {
+      f(static_cast<std::size_t>(labels._indices[t]),
+        weight * labels.value(t));
+    }
+  }
+}
+
+using accumulators = tbb::enumerable_thread_specific<Accumulator>;
+
+/// Numeric pass: writes rows into a matrix of layout `M`, whose index
+/// pointer has been counted by the symbolic pass
+template <class M, class A, class L, class R>
+static auto fill_rows(const A &adj, const L &labels, std::size_t n, R row_of,
+                      const std::vector<std::uint64_t> &offsets,
+                      accumulators &accs) -> AnyCSR {
+  using range = tbb::blocked_range<std::size_t>;
+
+  auto nnz = static_cast<std::size_t>(offsets[n]);
+  typename M::vec_p indptr(offsets.begin(), offsets.end());
+  typename M::vec_i indices(nnz);
+  typename M::vec_v data(nnz);
+
+  tbb::parallel_for(range(0, n), [&](const range &r) {
+    auto &acc = accs.local();
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      for_each_label(adj, labels, row_of(i),
+                     [&acc](std::size_t label, float v) { acc.add(label, v); });
+      std::sort(acc.touched.begin(), acc.touched.end());
+      auto pos = static_cast<std::size_t>(offsets[i]);
+      for (auto label : acc.touched) {
+        indices[pos] = static_cast<typename M::index_type>(label);
+        data[pos] = acc.values[label];
+        pos++;
+      }
+      acc.reset();
+    }
+  });
+
+  // rows are built sorted and within the shape
+  return std::make_shared<M>(std::move(data), std::move(indices),
+                             std::move(indptr), n, labels._ncols, false);
+}
+
+/// Label counts of nodes `row_of(0), ..., row_of(n - 1)`
+template <class A, class L, class R>
+static auto count_rows(const A &adj, const L &labels, std::size_t n, R row_of)
+    -> AnyCSR {
+  using range = tbb::blocked_range<std::size_t>;
+  check_shapes(adj, labels);
+
+  auto nlabels = labels._ncols;
+  accumulators accs([nlabels] { return Accumulator(nlabels); });
+
+  // symbolic pass: number of distinct labels of each row
+  std::vector<std::uint64_t> offsets(n + 1, 0);
+  tbb::parallel_for(range(0, n), [&](const range &r) {
+    auto &acc = accs.local();
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      for_each_label(adj, labels, row_of(i),
+                     [&acc](std::size_t label, float v) { acc.add(label, v); });
+      offsets[i + 1] = acc.touched.size();
+      acc.reset();
+    }
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  constexpr auto max32 = std::numeric_limits<std::uint32_t>::max();
+  if (nlabels > std::size_t{max32} + 1) {
+    return fill_rows<CSRWide>(adj, labels, n, row_of, offsets, accs);
+  }
+  if (offsets[n] > max32) {
+    return fill_rows<CSRLarge>(adj, labels, n, row_of, offsets, accs);
+  }
+  return fill_rows<CSR>(adj, labels, n, row_of, offsets, accs);
+}
+
+auto label_counts(const AnyCSR &adj, const AnyCSR &labels) -> AnyCSR {
+  return std::visit(
+      [](const auto &a, const auto &l) {
+        return count_rows(*a, *l, a->_nrows, [](std::size_t i) { return i; });
+      },
+      adj, labels);
+}
+
+auto label_counts(const AnyCSR &adj, const AnyCSR &labels, const int *ixs,
+                  std::size_t size) -> AnyCSR {
+  return std::visit(
+      [ixs, size](const auto &a, const auto &l) {
+        const auto &m = *a;
+        return count_rows(m, *l, size,
+                          [&m, ixs](std::size_t i) { return m._row(ixs[i]); });
+      },
+      adj, labels);
+}
+
+void label_counts(const AnyCSR &adj, const AnyCSR &labels, const int *ixs,
+                  std::size_t size, float *out) {
+  using range = tbb::blocked_range<std::size_t>;
+
+  std::visit(
+      [ixs, size, out](const auto &a, const auto &l) {
+        check_shapes(*a, *l);
+        auto nlabels = l->_ncols;
+        tbb::parallel_for(range(0, size), [&](const range &r) {
+          // each worker zeroes only its own rows, while they are hot in cache
+          std::fill(out + r.begin() * nlabels, out + r.end() * nlabels, 0.F);
+          for (auto i = r.begin(); i != r.end(); ++i) {
+            auto row = out + i * nlabels;
+            for_each_label(
+                *a, *l, a->_row(ixs[i]),
+                [row](std::size_t label, float v) { row[label] += v; });
+          }
+        });
+      },
+      adj, labels);
+}
+
+// ----------------------------------------------------------------------------
+// LabelCounter
+// ----------------------------------------------------------------------------
+
+LabelCounter::LabelCounter(const AnyCSR &adj, const AnyCSR &labels) {
+  using range = tbb::blocked_range<std::size_t>;
+  constexpr auto max32 = std::numeric_limits<std::uint32_t>::max();
+
+  auto counts = label_counts(adj, labels); // checks shapes as well
+
+  std::visit(
+      [this](const auto &pa) {
+        const auto &a = *pa;
+        if (a._nrows > std::size_t{max32} + 1) {
+          throw std::runtime_error("too many nodes to count labels of");
+        }
+        _nnodes = a._nrows;
+
+        // counting sort of edges by neighbor
+        _in_ptr.assign(a._ncols + 1, 0);
+        for (auto j : a._indices) {
+          _in_ptr[j + 1]++;
+        }
+        std::partial_sum(_in_ptr.begin(), _in_ptr.end(), _in_ptr.begin());
+        _in_nodes.resize(a.nnz());
+        _in_weights.resize(a.nnz());
+        std::vector<std::uint64_t> pos(_in_ptr.begin(), _in_ptr.end() - 1);
+        for (std::size_t i = 0; i < a._nrows; ++i) {
+          for (auto k = a._indptr[i]; k < a._indptr[i + 1]; ++k) {
+            auto p = pos[a._indices[k]]++;
+            _in_nodes[p] = static_cast<std::uint32_t>(i);
+            _in_weights[p] = a.value(k);
+          }
+        }
+      },
+      adj);
+
+  std::visit(
+      [this](const auto &pc) {
+        const auto &c = *pc;
+        if (c._ncols > std::size_t{max32} + 1) {
+          throw std::runtime_error("too many labels to count");
+        }
+        _nlabels = c._ncols;
+        _rows.resize(c._nrows);
+        tbb::parallel_for(range(0, c._nrows), [&](const range &r) {
+          for (auto i = r.begin(); i != r.end(); ++i) {
+            auto &row = _rows[i];
+            row.reserve(c._indptr[i + 1] - c._indptr[i]);
+            for (auto k = c._indptr[i]; k < c._indptr[i + 1]; ++k) {
+              row.push_back(
+                  {static_cast<std::uint32_t>(c._indices[k]), c.value(k)});
+            }
+          }
+        });
+      },
+      counts);
+
+  std::visit(
+      [this](const auto &pl) {
+        const auto &l = *pl;
+        _labels.resize(l._nrows);
+        tbb::parallel_for(range(0, l._nrows), [&](const range &r) {
+          for (auto i = r.begin(); i != r.end(); ++i) {
+            std::vector<Count> row;
+            for (auto k = l._indptr[i]; k < l._indptr[i + 1]; ++k) {
+              row.push_back(
+                  {static_cast<std::uint32_t>(l._indices[k]), l.value(k)});
+            }
+            // repeated labels are counted as one of their summed value
+            std::sort(row.begin(), row.end(),
+                      [](const Count &a, const Count &b) {
+                        return a.label < b.label;
+                      });
+            auto &labels = _labels[i];
+            for (const auto &c : row) {
+              if (!labels.empty() && labels.back().label == c.label) {
+                labels.back().value += c.value;
+              } else {
+                labels.push_back(c);
+              }
+            }
+          }
+        });
+      },
+      labels);
+}
+
+/// Position of `label` in labels of a node, or where it would be inserted
+static auto find_label(std::vector<LabelCounter::Count> &labels,
+                       std::int64_t label)
+    -> std::vector<LabelCounter::Count>::iterator {
+  return std::lower_bound(labels.begin(), labels.end(), label,
+                          [](const LabelCounter::Count &c, std::int64_t l) {
+                            return c.label < l;
+                          });
+}
+
+namespace {
+/// Change of a count of `label` in row of `node`
+struct CountDelta {
+  std::uint32_t node;
+  std::uint32_t label;
+  float value;
+
+  auto operator<(const CountDelta &o) const -> bool {
+    return node < o.node || (node == o.node && label < o.label);
+  }
+};
+} // namespace
+
+/// Merges deltas sorted by label into a row sorted by label, counts that
+/// become zero are dropped
+static void apply_deltas(std::vector<LabelCounter::Count> &row,
+                         const CountDelta *begin, const CountDelta *end) {
+  std::vector<LabelCounter::Count> merged;
+  merged.reserve(row.size() + static_cast<std::size_t>(end - begin));
+
+  auto it = row.begin();
+  for (auto d = begin; d != end; ++d) {
+    while (it != row.end() && it->label < d->label) {
+      merged.push_back(*it++);
+    }
+    if (d != begin && d[-1].label == d->label) {
+      merged.back().value += d->value;
+    } else if (it != row.end() && it->label == d->label) {
+      merged.push_back({d->label, it->value + d->value});
+      ++it;
+    } else {
+      merged.push_back({d->label, d->value});
+    }
+  }
+  merged.insert(merged.end(), it, row.end());
+  merged.erase(std::remove_if(merged.begin(), merged.end(),
+                              [](const auto &c) { return c.value == 0.F; }),
+               merged.end());
+  row.swap(merged);
+}
+
+void LabelCounter::update(const LabelChange *changes, std::size_t size) {
+  using range = tbb::blocked_range<std::size_t>;
+
+  auto nnodes = _in_ptr.size() - 1;
+  auto nlabels = static_cast<std::int64_t>(_nlabels);
+  for (std::size_t i = 0; i < size; ++i) {
+    const auto &c = changes[i];
+    if (c.node < 0 || static_cast<std::size_t>(c.node) >= nnodes ||
+        c.old_label >= nlabels || c.new_label >= nlabels) {
+      std::ostringstream ss;
+      ss << "Label change (" << c.node << ", " << c.old_label << ", "
+         << c.new_label << ") is out of range";
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  // labels of changed nodes after the changes, and values the changes
+  // remove and add, checked before anything is changed
+  std::unordered_map<std::size_t, std::vector<Count>> changed;
+  std::vector<std::pair<float, float>> values(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    const auto &c = changes[i];
+    auto node = static_cast<std::size_t>(c.node);
+    auto it = changed.find(node);
+    if (it == changed.end()) {
+      it = changed.emplace(node, _labels[node]).first;
+    }
+    auto &labels = it->second;
+
+    auto old_it = find_label(labels, c.old_label);
+    auto has_old = old_it != labels.end() && old_it->label == c.old_label;
+    if (c.old_label >= 0 && !has_old) {
+      std::ostringstream ss;
+      ss << "Label " << c.old_label << " is not a label of node " << c.node;
+      throw std::runtime_error(ss.str());
+    }
+    if (c.old_label == c.new_label) {
+      continue;
+    }
+    auto new_it = find_label(labels, c.new_label);
+    if (c.new_label >= 0 && new_it != labels.end() &&
+        new_it->label == c.new_label) {
+      std::ostringstream ss;
+      ss << "Label " << c.new_label << " is a label of node " << c.node
+         << " already";
+      throw std::runtime_error(ss.str());
+    }
+
+    auto value = 1.F;
+    if (c.old_label >= 0) {
+      value = old_it->value;
+      values[i].first = value;
+      labels.erase(old_it);
+    }
+    if (c.new_label >= 0) {
+      values[i].second = value;
+      labels.insert(find_label(labels, c.new_label),
+                    {static_cast<std::uint32_t>(c.new_label), value});
+    }
+  }
+  for (auto &[node, labels] : changed) {
+    _labels[node].swap(labels);
+  }
+
+  auto nlabels_changed = [](const LabelChange &c) -> std::uint64_t {
+    return c.old_label == c.new_label
+               ? 0
+               : static_cast<std::uint64_t>(c.old_label >= 0) +
+                     static_cast<std::uint64_t>(c.new_label >= 0);
+  };
+
+  // every change touches rows of nodes having the changed node as a neighbor
+  std::vector<std::uint64_t> offsets(size + 1, 0);
+  tbb::parallel_for(range(0, size), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto node = static_cast<std::size_t>(changes[i].node);
+      offsets[i + 1] =
+          (_in_ptr[node + 1] - _in_ptr[node]) * nlabels_changed(changes[i]);
+    }
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<CountDelta> deltas(offsets[size]);
+  tbb::parallel_for(range(0, size), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      const auto &c = changes[i];
+      if (nlabels_changed(c) == 0) {
+        continue;
+      }
+      auto node = static_cast<std::size_t>(c.node);
+      auto out = deltas.begin() + static_cast<std::ptrdiff_t>(offsets[i]);
+      for (auto k = _in_ptr[node]; k < _in_ptr[node + 1]; ++k) {
+        auto w = _in_weights[k];
+        if (c.old_label >= 0) {
+          *out++ = {_in_nodes[k], static_cast<std::uint32_t>(c.old_label),
+                    -w * values[i].first};
+        }
+        if (c.new_label >= 0) {
+          *out++ = {_in_nodes[k], static_cast<std::uint32_t>(c.new_label),
+                    w * values[i].second};
+        }
+      }
+    }
+  });
+  tbb::parallel_sort(deltas.begin(), deltas.end());
+
+  // each affected row is updated by one worker
+  std::vector<std::size_t> starts;
+  for (std::size_t e = 0; e < deltas.size(); ++e) {
+    if (e == 0 || deltas[e].node != deltas[e - 1].node) {
+      starts.push_back(e);
+    }
+  }
+  starts.push_back(deltas.size());
+
+  tbb::parallel_for(range(0, starts.size() - 1), [&](const range &r) {
+    for (auto s = r.begin(); s != r.end(); ++s) {
+      auto begin = deltas.data() + starts[s];
+      apply_deltas(_rows[begin->node], begin, deltas.data() + starts[s + 1]);
+    }
+  });
+}
+
+auto LabelCounter::row(int ixi) const -> const std::vector<Count> & {
+  auto ix = ixi < 0 ? static_cast<size_t>(ixi + static_cast<long>(_nnodes))
+                    : static_cast<size_t>(ixi);
+  if (ix >= _nnodes) {
+    std::ostringstream ss;
+    ss << "Index " << ixi << " is out of range (0, " << _nnodes << ")";
+    throw std::runtime_error(ss.str());
+  }
+  return _rows[ix];
+}
+
+void LabelCounter::slice(const int *ixs, std::size_t size, float *out) const {
+  using range = tbb::blocked_range<std::size_t>;
+
+  tbb::parallel_for(range(0, size), [&](const range &r) {
+    // each worker zeroes only its own rows, while they are hot in cache
+    std::fill(out + r.begin() * _nlabels, out + r.end() * _nlabels, 0.F);
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto dst = out + i * _nlabels;
+      for (const auto &c : row(ixs[i])) {
+        dst[c.label] = c.value;
+      }
+    }
+  });
+}
+
+template <class M>
+static auto rows_to_csr(const std::vector<std::vector<LabelCounter::Count>> &rows,
+                        std::size_t nlabels,
+                        const std::vector<std::uint64_t> &offsets) -> AnyCSR {
+  using range = tbb::blocked_range<std::size_t>;
+
+  auto n = rows.size();
+  typename M::vec_p indptr(offsets.begin(), offsets.end());
+  typename M::vec_i indices(offsets[n]);
+  typename M::vec_v data(offsets[n]);
+  tbb::parallel_for(range(0, n), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto pos = static_cast<std::size_t>(offsets[i]);
+      for (const auto &c : rows[i]) {
+        indices[pos] = static_cast<typename M::index_type>(c.label);
+        data[pos] = c.value;
+        pos++;
+      }
+    }
+  });
+
+  // rows are kept sorted and within the shape
+  return std::make_shared<M>(std::move(data), std::move(indices),
+                             std::move(indptr), n, nlabels, false);
+}
+
+auto LabelCounter::to_csr() const -> AnyCSR {
+  std::vector<std::uint64_t> offsets(_rows.size() + 1, 0);
+  for (std::size_t i = 0; i < _rows.size(); ++i) {
+    offsets[i + 1] = offsets[i] + _rows[i].size();
+  }
+
+  constexpr auto max32 = std::numeric_limits<std::uint32_t>::max();
+  if (_nlabels > std::size_t{max32} + 1) {
+    return rows_to_csr<CSRWide>(_rows, _nlabels, offsets);
+  }
+  if (offsets.back() > max32) {
+    return rows_to_csr<CSRLarge>(_rows, _nlabels, offsets);
+  }
+  return rows_to_csr<CSR>(_rows, _nlabels, offsets);
+}
@@ -16,15 +16,55 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "csr_builder.hpp"
 #include "csr_matrix.hpp"
 #include "externalsort.hpp"
 #include "tools.hpp"
 
-int main() { return 0; }
+static auto usage() -> int {
+  std::cerr << "usage: main build <edges.bin> <out.csr> [tmp_dir] [max_mem]"
+            << std::endl;
+  return 1;
+}
+
+/// Builds a CSR adjacency matrix file from a binary edge list
+static auto build(int argc, char **argv) -> int {
+  if (argc < 4 || argc > 6) {
+    return usage();
+  }
+  std::filesystem::path tmp_dir = argc > 4
+                                      ? std::filesystem::path(argv[4])
+                                      : std::filesystem::temp_directory_path();
+  std::size_t max_mem = std::size_t{1} << 30U;
+  if (argc > 5) {
+    max_mem = static_cast<std::size_t>(std::stoull(argv[5]));
+  }
+  auto nnz = build_csr(argv[2], argv[3], tmp_dir, max_mem);
+  std::cout << "nnz: " << nnz << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  try {
+    if (std::string(argv[1]) == "build") {
+      return build(argc, argv);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return usage();
+}
@@ -0,0 +1,121 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+
+BatchPipeline::BatchPipeline(AnyCSR m, std::vector<int> ixs,
+                             std::vector<size_t> offsets, size_t depth)
+    : _m(std::move(m)), _ixs(std::move(ixs)), _offsets(std::move(offsets)),
+      _slots(std::max<size_t>(depth, 1) + 1) {
+  if (_offsets.empty() || _offsets.front() != 0 ||
+      !std::is_sorted(_offsets.begin(), _offsets.end()) ||
+      _offsets.back() > _ixs.size()) {
+    throw std::runtime_error("batch offsets should be a non-decreasing "
+                             "sequence from 0 to the number of indices");
+  }
+  _ncols = std::visit([](const auto &m) { return m->_ncols; }, _m);
+  _producer = std::thread(&BatchPipeline::produce, this);
+}
+
+auto BatchPipeline::shuffled(AnyCSR m, size_t batch_size, std::uint64_t seed,
+                             bool drop_last, size_t depth) -> BatchPipeline * {
+  if (batch_size == 0) {
+    throw std::runtime_error("batch size should be positive");
+  }
+  auto nrows = std::visit([](const auto &m) { return m->_nrows; }, m);
+  std::vector<int> ixs(nrows);
+  std::iota(ixs.begin(), ixs.end(), 0);
+  std::shuffle(ixs.begin(), ixs.end(), std::mt19937_64(seed));
+
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < nrows; i += batch_size) {
+    offsets.push_back(i);
+  }
+  if (drop_last && nrows % batch_size != 0) {
+    offsets.pop_back();
+  }
+  offsets.push_back(std::min(offsets.size() * batch_size, nrows));
+
+  return new BatchPipeline(std::move(m), std::move(ixs), std::move(offsets),
+                           depth);
+}
+
+BatchPipeline::~BatchPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cancelled = true;
+  }
+  _cv.notify_all();
+  _producer.join();
+}
+
+void BatchPipeline::produce() {
+  for (size_t b = 0; b < nbatches(); ++b) {
+    {
+      // wait until the consumer has released the batch that used the slot
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [&] {
+        auto released = _next - (_held ? 1 : 0);
+        return _cancelled || b < released + _slots.size();
+      });
+      if (_cancelled) {
+        return;
+      }
+    }
+
+    auto &slot = _slots[b % _slots.size()];
+    auto ixs = _ixs.data() + _offsets[b];
+    auto size = _offsets[b + 1] - _offsets[b];
+    slot.error = nullptr;
+    try {
+      slot.data.resize(size * _ncols);
+      _arena.execute([&] {
+        std::visit(
+            [&](const auto &m) {
+              const auto &cm = *m;
+              cm.slice(ixs, size, slot.data.data());
+            },
+            _m);
+      });
+    } catch (...) {
+      slot.error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _produced = b + 1;
+    }
+    _cv.notify_all();
+  }
+}
+
+auto BatchPipeline::next(Batch &out, bool block) -> bool {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (_held) {
+    _held = false;
+    _cv.notify_all(); // its slot is free now
+  }
+  if (done()) {
+    return false;
+  }
+  if (_next >= _produced) {
+    if (!block) {
+      return false;
+    }
+    _cv.wait(lock, [&] { return _next < _produced; });
+  }
+
+  auto b = _next++;
+  auto &slot = _slots[b % _slots.size()];
+  _held = true;
+  if (slot.error) {
+    std::rethrow_exception(slot.error);
+  }
+  out = Batch{slot.data.data(), _ixs.data() + _offsets[b],
+              _offsets[b + 1] - _offsets[b], b};
+  return true;
+}
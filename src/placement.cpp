@@ -0,0 +1,225 @@
+#define TBB_SUPPRESS_DEPRECATED_MESSAGES 1
+
+#include "placement.hpp"
+#include "csr_format.hpp"
+#include "half.hpp"
+#include "tbb/tbb.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// numaif.h belongs to libnuma, which is not a dependency, so the syscall is
+// made directly with constants of linux/mempolicy.h
+static constexpr int MPOL_BIND_MODE = 2;
+static constexpr int MPOL_INTERLEAVE_MODE = 3;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static constexpr std::size_t PAGE = std::size_t{1} << 12U;
+static constexpr std::size_t HUGE_PAGE = std::size_t{1} << 21U;
+
+static auto round_up(std::size_t size, std::size_t to) -> std::size_t {
+  return (size + to - 1) / to * to;
+}
+
+// ----------------------------------------------------------------------------
+// NUMA topology
+// ----------------------------------------------------------------------------
+
+/// Parses a node list like "0-1,3" of sysfs, returning the largest node + 1
+static auto count_nodes(const std::string &list) -> int {
+  int count = 1;
+  std::istringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    auto dash = range.find('-');
+    auto last = dash == std::string::npos ? range : range.substr(dash + 1);
+    try {
+      count = std::max(count, std::stoi(last) + 1);
+    } catch (const std::exception &) {
+      return 1;
+    }
+  }
+  return count;
+}
+
+auto numa_nodes() -> int {
+  static const int nodes = [] {
+    std::ifstream is("/sys/devices/system/node/online");
+    std::string list;
+    if (!std::getline(is, list)) {
+      return 1;
+    }
+    // one word of the node mask is passed to mbind
+    return std::min(count_nodes(list), 64);
+  }();
+  return nodes;
+}
+
+auto current_numa_node() -> int {
+#ifdef SYS_getcpu
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return static_cast<int>(node);
+  }
+#endif
+  return 0;
+}
+
+/// Applies NUMA policy to pages of a mapping, a no-op on a single node
+static void bind_pages(void *data, std::size_t size, NumaPolicy numa,
+                       int node) {
+  auto nodes = numa_nodes();
+  if (nodes < 2) {
+    return;
+  }
+  unsigned long mask = 0;
+  int mode = 0;
+  if (node >= 0) {
+    mask = 1UL << static_cast<unsigned>(node % nodes);
+    mode = MPOL_BIND_MODE;
+  } else if (numa == NumaPolicy::interleave) {
+    mask = nodes == 64 ? ~0UL : (1UL << static_cast<unsigned>(nodes)) - 1;
+    mode = MPOL_INTERLEAVE_MODE;
+  } else {
+    return;
+  }
+#ifdef SYS_mbind
+  // placement is a hint: kernels without NUMA support keep default policy
+  ::syscall(SYS_mbind, data, size, mode, &mask, 65UL, 0U);
+#else
+  (void)data, (void)size, (void)mode;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Paged memory
+// ----------------------------------------------------------------------------
+
+/// Pages used for `size` bytes, transparent huge pages are not worth it for
+/// a fraction of one
+static auto page_size(std::size_t size, PageSize pages) -> PageSize {
+  return pages == PageSize::transparent && size < HUGE_PAGE ? PageSize::normal
+                                                            : pages;
+}
+
+/// Maps at least `size` bytes, returning the mapped size in `size`
+static auto map_pages(std::size_t &size, Placement placement, int node)
+    -> void * {
+  auto pages = page_size(size, placement.pages);
+  size = round_up(std::max<std::size_t>(size, 1),
+                  pages == PageSize::normal ? PAGE : HUGE_PAGE);
+
+  void *p = MAP_FAILED;
+  if (pages == PageSize::huge) {
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                   (21 << MAP_HUGE_SHIFT),
+               -1, 0);
+  } else if (pages == PageSize::transparent) {
+    // over-allocate to cut a huge page aligned range out of the mapping
+    auto base = ::mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED) {
+      auto start = reinterpret_cast<std::uintptr_t>(base);
+      auto aligned = round_up(start, HUGE_PAGE);
+      if (aligned > start) {
+        ::munmap(base, aligned - start);
+      }
+      ::munmap(reinterpret_cast<void *>(aligned + size),
+               start + HUGE_PAGE - aligned);
+      p = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+      ::madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+  } else {
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if (p == MAP_FAILED) {
+    std::ostringstream ss;
+    ss << "Could not allocate " << size << " bytes";
+    if (pages == PageSize::huge) {
+      ss << " of huge pages, reserve them with vm.nr_hugepages";
+    }
+    throw std::runtime_error(ss.str());
+  }
+  bind_pages(p, size, placement.numa, node);
+  return p;
+}
+
+PagedMemory::PagedMemory(std::size_t size, Placement placement, int node)
+    : _size(size) {
+  _data = map_pages(_size, placement, node);
+}
+
+PagedMemory::~PagedMemory() { ::munmap(_data, _size); }
+
+template <class T>
+auto place_buffer(const T *data, std::size_t n, Placement placement, int node)
+    -> Buffer<T> {
+  if (n == 0) {
+    return Buffer<T>(std::vector<T>());
+  }
+  auto memory = std::make_shared<PagedMemory>(n * sizeof(T), placement, node);
+  auto out = static_cast<T *>(memory->data());
+
+  using range = tbb::blocked_range<std::size_t>;
+  tbb::parallel_for(range(0, n, HUGE_PAGE / sizeof(T)), [&](const range &r) {
+    std::copy(data + r.begin(), data + r.end(), out + r.begin());
+  });
+  return Buffer<T>(out, n, std::move(memory));
+}
+
+// ----------------------------------------------------------------------------
+// Allocator
+// ----------------------------------------------------------------------------
+
+template <class T> auto PageAllocator<T>::allocate(std::size_t n) -> T * {
+  auto size = n * sizeof(T);
+  if (_placement.is_default() || size < HUGE_PAGE) {
+    return static_cast<T *>(::operator new(size));
+  }
+  return static_cast<T *>(map_pages(size, _placement, -1));
+}
+
+template <class T> void PageAllocator<T>::deallocate(T *p, std::size_t n) {
+  auto size = n * sizeof(T);
+  if (_placement.is_default() || size < HUGE_PAGE) {
+    ::operator delete(p);
+    return;
+  }
+  auto pages = page_size(size, _placement.pages);
+  ::munmap(p, round_up(size, pages == PageSize::normal ? PAGE : HUGE_PAGE));
+}
+
+// Explicit template instantiation
+template auto place_buffer(const float *, std::size_t, Placement, int)
+    -> Buffer<float>;
+template auto place_buffer(const float16 *, std::size_t, Placement, int)
+    -> Buffer<float16>;
+template auto place_buffer(const bfloat16 *, std::size_t, Placement, int)
+    -> Buffer<bfloat16>;
+template auto place_buffer(const std::uint8_t *, std::size_t, Placement, int)
+    -> Buffer<std::uint8_t>;
+template auto place_buffer(const pattern *, std::size_t, Placement, int)
+    -> Buffer<pattern>;
+template auto place_buffer(const std::uint32_t *, std::size_t, Placement, int)
+    -> Buffer<std::uint32_t>;
+template auto place_buffer(const std::uint64_t *, std::size_t, Placement, int)
+    -> Buffer<std::uint64_t>;
+
+template class PageAllocator<float>;
@@ -0,0 +1,37 @@
+#include "projection.hpp"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+ColumnProjection::ColumnProjection(std::size_t ncols,
+                                   const std::int64_t *columns,
+                                   std::size_t size)
+    : _ncols(ncols) {
+  // the table holds a position per column, the sink included
+  if (ncols >= std::numeric_limits<std::uint32_t>::max()) {
+    std::ostringstream ss;
+    ss << "Can not project matrices of " << ncols << " columns";
+    throw std::runtime_error(ss.str());
+  }
+  _remap.assign(ncols, static_cast<std::uint32_t>(size));
+  _columns.reserve(size);
+  for (std::size_t k = 0; k < size; ++k) {
+    auto col = columns[k] < 0 ? columns[k] + static_cast<std::int64_t>(ncols)
+                              : columns[k];
+    if (col < 0 || static_cast<std::size_t>(col) >= ncols) {
+      std::ostringstream ss;
+      ss << "Column " << columns[k] << " is out of range (0, " << ncols
+         << ")";
+      throw std::runtime_error(ss.str());
+    }
+    auto &pos = _remap[static_cast<std::size_t>(col)];
+    if (pos != size) {
+      std::ostringstream ss;
+      ss << "Column " << columns[k] << " is selected twice";
+      throw std::runtime_error(ss.str());
+    }
+    pos = static_cast<std::uint32_t>(k);
+    _columns.push_back(static_cast<std::uint32_t>(col));
+  }
+}
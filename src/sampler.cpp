@@ -0,0 +1,150 @@
+#include "sampler.hpp"
+#include "csr_matrix.hpp"
+#include "rng.hpp"
+#include "tbb/tbb.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/// Independent stream of `node` at `hop`
+static auto node_stream(std::uint64_t seed, std::size_t hop, int node)
+    -> SplitMix64 {
+  auto key = (static_cast<std::uint64_t>(hop) << 32U) ^
+             static_cast<std::uint32_t>(node);
+  return random_stream(seed, key);
+}
+
+template <class M>
+static auto sample_hop(const M &adj, std::vector<int> dst, int fanout,
+                       std::uint64_t seed, std::size_t hop) -> SampledBlock {
+  using range = tbb::blocked_range<std::size_t>;
+
+  SampledBlock b;
+  b.dst_nodes = std::move(dst);
+  const auto &nodes = b.dst_nodes;
+  auto n = nodes.size();
+
+  auto degree = [&adj](int node) {
+    return static_cast<std::size_t>(adj._indptr[node + 1] -
+                                    adj._indptr[node]);
+  };
+  auto nsampled = [fanout](std::size_t deg) {
+    return fanout < 0 ? deg : std::min(deg, static_cast<std::size_t>(fanout));
+  };
+
+  b.indptr.assign(n + 1, 0);
+  tbb::parallel_for(range(0, n), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      b.indptr[i + 1] = static_cast<std::int64_t>(nsampled(degree(nodes[i])));
+    }
+  });
+  std::partial_sum(b.indptr.begin(), b.indptr.end(), b.indptr.begin());
+
+  // sampled neighbors, global ids
+  std::vector<int> sampled(static_cast<std::size_t>(b.indptr[n]));
+  tbb::parallel_for(range(0, n), [&](const range &r) {
+    std::vector<std::size_t> picks;
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      auto begin = static_cast<std::size_t>(adj._indptr[nodes[i]]);
+      auto deg = degree(nodes[i]);
+      auto k = nsampled(deg);
+      auto out = sampled.begin() + b.indptr[i];
+
+      if (k == deg) {
+        std::copy(adj._indices.begin() + begin,
+                  adj._indices.begin() + begin + deg, out);
+        continue;
+      }
+
+      // Floyd's algorithm, k distinct positions out of deg
+      auto rng = node_stream(seed, hop, nodes[i]);
+      picks.clear();
+      for (auto j = deg - k; j < deg; ++j) {
+        auto t = static_cast<std::size_t>(rng.below(j + 1));
+        if (std::find(picks.begin(), picks.end(), t) != picks.end()) {
+          t = j;
+        }
+        picks.push_back(t);
+      }
+      for (auto t : picks) {
+        *out++ = static_cast<int>(adj._indices[begin + t]);
+      }
+    }
+  });
+
+  // local ids: frontier nodes keep their positions, new nodes follow
+  std::vector<std::pair<int, std::int64_t>> known(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    known[i] = {nodes[i], static_cast<std::int64_t>(i)};
+  }
+  tbb::parallel_sort(known.begin(), known.end());
+
+  auto is_known = [&known](int node) {
+    auto it = std::lower_bound(known.begin(), known.end(),
+                               std::make_pair(node, std::int64_t{0}));
+    return it != known.end() && it->first == node ? it->second
+                                                  : std::int64_t{-1};
+  };
+
+  std::vector<int> reached(sampled);
+  tbb::parallel_sort(reached.begin(), reached.end());
+  reached.erase(std::unique(reached.begin(), reached.end()), reached.end());
+  reached.erase(std::remove_if(reached.begin(), reached.end(),
+                               [&](int node) { return is_known(node) >= 0; }),
+                reached.end());
+
+  b.src_nodes.reserve(n + reached.size());
+  b.src_nodes.insert(b.src_nodes.end(), nodes.begin(), nodes.end());
+  b.src_nodes.insert(b.src_nodes.end(), reached.begin(), reached.end());
+
+  b.indices.resize(sampled.size());
+  tbb::parallel_for(range(0, sampled.size()), [&](const range &r) {
+    for (auto e = r.begin(); e != r.end(); ++e) {
+      auto local = is_known(sampled[e]);
+      if (local < 0) {
+        auto it = std::lower_bound(reached.begin(), reached.end(), sampled[e]);
+        local = static_cast<std::int64_t>(n) + (it - reached.begin());
+      }
+      b.indices[e] = local;
+    }
+  });
+
+  return b;
+}
+
+auto sample_blocks(const AnyCSR &adj, const int *seeds, std::size_t size,
+                   const std::vector<int> &fanouts, std::uint64_t seed)
+    -> std::vector<SampledBlock> {
+  return std::visit(
+      [&](const auto &pm) {
+        const auto &m = *pm;
+        if (m._nrows != m._ncols) {
+          throw std::runtime_error("adjacency matrix should be square");
+        }
+        if (m._nrows > static_cast<size_t>(std::numeric_limits<int>::max())) {
+          throw std::runtime_error("too many nodes to sample");
+        }
+
+        std::vector<int> frontier(size);
+        for (std::size_t i = 0; i < size; ++i) {
+          frontier[i] = static_cast<int>(m._row(seeds[i]));
+        }
+
+        std::vector<SampledBlock> blocks;
+        blocks.reserve(fanouts.size());
+        for (std::size_t hop = 0; hop < fanouts.size(); ++hop) {
+          blocks.push_back(sample_hop(m, std::move(frontier), fanouts[hop],
+                                      seed, hop));
+          frontier = std::vector<int>(blocks.back().src_nodes);
+        }
+        return blocks;
+      },
+      adj);
+}
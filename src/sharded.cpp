@@ -0,0 +1,168 @@
+#define TBB_SUPPRESS_DEPRECATED_MESSAGES 1
+
+#include "sharded.hpp"
+#include "csr_format.hpp"
+#include "tbb/tbb.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <variant>
+
+template <class T>
+static void read_array(std::istream &is, std::vector<T> &v) {
+  is.read(reinterpret_cast<char *>(v.data()),
+          static_cast<std::streamsize>(v.size() * sizeof(T)));
+  if (!is) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+}
+
+ShardedCSR::ShardedCSR(const std::string &fname, std::size_t max_resident,
+                       bool trusted)
+    : _fname(fname), _max_resident(std::max<std::size_t>(max_resident, 1)),
+      _trusted(trusted) {
+  std::ifstream is(fname, std::ios::binary);
+  if (!is) {
+    std::ostringstream ss;
+    ss << "Could not load " << fname;
+    throw std::runtime_error(ss.str());
+  }
+  ShardIndexHeader h{};
+  if (!is.read(reinterpret_cast<char *>(&h), sizeof(h))) {
+    throw std::runtime_error("Unexpected end of file");
+  }
+  h.check(std::filesystem::file_size(fname));
+
+  _nrows = h.nrows;
+  _ncols = h.ncols;
+  _row_starts.resize(std::size_t{h.nshards} + 1);
+  _indptr.resize(_nrows + 1);
+  read_array(is, _row_starts);
+  read_array(is, _indptr);
+
+  if (_row_starts.front() != 0 || _row_starts.back() != _nrows ||
+      std::adjacent_find(_row_starts.begin(), _row_starts.end(),
+                         std::greater_equal<>()) != _row_starts.end()) {
+    throw std::runtime_error("Shard rows must be increasing ranges");
+  }
+  if (_indptr.front() != 0 || _indptr.back() != h.nnz ||
+      !std::is_sorted(_indptr.begin(), _indptr.end())) {
+    throw std::runtime_error("index pointer values must form a "
+                             "non-decreasing sequence");
+  }
+}
+
+auto ShardedCSR::shard_of(std::size_t row) const -> std::size_t {
+  auto it = std::upper_bound(_row_starts.begin(), _row_starts.end(), row);
+  return static_cast<std::size_t>(it - _row_starts.begin()) - 1;
+}
+
+auto ShardedCSR::shard(std::size_t k) const -> AnyCSR {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _resident.find(k);
+    if (it != _resident.end()) {
+      _lru.splice(_lru.begin(), _lru, it->second);
+      return it->second->second;
+    }
+  }
+
+  // loads of different shards overlap, a shard loaded twice concurrently
+  // is cached once
+  auto fname = shard_fname(_fname, k);
+  auto m = load_any(fname, false, {}, _trusted);
+  std::visit(
+      [&](const auto &pm) {
+        auto rows = _row_starts[k + 1] - _row_starts[k];
+        auto nnz = _indptr[_row_starts[k + 1]] - _indptr[_row_starts[k]];
+        if (pm->_nrows != rows || pm->_ncols != _ncols || pm->nnz() != nnz) {
+          std::ostringstream ss;
+          ss << "Shard " << fname << " does not match its index";
+          throw std::runtime_error(ss.str());
+        }
+      },
+      m);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _resident.find(k);
+  if (it != _resident.end()) {
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return it->second->second;
+  }
+  ++_loads;
+  _lru.emplace_front(k, m);
+  _resident[k] = _lru.begin();
+  while (_lru.size() > _max_resident) {
+    _resident.erase(_lru.back().first);
+    _lru.pop_back();
+  }
+  return m;
+}
+
+auto ShardedCSR::resident() const -> std::size_t {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _lru.size();
+}
+
+auto ShardedCSR::loads() const -> std::uint64_t {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _loads;
+}
+
+auto ShardedCSR::_row(int ixi) const -> std::size_t {
+  auto ix = ixi < 0 ? static_cast<std::size_t>(ixi + static_cast<long>(_nrows))
+                    : static_cast<std::size_t>(ixi);
+  if (ix >= _nrows) {
+    std::ostringstream ss;
+    ss << "Index " << ixi << " is out of range (0, " << _nrows << ")";
+    throw std::runtime_error(ss.str());
+  }
+  return ix;
+}
+
+void ShardedCSR::slice(const int *ixs, std::size_t size, float *out) const {
+  using range = tbb::blocked_range<std::size_t>;
+
+  // rows in increasing order with their positions in `out`, so that rows
+  // of a shard are adjacent and read mostly sequentially
+  std::vector<std::pair<std::size_t, std::size_t>> order(size);
+  tbb::parallel_for(range(0, size), [&](const range &r) {
+    for (auto i = r.begin(); i != r.end(); ++i) {
+      order[i] = {_row(ixs[i]), i};
+    }
+  });
+  tbb::parallel_sort(order.begin(), order.end());
+
+  std::vector<int> rows;
+  std::vector<std::size_t> to;
+  for (std::size_t b = 0; b < size;) {
+    auto k = shard_of(order[b].first);
+    auto first = _row_starts[k];
+    auto e = b;
+    rows.clear();
+    to.clear();
+    for (; e < size && order[e].first < _row_starts[k + 1]; ++e) {
+      rows.push_back(static_cast<int>(order[e].first - first));
+      to.push_back(order[e].second);
+    }
+    std::visit(
+        [&](const auto &pm) {
+          pm->slice_to(rows.data(), to.data(), rows.size(), out);
+        },
+        shard(k));
+    b = e;
+  }
+}
+
+auto ShardedCSR::slice_nnz(const int *ixs, std::size_t size) const
+    -> std::size_t {
+  std::size_t nnz = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    auto ix = _row(ixs[i]);
+    nnz += _indptr[ix + 1] - _indptr[ix];
+  }
+  return nnz;
+}
@@ -0,0 +1,29 @@
+#include "simd.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+static auto detect_simd_level() -> SimdLevel {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  // AVX2 kernels convert half precision values with F16C as well
+  auto avx2 = __builtin_cpu_supports("avx2") != 0 &&
+              __builtin_cpu_supports("f16c") != 0;
+  if (avx2 && __builtin_cpu_supports("avx512f") != 0) {
+    return SimdLevel::avx512;
+  }
+  if (avx2) {
+    return SimdLevel::avx2;
+  }
+#endif
+  return SimdLevel::scalar;
+}
+
+static std::atomic<int> simd_cap{static_cast<int>(SimdLevel::avx512)};
+
+auto simd_level() -> SimdLevel {
+  static const auto detected = static_cast<int>(detect_simd_level());
+  return static_cast<SimdLevel>(std::min(detected, simd_cap.load()));
+}
+
+void set_simd_level(SimdLevel level) { simd_cap = static_cast<int>(level); }
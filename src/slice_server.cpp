@@ -0,0 +1,507 @@
+#include "slice_server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Messages of the protocol, both ends run on the same host
+namespace {
+
+constexpr char MAGIC[8] = {'G', 'S', 'C', 'S', 'L', 'I', 'C', 'E'};
+constexpr std::uint32_t VERSION = 1;
+
+/// First message of a client, sent along with the file descriptor of its
+/// ring of `slots * slot_bytes` bytes
+struct Hello {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t slots;
+  std::uint64_t slot_bytes;
+};
+
+/// Slice rows into a slot, followed by `nrows` row indices
+struct Request {
+  std::uint64_t slot;
+  std::uint64_t nrows;
+};
+
+/// Reply to a hello or a request, followed by `error_len` bytes of an error
+/// message when `status` is not zero
+struct Reply {
+  std::int32_t status;
+  std::uint32_t error_len;
+  std::uint64_t nrows;
+  std::uint64_t ncols;
+};
+
+} // namespace
+
+[[noreturn]] static void throw_errno(const char *what) {
+  std::ostringstream ss;
+  ss << what << ": " << std::strerror(errno);
+  throw std::runtime_error(ss.str());
+}
+
+/// Reads `size` bytes, false if the peer has disconnected
+static auto read_full(int fd, void *buf, size_t size) -> bool {
+  auto p = static_cast<char *>(buf);
+  while (size > 0) {
+    auto n = ::recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/// Writes `size` bytes, false if the peer has disconnected
+static auto write_full(int fd, const void *buf, size_t size) -> bool {
+  auto p = static_cast<const char *>(buf);
+  while (size > 0) {
+    auto n = ::send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/// Sends `size` bytes with a file descriptor attached to the first of them
+static auto send_fd(int fd, const void *buf, size_t size, int passed) -> bool {
+  iovec iov{const_cast<void *>(buf), size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  auto cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cm), &passed, sizeof(int));
+
+  ssize_t n = 0;
+  do {
+    n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    return false;
+  }
+  return write_full(fd, static_cast<const char *>(buf) + n,
+                    size - static_cast<size_t>(n));
+}
+
+/// Receives `size` bytes and the file descriptor attached to them, -1 if
+/// the peer has disconnected or attached none
+static auto receive_fd(int fd, void *buf, size_t size) -> int {
+  iovec iov{buf, size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n = 0;
+  do {
+    n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    return -1;
+  }
+  int received = -1;
+  for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+       cm = CMSG_NXTHDR(&msg, cm)) {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+      std::memcpy(&received, CMSG_DATA(cm), sizeof(int));
+    }
+  }
+  if (received >= 0 &&
+      !read_full(fd, static_cast<char *>(buf) + n,
+                 size - static_cast<size_t>(n))) {
+    ::close(received);
+    return -1;
+  }
+  return received;
+}
+
+static auto socket_address(const std::string &path) -> sockaddr_un {
+  sockaddr_un addr{};
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    std::ostringstream ss;
+    ss << "Socket path " << path << " should have 1 to "
+       << sizeof(addr.sun_path) - 1 << " bytes";
+    throw std::runtime_error(ss.str());
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  return addr;
+}
+
+/// Sends a reply, with `error` if it is not empty
+static auto reply(int fd, Reply r, const std::string &error) -> bool {
+  r.status = error.empty() ? 0 : -1;
+  r.error_len = static_cast<std::uint32_t>(error.size());
+  return write_full(fd, &r, sizeof(r)) &&
+         write_full(fd, error.data(), error.size());
+}
+
+/// Rows of `ncols` floats a slot of `slot_bytes` holds
+static auto rows_per_slot(size_t slot_bytes, size_t ncols) -> size_t {
+  return slot_bytes / (std::max<size_t>(ncols, 1) * sizeof(float));
+}
+
+SliceServer::SliceServer(AnyCSR m, const std::string &path, int nthreads)
+    : _m(std::move(m)), _path(path) {
+  _ncols = std::visit([](const auto &pm) { return pm->_ncols; }, _m);
+  auto addr = socket_address(path);
+  _listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_listen_fd < 0) {
+    throw_errno("Could not create socket");
+  }
+  ::unlink(path.c_str()); // a socket left by a server that did not stop
+  if (::bind(_listen_fd, reinterpret_cast<const sockaddr *>(&addr),
+             sizeof(addr)) != 0 ||
+      ::listen(_listen_fd, SOMAXCONN) != 0) {
+    auto error = errno;
+    ::close(_listen_fd);
+    errno = error;
+    throw_errno(("Could not listen on " + path).c_str());
+  }
+  _arena.initialize(nthreads > 0 ? nthreads : tbb::task_arena::automatic);
+  _acceptor = std::thread(&SliceServer::accept_loop, this);
+}
+
+SliceServer::~SliceServer() { stop(); }
+
+void SliceServer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stopped) {
+      return;
+    }
+    _stopped = true;
+    // wakes the acceptor and threads waiting for requests
+    ::shutdown(_listen_fd, SHUT_RDWR);
+    for (auto &c : _connections) {
+      ::shutdown(c.fd, SHUT_RDWR);
+    }
+  }
+  _acceptor.join();
+  for (auto &c : _connections) {
+    c.thread.join();
+    ::close(c.fd);
+  }
+  _connections.clear();
+  ::close(_listen_fd);
+  ::unlink(_path.c_str());
+}
+
+auto SliceServer::nclients() -> size_t {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return static_cast<size_t>(
+      std::count_if(_connections.begin(), _connections.end(),
+                    [](const Connection &c) { return !c.done; }));
+}
+
+void SliceServer::accept_loop() {
+  while (true) {
+    auto fd = ::accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    auto error = errno;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stopped) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      return;
+    }
+    if (fd < 0) {
+      if (error == EINTR || error == ECONNABORTED) {
+        continue;
+      }
+      std::cerr << "Slice server stopped accepting clients: "
+                << std::strerror(error) << std::endl;
+      return;
+    }
+
+    // join threads of disconnected clients
+    for (auto it = _connections.begin(); it != _connections.end();) {
+      if (it->done) {
+        it->thread.join();
+        ::close(it->fd);
+        it = _connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    auto &c = _connections.emplace_back();
+    c.fd = fd;
+    c.thread = std::thread(&SliceServer::serve, this, std::ref(c));
+  }
+}
+
+void SliceServer::serve(Connection &c) {
+  int ring_fd = -1;
+  void *ring = MAP_FAILED;
+  size_t ring_bytes = 0;
+  Reply r{0, 0, 0, _ncols};
+  try {
+    Hello hello{};
+    ring_fd = receive_fd(c.fd, &hello, sizeof(hello));
+    if (ring_fd < 0) {
+      throw std::runtime_error("Client did not pass shared memory");
+    }
+    if (std::memcmp(hello.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        hello.version != VERSION) {
+      throw std::runtime_error("Unsupported slice client");
+    }
+    // a client shrinking the ring later would fault writes of the server
+    auto seals = ::fcntl(ring_fd, F_GET_SEALS);
+    if (seals < 0 || (static_cast<unsigned>(seals) & F_SEAL_SHRINK) == 0) {
+      throw std::runtime_error(
+          "Shared memory of the client is not sealed against shrinking");
+    }
+    struct stat st {};
+    if (hello.slots == 0 || hello.slot_bytes == 0 ||
+        hello.slot_bytes > SIZE_MAX / hello.slots ||
+        ::fstat(ring_fd, &st) != 0 ||
+        static_cast<std::uint64_t>(st.st_size) <
+            hello.slot_bytes * hello.slots) {
+      throw std::runtime_error("Shared memory is smaller than the ring");
+    }
+    ring_bytes = static_cast<size_t>(hello.slot_bytes * hello.slots);
+    ring = ::mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  ring_fd, 0);
+    if (ring == MAP_FAILED) {
+      throw_errno("Could not map shared memory");
+    }
+    auto slot_rows = rows_per_slot(hello.slot_bytes, _ncols);
+    r.nrows = std::visit([](const auto &pm) { return pm->_nrows; }, _m);
+    if (!reply(c.fd, r, {})) {
+      throw std::runtime_error("Client disconnected");
+    }
+
+    std::vector<int> ixs;
+    Request req{};
+    while (read_full(c.fd, &req, sizeof(req))) {
+      if (req.slot >= hello.slots || req.nrows > slot_rows) {
+        throw std::runtime_error("Request does not fit into a slot");
+      }
+      ixs.resize(req.nrows);
+      if (!read_full(c.fd, ixs.data(), ixs.size() * sizeof(int))) {
+        break;
+      }
+      auto out = reinterpret_cast<float *>(static_cast<char *>(ring) +
+                                           req.slot * hello.slot_bytes);
+      std::string error;
+      try {
+        _arena.execute([&] {
+          std::visit(
+              [&](const auto &pm) { pm->slice(ixs.data(), ixs.size(), out); },
+              _m);
+        });
+      } catch (const std::exception &e) {
+        error = e.what();
+      }
+      r.nrows = req.nrows;
+      if (!reply(c.fd, r, error)) {
+        break;
+      }
+    }
+  } catch (const std::exception &e) {
+    reply(c.fd, r, e.what()); // the client may be gone already
+  }
+
+  if (ring != MAP_FAILED) {
+    ::munmap(ring, ring_bytes);
+  }
+  if (ring_fd >= 0) {
+    ::close(ring_fd);
+  }
+  c.done = true;
+}
+
+SliceClient::SliceClient(const std::string &path, size_t slots,
+                         size_t slot_bytes)
+    : _slots(slots), _slot_bytes(slot_bytes) {
+  if (slots == 0 || slots > UINT32_MAX || slot_bytes == 0 ||
+      slot_bytes > SIZE_MAX / slots) {
+    throw std::runtime_error("Ring should have at least one non-empty slot");
+  }
+  auto addr = socket_address(path);
+  auto ring_fd = ::memfd_create("gscounting-slices",
+                               MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (ring_fd < 0) {
+    throw_errno("Could not create shared memory");
+  }
+  try {
+    auto ring_bytes = slots * slot_bytes;
+    if (::ftruncate(ring_fd, static_cast<off_t>(ring_bytes)) != 0) {
+      throw_errno("Could not size shared memory");
+    }
+    if (::fcntl(ring_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+      throw_errno("Could not seal shared memory");
+    }
+    auto ring = ::mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, ring_fd, 0);
+    if (ring == MAP_FAILED) {
+      throw_errno("Could not map shared memory");
+    }
+    _ring = static_cast<char *>(ring);
+
+    _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+      throw_errno("Could not create socket");
+    }
+    if (::connect(_fd, reinterpret_cast<const sockaddr *>(&addr),
+                  sizeof(addr)) != 0) {
+      throw_errno(("Could not connect to " + path).c_str());
+    }
+    Hello hello{};
+    std::memcpy(hello.magic, MAGIC, sizeof(MAGIC));
+    hello.version = VERSION;
+    hello.slots = static_cast<std::uint32_t>(slots);
+    hello.slot_bytes = slot_bytes;
+    if (!send_fd(_fd, &hello, sizeof(hello), ring_fd)) {
+      throw std::runtime_error("Slice server closed the connection");
+    }
+    auto error = receive(&_nrows, &_ncols);
+    if (!error.empty()) {
+      throw std::runtime_error(error);
+    }
+  } catch (...) {
+    ::close(ring_fd);
+    close();
+    throw;
+  }
+  // the server holds its own reference to the ring
+  ::close(ring_fd);
+}
+
+SliceClient::~SliceClient() { close(); }
+
+void SliceClient::close() {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+  if (_ring != nullptr) {
+    ::munmap(_ring, _slots * _slot_bytes);
+    _ring = nullptr;
+  }
+}
+
+auto SliceClient::slot_rows() const -> size_t {
+  return rows_per_slot(_slot_bytes, _ncols);
+}
+
+void SliceClient::send(const int *ixs, size_t size, size_t slot) {
+  Request req{slot, size};
+  if (!write_full(_fd, &req, sizeof(req)) ||
+      !write_full(_fd, ixs, size * sizeof(int))) {
+    throw std::runtime_error("Slice server closed the connection");
+  }
+}
+
+auto SliceClient::receive(size_t *nrows, size_t *ncols) -> std::string {
+  Reply r{};
+  if (!read_full(_fd, &r, sizeof(r))) {
+    throw std::runtime_error("Slice server closed the connection");
+  }
+  std::string error(r.error_len, '\0');
+  if (!read_full(_fd, error.data(), error.size())) {
+    throw std::runtime_error("Slice server closed the connection");
+  }
+  if (nrows != nullptr && ncols != nullptr) {
+    *nrows = static_cast<size_t>(r.nrows);
+    *ncols = static_cast<size_t>(r.ncols);
+  }
+  if (r.status != 0 && error.empty()) {
+    error = "Slice server failed";
+  }
+  return error;
+}
+
+auto SliceClient::slice(const int *ixs, size_t size) -> const float * {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (size > slot_rows()) {
+    std::ostringstream ss;
+    ss << size << " rows of " << _ncols << " columns do not fit into a slot "
+       << "of " << _slot_bytes << " bytes";
+    throw std::runtime_error(ss.str());
+  }
+  auto slot = _next;
+  _next = (_next + 1) % _slots;
+  send(ixs, size, slot);
+  auto error = receive();
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+  return reinterpret_cast<const float *>(_ring + slot * _slot_bytes);
+}
+
+void SliceClient::slice(const int *ixs, size_t size, float *out) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto rows = slot_rows();
+  if (rows == 0) {
+    std::ostringstream ss;
+    ss << "A slot of " << _slot_bytes << " bytes does not hold a row of "
+       << _ncols << " columns";
+    throw std::runtime_error(ss.str());
+  }
+  auto nchunks = (size + rows - 1) / rows;
+  size_t sent = 0;
+  std::string error;
+  for (size_t k = 0; k < nchunks; ++k) {
+    // keep every slot busy, unless a request has failed
+    while (sent < nchunks && sent - k < _slots && error.empty()) {
+      auto begin = sent * rows;
+      send(ixs + begin, std::min(rows, size - begin), (_next + sent) % _slots);
+      ++sent;
+    }
+    if (k == sent) {
+      break;
+    }
+    auto chunk_error = receive();
+    if (!chunk_error.empty()) {
+      error = error.empty() ? chunk_error : error;
+      continue;
+    }
+    if (error.empty()) {
+      auto begin = k * rows;
+      auto n = std::min(rows, size - begin) * _ncols;
+      auto slot = _ring + (_next + k) % _slots * _slot_bytes;
+      std::copy_n(reinterpret_cast<const float *>(slot), n,
+                  out + begin * _ncols);
+    }
+  }
+  _next = (_next + sent) % _slots;
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+}
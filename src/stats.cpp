@@ -0,0 +1,106 @@
+#include "stats.hpp"
+
+#include <cstdlib>
+
+namespace {
+
+/// Counters of one operation on their own cache lines, so that threads
+/// recording different operations do not contend
+struct alignas(64) StatCounters {
+  std::atomic<std::uint64_t> calls{0};
+  std::atomic<std::uint64_t> rows{0};
+  std::atomic<std::uint64_t> bytes{0};
+  std::atomic<std::uint64_t> total_ns{0};
+  std::atomic<std::uint64_t> max_ns{0};
+  std::atomic<std::uint64_t> histogram[NLATENCY_BUCKETS]{};
+};
+
+StatCounters counters[NSTATS];
+
+auto env_enabled() -> bool {
+  const char *env = std::getenv("GSC_STATS");
+  return env != nullptr && *env != '\0' && std::atoi(env) != 0;
+}
+
+std::atomic<bool> enabled{env_enabled()};
+
+auto bucket(std::uint64_t ns) -> std::size_t {
+  std::size_t k = 0;
+  for (; ns > 1 && k + 1 < NLATENCY_BUCKETS; ns >>= 1U) {
+    ++k;
+  }
+  return k;
+}
+
+} // namespace
+
+auto stat_name(Stat stat) -> const char * {
+  switch (stat) {
+  case Stat::slice:
+    return "slice";
+  case Stat::slice_validate:
+    return "slice_validate";
+  case Stat::slice_fill:
+    return "slice_fill";
+  case Stat::slice_scatter:
+    return "slice_scatter";
+  case Stat::load:
+    return "load";
+  case Stat::map:
+    return "map";
+  case Stat::save:
+    return "save";
+  case Stat::sort_run:
+    return "sort_run";
+  case Stat::sort_merge:
+    return "sort_merge";
+  }
+  return "unknown";
+}
+
+void set_stats_enabled(bool value) {
+  enabled.store(value, std::memory_order_relaxed);
+}
+
+auto stats_enabled() -> bool { return enabled.load(std::memory_order_relaxed); }
+
+void record_stat(Stat stat, std::uint64_t ns, std::uint64_t rows,
+                 std::uint64_t bytes) {
+  auto &c = counters[static_cast<std::size_t>(stat)];
+  constexpr auto relaxed = std::memory_order_relaxed;
+  c.calls.fetch_add(1, relaxed);
+  c.rows.fetch_add(rows, relaxed);
+  c.bytes.fetch_add(bytes, relaxed);
+  c.total_ns.fetch_add(ns, relaxed);
+  c.histogram[bucket(ns)].fetch_add(1, relaxed);
+  auto max = c.max_ns.load(relaxed);
+  while (ns > max && !c.max_ns.compare_exchange_weak(max, ns, relaxed)) {
+  }
+}
+
+auto stats_snapshot(Stat stat) -> StatSnapshot {
+  const auto &c = counters[static_cast<std::size_t>(stat)];
+  StatSnapshot s;
+  s.calls = c.calls.load();
+  s.rows = c.rows.load();
+  s.bytes = c.bytes.load();
+  s.total_ns = c.total_ns.load();
+  s.max_ns = c.max_ns.load();
+  for (std::size_t k = 0; k < NLATENCY_BUCKETS; ++k) {
+    s.histogram[k] = c.histogram[k].load();
+  }
+  return s;
+}
+
+void reset_stats() {
+  for (auto &c : counters) {
+    c.calls = 0;
+    c.rows = 0;
+    c.bytes = 0;
+    c.total_ns = 0;
+    c.max_ns = 0;
+    for (auto &h : c.histogram) {
+      h = 0;
+    }
+  }
+}
@@ -1,18 +1,39 @@
 // "Copyright 2020 Kirill Konevets"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstddef>
 #include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <numeric>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <variant>
 #include <vector>
 
 #include "c_api.h"
+#include "csr_builder.hpp"
+#include "csr_format.hpp"
 #include "csr_matrix.hpp"
+#include "half.hpp"
+#include "label_counts.hpp"
 #include "externalsort.hpp"
+#include "generators.hpp"
+#include "pipeline.hpp"
+#include "sampler.hpp"
+#include "sharded.hpp"
+#include "slice_server.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
+#include "text_parser.hpp"
 #include "tools.hpp"
+#include "tbb/task_arena.h"
 #include "gtest/gtest.h"
 
 namespace fs = std::filesystem;
@@ -22,15 +43,26 @@ using adj_type = AdjItem<std::uint32_t>;
 
 constexpr size_t EDGE_LIST_LENGTH{1000};
 
+/// Path of a test input, relative to the repository root
 fs::path pjoin(std::string fname) {
   return fs::path("./src/tests/data/") / fname;
 }
 
+/// Path of a file written by a test, kept out of the source tree
+fs::path tjoin(std::string fname) {
+  static const auto dir = [] {
+    auto d = fs::temp_directory_path() / "gscounting-tests";
+    fs::create_directories(d);
+    return d;
+  }();
+  return dir / fname;
+}
+
 TEST(IteratorTest, Edge) {
   std::vector<edge_type> edges;
   {
     std::ifstream ifile(pjoin("edgelist.txt"));
-    std::ofstream ofile(pjoin("edgelist.bin"), std::ios::binary);
+    std::ofstream ofile(tjoin("edgelist.bin"), std::ios::binary);
     ASSERT_TRUE(ifile && ofile);
 
     for (edge_type edge; ifile >> edge;) {
@@ -40,7 +72,7 @@ TEST(IteratorTest, Edge) {
   }
 
   {
-    std::ifstream fin(pjoin("edgelist.bin"), std::ios::binary);
+    std::ifstream fin(tjoin("edgelist.bin"), std::ios::binary);
     ASSERT_TRUE(fin);
 
     size_t i = 0;
@@ -56,7 +88,7 @@ TEST(IteratorTest, Edge) {
 TEST(IteratorTest, Adjacency) {
   adj_type row{3, {1, 2, 3, 4, 5}};
   {
-    std::ofstream ofile(pjoin("edjlist.bin"), std::ios::binary);
+    std::ofstream ofile(tjoin("edjlist.bin"), std::ios::binary);
     ASSERT_TRUE(ofile);
 
     ofile.unsetf(std::ios::skipws);
@@ -64,7 +96,7 @@ TEST(IteratorTest, Adjacency) {
   }
 
   {
-    std::ifstream fin(pjoin("edjlist.bin"), std::ios::binary);
+    std::ifstream fin(tjoin("edjlist.bin"), std::ios::binary);
     ASSERT_TRUE(fin);
 
     for (adj_type cur_row; adj_type::decode(fin, cur_row);) {
@@ -76,13 +108,135 @@ TEST(IteratorTest, Adjacency) {
   }
 }
 
+TEST(IteratorTest, Blocks) {
+  std::vector<edge_type> edges;
+  std::vector<adj_type> rows;
+  for (std::uint32_t i = 0; i < 100; ++i) {
+    edges.emplace_back(i, 2 * i);
+    rows.emplace_back(i, std::vector<std::uint32_t>(i % 7, i));
+  }
+  {
+    std::ofstream ofile(tjoin("edgelist_block.bin"), std::ios::binary);
+    std::ofstream afile(tjoin("edjlist_block.bin"), std::ios::binary);
+    ASSERT_TRUE(ofile && afile);
+    EXPECT_TRUE(edge_type::encode_block(ofile, edges.data(), edges.size()));
+    EXPECT_TRUE(adj_type::encode_block(afile, rows.data(), rows.size()));
+  }
+
+  // block size does not divide the number of records
+  std::ifstream fin(tjoin("edgelist_block.bin"), std::ios::binary);
+  std::ifstream ain(tjoin("edjlist_block.bin"), std::ios::binary);
+  ASSERT_TRUE(fin && ain);
+  std::vector<edge_type> eblock(30);
+  std::vector<adj_type> ablock(30);
+  size_t ne = 0;
+  size_t na = 0;
+  for (size_t n; (n = edge_type::decode_block(fin, eblock.data(), 30)) > 0;) {
+    for (size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(eblock[i], edges[ne++]);
+    }
+  }
+  for (size_t n; (n = adj_type::decode_block(ain, ablock.data(), 30)) > 0;) {
+    for (size_t i = 0; i < n; ++i, ++na) {
+      ASSERT_EQ(ablock[i].source, rows[na].source);
+      ASSERT_EQ(ablock[i].targets, rows[na].targets);
+    }
+  }
+  ASSERT_EQ(ne, edges.size());
+  ASSERT_EQ(na, rows.size());
+
+  // a row longer than a read is carried over, rows after a block are left
+  // in the stream
+  std::vector<adj_type> long_rows;
+  long_rows.emplace_back(1, std::vector<std::uint32_t>(3, 1));
+  long_rows.emplace_back(2, std::vector<std::uint32_t>(200000, 2));
+  long_rows.emplace_back(3, std::vector<std::uint32_t>{});
+  long_rows.emplace_back(4, std::vector<std::uint32_t>(5, 4));
+  std::stringstream ss;
+  ASSERT_TRUE(adj_type::encode_block(ss, long_rows.data(), long_rows.size()));
+  ASSERT_EQ(adj_type::decode_block(ss, ablock.data(), 3), 3U);
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(ablock[i].source, long_rows[i].source);
+    ASSERT_EQ(ablock[i].targets, long_rows[i].targets);
+  }
+  adj_type last;
+  ASSERT_TRUE(adj_type::decode(ss, last));
+  ASSERT_EQ(last.targets, long_rows[3].targets);
+  ASSERT_EQ(adj_type::decode_block(ss, ablock.data(), 3), 0U);
+}
+
+TEST(IteratorTest, ParseText) {
+  {
+    std::ofstream ofile(tjoin("edgelist_parse.txt"));
+    ASSERT_TRUE(ofile);
+    for (std::uint32_t i = 0; i < 1000; ++i) {
+      ofile << i << (i % 2 ? "\t" : " ") << 3 * i << (i % 3 ? "\n" : "\r\n");
+      if (i % 100 == 0) {
+        ofile << "\n" << i << " x\n";
+      }
+    }
+    ofile << "4294967296 1\n7 8"; // out of range, no trailing newline
+  }
+
+  // chunks are much smaller than the file
+  auto stats = parse_edges(tjoin("edgelist_parse.txt"),
+                           tjoin("edgelist_parse.bin"), 100);
+  ASSERT_EQ(stats.records, 1001U);
+  ASSERT_EQ(stats.malformed, 11U);
+  ASSERT_EQ(stats.lines, 1000U + 20 + 2);
+  ASSERT_EQ(stats.malformed_lines.front(), 3U);
+  ASSERT_EQ(stats.malformed_lines.back(), 1021U);
+
+  std::ifstream fin(tjoin("edgelist_parse.bin"), std::ios::binary);
+  std::vector<edge_type> edges(stats.records + 1);
+  ASSERT_EQ(edge_type::decode_block(fin, edges.data(), edges.size()),
+            stats.records);
+  for (std::uint32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(edges[i], edge_type(i, 3 * i));
+  }
+  ASSERT_EQ(edges[1000], edge_type(7, 8));
+
+  stats = parse_adjacency(pjoin("edjlist.txt"), tjoin("edjlist_parse.bin"), 4);
+  std::ifstream ifile(pjoin("edjlist.txt"));
+  std::ifstream ain(tjoin("edjlist_parse.bin"), std::ios::binary);
+  size_t n = 0;
+  adj_type parsed;
+  for (std::string line; std::getline(ifile, line); ++n) {
+    std::istringstream iss(line);
+    std::uint32_t source;
+    iss >> source;
+    std::vector<std::uint32_t> targets(std::istream_iterator<std::uint32_t>(iss),
+                                       {});
+    ASSERT_TRUE(adj_type::decode(ain, parsed));
+    ASSERT_EQ(parsed.source, source);
+    ASSERT_EQ(parsed.targets, targets);
+  }
+  ASSERT_EQ(stats.records, n);
+  ASSERT_EQ(stats.malformed, 0U);
+}
+
+TEST(IteratorTest, DISABLED_ParsePerformance) {
+  {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<std::uint32_t> uni(0, 100000000);
+    std::ofstream ofile(tjoin("edgelist_perf.txt"));
+    for (size_t i = 0; i < 10000000; ++i) {
+      ofile << uni(rng) << ' ' << uni(rng) << '\n';
+    }
+  }
+
+  std::cout << parse_edges(tjoin("edgelist_perf.txt"),
+                           tjoin("edgelist_perf.bin"))
+            << std::endl;
+}
+
 TEST(ExternalSorterTest, GenerateEdges) {
   std::random_device rd;
   std::mt19937 rng(rd());
   std::uniform_int_distribution<std::uint32_t> uni(
       0, 1000000); // guaranteed unbiased
 
-  std::ofstream os(pjoin("edgelist_big.bin"), std::ios::binary);
+  std::ofstream os(tjoin("edgelist_big.bin"), std::ios::binary);
   ASSERT_TRUE(os);
 
   for (size_t i = 0; i < EDGE_LIST_LENGTH; ++i) {
@@ -91,14 +245,14 @@ TEST(ExternalSorterTest, GenerateEdges) {
 }
 
 TEST(ExternalSorterTest, SortUnstableAndSave) {
-  std::ifstream fin(pjoin("edgelist_big.bin"), std::ios::binary);
+  std::ifstream fin(tjoin("edgelist_big.bin"), std::ios::binary);
   ASSERT_TRUE(fin);
 
   size_t max_mem = EDGE_LIST_LENGTH * sizeof(edge_type) / 5;
-  ExternalSorter<edge_type> sorter(pjoin(""), max_mem);
+  ExternalSorter<edge_type> sorter(tjoin(""), max_mem);
   auto merged = sorter.sort_unstable(fin);
 
-  std::ofstream os(pjoin("edgelist_big_sorted.bin"), std::ios::binary);
+  std::ofstream os(tjoin("edgelist_big_sorted.bin"), std::ios::binary);
   ASSERT_TRUE(os);
 
   for (auto &item : merged) {
@@ -107,7 +261,7 @@ TEST(ExternalSorterTest, SortUnstableAndSave) {
 }
 
 TEST(ExternalSorterTest, CheckEqual) {
-  std::ifstream fin(pjoin("edgelist_big.bin"), std::ios::binary);
+  std::ifstream fin(tjoin("edgelist_big.bin"), std::ios::binary);
   ASSERT_TRUE(fin);
 
   std::vector<edge_type> v;
@@ -116,7 +270,7 @@ TEST(ExternalSorterTest, CheckEqual) {
   }
   std::sort(v.begin(), v.end());
 
-  std::ifstream fin_sorted(pjoin("edgelist_big_sorted.bin"), std::ios::binary);
+  std::ifstream fin_sorted(tjoin("edgelist_big_sorted.bin"), std::ios::binary);
   ASSERT_TRUE(fin_sorted);
 
   edge_type edge2;
@@ -127,6 +281,165 @@ TEST(ExternalSorterTest, CheckEqual) {
   }
 }
 
+TEST(ExternalSorterTest, MultiPassMerge) {
+  std::ifstream fin(tjoin("edgelist_big.bin"), std::ios::binary);
+  ASSERT_TRUE(fin);
+
+  std::vector<edge_type> v;
+  for (edge_type edge; edge_type::decode(fin, edge);) {
+    v.push_back(edge);
+  }
+  std::sort(v.begin(), v.end());
+  fin.clear();
+  fin.seekg(0);
+
+  // 50 parts merged 3 at a time
+  auto dir = tjoin("multipass");
+  fs::create_directories(dir);
+  size_t max_mem = EDGE_LIST_LENGTH * sizeof(edge_type) / 50;
+  {
+    ExternalSorter<edge_type> sorter(dir, max_mem, 3);
+    std::vector<edge_type> sorted;
+    for (auto &item : sorter.sort_unstable(fin)) {
+      sorted.push_back(item);
+    }
+    ASSERT_EQ(sorted, v);
+    ASSERT_LE(std::distance(fs::directory_iterator(dir), {}), 3);
+  }
+  fs::remove_all(dir);
+}
+
+TEST(ExternalSorterTest, BuildCSR) {
+  // small node ids, so that some edges repeat
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<std::uint32_t> uni(0, 30);
+  std::vector<edge_type> edges;
+  {
+    std::ofstream os(tjoin("edgelist_dup.bin"), std::ios::binary);
+    ASSERT_TRUE(os);
+    for (size_t i = 0; i < EDGE_LIST_LENGTH; ++i) {
+      edges.emplace_back(uni(rng), uni(rng));
+      edges.back().encode(os);
+    }
+  }
+
+  size_t max_mem = EDGE_LIST_LENGTH * sizeof(edge_type) / 5;
+  auto nnz = build_csr(tjoin("edgelist_dup.bin"), tjoin("m_built.bin"),
+                       tjoin(""), max_mem);
+
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  ASSERT_EQ(nnz, edges.size());
+
+  std::uint32_t nnodes = 0;
+  for (auto &edge : edges) {
+    nnodes = std::max({nnodes, edge.first + 1, edge.second + 1});
+  }
+  std::vector<std::uint32_t> indptr(nnodes + 1, 0);
+  std::vector<std::uint32_t> indices;
+  for (auto &edge : edges) {
+    indptr[edge.first + 1]++;
+    indices.push_back(edge.second);
+  }
+  std::partial_sum(indptr.begin(), indptr.end(), indptr.begin());
+  CSR expected(std::vector<float>(edges.size(), 1.F), std::move(indices),
+               std::move(indptr), nnodes, nnodes);
+
+  auto m = std::unique_ptr<CSR>(CSR::load(tjoin("m_built.bin")));
+  ASSERT_EQ(*m, expected);
+  // all values are one, so no data is stored
+  using PatternCSR = CSRT<pattern>;
+  auto mm = std::unique_ptr<PatternCSR>(
+      PatternCSR::load_mmap(tjoin("m_built.bin")));
+  ASSERT_EQ(*mm, expected.astype<pattern>());
+  ASSERT_FALSE(fs::exists(tjoin("m_built.bin.runs")));
+
+  // room reserved for more non-zeros than written is not kept
+  auto file_end = [](const std::string &fname) {
+    std::ifstream is(fname, std::ios::binary);
+    CSRFileHeader h{};
+    EXPECT_TRUE(read_csr_header(is, h));
+    auto &indptr = h.sections[CSRFileHeader::INDPTR];
+    return indptr.offset + indptr.length * dtype_size(indptr.dtype);
+  };
+  ASSERT_EQ(fs::file_size(tjoin("m_built.bin")),
+            file_end(tjoin("m_built.bin")));
+
+  // rows must not go back
+  CSRFileWriter<float, std::uint32_t, std::uint32_t> writer(
+      tjoin("m_built.bin"), 2);
+  writer.push(1, 0, 1.F);
+  ASSERT_THROW(writer.push(0, 0, 1.F), std::runtime_error);
+
+  // values stay in place, sections after them move down
+  CSRFileWriter<float, std::uint32_t, std::uint32_t> sparse(
+      tjoin("m_compact.bin"), 1000);
+  sparse.push(0, 2, 1.F);
+  sparse.push(2, 0, 4.F);
+  sparse.push(2, 1, 5.F);
+  ASSERT_EQ(sparse.close(3, 3), 3U);
+  ASSERT_EQ(fs::file_size(tjoin("m_compact.bin")),
+            file_end(tjoin("m_compact.bin")));
+  auto compact = std::unique_ptr<CSR>(CSR::load(tjoin("m_compact.bin")));
+  ASSERT_EQ(*compact, CSR(std::vector<float>{1, 4, 5},
+                          std::vector<std::uint32_t>{2, 0, 1},
+                          std::vector<std::uint32_t>{0, 1, 1, 3}, 3, 3));
+}
+
+TEST(ExternalSorterTest, BuildRMat) {
+  RMatParams params;
+  params.scale = 10;
+  params.nedges = 20000;
+  {
+    std::ofstream os(tjoin("edgelist_rmat.bin"), std::ios::binary);
+    ASSERT_TRUE(os);
+    ASSERT_EQ(write_rmat_edges(os, params, 7), params.nedges);
+  }
+  size_t max_mem = params.nedges * sizeof(edge_type) / 5;
+  auto nnz = build_csr(tjoin("edgelist_rmat.bin"), tjoin("m_rmat.bin"),
+                       tjoin(""), max_mem);
+
+  using PatternCSR = CSRT<pattern>;
+  auto expected = rmat_csr<PatternCSR>(params, 7);
+  ASSERT_EQ(nnz, expected.nnz());
+  ASSERT_LT(nnz, params.nedges); // R-MAT edges repeat
+  ASSERT_EQ(rmat_csr<PatternCSR>(params, 7, false).nnz(), params.nedges);
+
+  // the built matrix is as large as its largest node ids
+  auto m = std::unique_ptr<PatternCSR>(
+      PatternCSR::load_mmap(tjoin("m_rmat.bin")));
+  ASSERT_EQ(m->_indices, expected._indices);
+  ASSERT_TRUE(std::equal(m->_indptr.begin(), m->_indptr.end(),
+                         expected._indptr.begin()));
+  ASSERT_EQ(expected._indptr[m->_nrows], nnz);
+}
+
+TEST(ExternalSorterTest, BuildSquare) {
+  // the largest node id is a target, its node has no edges of its own
+  {
+    std::ofstream os(tjoin("edgelist_square.bin"), std::ios::binary);
+    ASSERT_TRUE(os);
+    for (auto edge : {edge_type(0, 1), edge_type(1, 2), edge_type(2, 5)}) {
+      edge.encode(os);
+    }
+  }
+  ASSERT_EQ(build_csr(tjoin("edgelist_square.bin"), tjoin("m_square.bin"),
+                      tjoin("")),
+            3);
+  AnyCSR adj = std::shared_ptr<CSR>(CSR::load(tjoin("m_square.bin")));
+  auto &m = *std::get<std::shared_ptr<CSR>>(adj);
+  ASSERT_EQ(m._nrows, 6);
+  ASSERT_EQ(m._ncols, 6);
+
+  std::array<int, 2> seeds{0, 2};
+  auto blocks = sample_blocks(adj, seeds.data(), seeds.size(), {-1, -1}, 0);
+  ASSERT_EQ(blocks.size(), 2);
+  auto labels = std::make_shared<CSR>(CSR::random(6, 3, 0.5));
+  auto counts = std::get<std::shared_ptr<CSR>>(label_counts(adj, labels));
+  ASSERT_EQ(counts->_nrows, 6);
+  ASSERT_EQ(counts->_ncols, 3);
+}
+
 CSR get_simple_csr() {
   std::vector<std::uint32_t> indptr = {0, 1, 1, 3};
   std::vector<std::uint32_t> indices = {0, 0, 1};
@@ -139,19 +452,1099 @@ TEST(CSRCheck, Slice) {
   auto m = get_simple_csr();
   std::array<int, 3> ixs{0, 2, -3};
   m.slice(ixs.data(), ixs.size());
-  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  CSR::vec_slice res{1, 0, 0, 4, 5, 0, 1, 0, 0};
   ASSERT_EQ(m.slice_data, res);
 }
 
+TEST(CSRCheck, SliceConcurrent) {
+  const auto m = get_simple_csr();
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+
+  std::vector<std::vector<float>> outs(4, std::vector<float>(res.size(), 7));
+  std::vector<std::thread> threads;
+  for (auto &out : outs) {
+    threads.emplace_back([&] {
+      for (int k = 0; k < 100; ++k) {
+        m.slice(ixs.data(), ixs.size(), out.data());
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (auto &out : outs) {
+    ASSERT_EQ(out, res);
+  }
+}
+
+template <class M> void check_slice_kernels(const M &m) {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> uni(-static_cast<int>(m._nrows),
+                                         static_cast<int>(m._nrows) - 1);
+  std::vector<int> ixs(300);
+  std::generate(ixs.begin(), ixs.end(), [&] { return uni(rng); });
+
+  auto n = ixs.size() * m._ncols;
+  std::vector<float> scalar(n, -1);
+  std::vector<float> simd(n, -1);
+  std::vector<float> sorted(n, -1);
+  set_simd_level(SimdLevel::scalar);
+  m.slice(ixs.data(), ixs.size(), scalar.data());
+  set_simd_level(SimdLevel::avx512);
+  m.slice(ixs.data(), ixs.size(), simd.data());
+  m.slice(ixs.data(), ixs.size(), sorted.data(), true);
+  ASSERT_EQ(simd, scalar);
+  ASSERT_EQ(sorted, scalar);
+}
+
+TEST(CSRCheck, SliceKernels) {
+  // row lengths are not multiples of vector widths
+  auto m = CSR::random(100, 53, 0.6);
+  check_slice_kernels(m);
+
+  CSRWide wide(std::vector<float>(m._data.begin(), m._data.end()),
+               std::vector<std::uint64_t>(m._indices.begin(), m._indices.end()),
+               std::vector<std::uint64_t>(m._indptr.begin(), m._indptr.end()),
+               m._nrows, m._ncols);
+  check_slice_kernels(wide);
+}
+
+TEST(CSRCheck, HalfConversions) {
+  EXPECT_EQ(float16(1.F).bits, 0x3c00);
+  EXPECT_EQ(float16(-2.F).bits, 0xc000);
+  EXPECT_EQ(float16(65504.F).bits, 0x7bff);
+  EXPECT_EQ(float16(65520.F).bits, 0x7c00); // ties to even overflow
+  EXPECT_EQ(float16(5.9604645e-8F).bits, 0x0001);
+  EXPECT_EQ(float16(2.9802322e-8F).bits, 0x0000);
+  EXPECT_EQ(float16(1.F + 1.F / 4096).bits, 0x3c00);
+  EXPECT_EQ(bfloat16(1.F).bits, 0x3f80);
+  EXPECT_EQ(bfloat16(1.F + 1.F / 256).bits, 0x3f80);
+
+  // every value round trips, nans stay nans
+  for (std::uint32_t b = 0; b <= 0xffff; ++b) {
+    float16 h;
+    h.bits = static_cast<std::uint16_t>(b);
+    auto f = static_cast<float>(h);
+    if (std::isnan(f)) {
+      EXPECT_TRUE(std::isnan(static_cast<float>(float16(f))));
+    } else {
+      ASSERT_EQ(float16(f).bits, b);
+    }
+    bfloat16 bf;
+    bf.bits = static_cast<std::uint16_t>(b);
+    f = static_cast<float>(bf);
+    if (!std::isnan(f)) {
+      ASSERT_EQ(bfloat16(f).bits, b);
+    }
+  }
+
+  // vectorized conversions match scalar ones
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> uni(-70000, 70000);
+  std::vector<float> values(1001);
+  std::generate(values.begin(), values.end(), [&] { return uni(rng); });
+  values[3] = std::numeric_limits<float>::quiet_NaN();
+  values[4] = 1e-6F;
+  auto n = values.size();
+  std::vector<float16> h(n);
+  std::vector<bfloat16> bf(n);
+  std::vector<std::uint8_t> q(n);
+  std::vector<float> back(n);
+  set_simd_level(SimdLevel::avx2);
+  convert_values(values.data(), n, h.data());
+  convert_values(values.data(), n, bf.data());
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(h[i].bits, float16(values[i]).bits);
+    ASSERT_EQ(bf[i].bits, bfloat16(values[i]).bits);
+  }
+  convert_values(h.data(), n, back.data());
+  for (size_t i = 5; i < n; ++i) {
+    ASSERT_EQ(back[i], static_cast<float>(h[i]));
+  }
+  convert_values(values.data(), n, q.data(), 1000.F);
+  convert_values(q.data(), n, back.data(), 1000.F);
+  for (size_t i = 5; i < n; ++i) {
+    auto expected = std::clamp(std::nearbyint(values[i] / 1000), 0.F, 255.F);
+    ASSERT_EQ(back[i], expected * 1000);
+  }
+  set_simd_level(SimdLevel::avx512);
+}
+
+TEST(CSRCheck, ReducedPrecision) {
+  auto m = CSR::random(100, 53, 0.6);
+  auto h = m.astype<float16>();
+  auto bf = m.astype<bfloat16>();
+  auto q = m.astype<std::uint8_t>();
+  check_slice_kernels(h);
+  check_slice_kernels(bf);
+  check_slice_kernels(q);
+  ASSERT_EQ(h._indices.data(), m._indices.data()); // shared
+
+  std::vector<int> ixs{3, -1, 50, 3, 0};
+  auto n = ixs.size() * m._ncols;
+  std::vector<float> exact(n);
+  m.slice(ixs.data(), ixs.size(), exact.data());
+
+  // 16 bit outputs are converted from floats
+  std::vector<float16> out_h(n);
+  std::vector<bfloat16> out_bf(n);
+  m.slice(ixs.data(), ixs.size(), out_h.data());
+  m.slice(ixs.data(), ixs.size(), out_bf.data(), true);
+  std::vector<float> out(n);
+  h.slice(ixs.data(), ixs.size(), out.data());
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(out_h[i].bits, float16(exact[i]).bits);
+    ASSERT_EQ(out_bf[i].bits, bfloat16(exact[i]).bits);
+    ASSERT_EQ(out[i], static_cast<float>(float16(exact[i])));
+  }
+
+  // largest value maps to 255, values are within half a step
+  q.slice(ixs.data(), ixs.size(), out.data());
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_NEAR(out[i], exact[i], q._scale / 2 + 1e-6);
+  }
+
+  // files keep the value type and the scale
+  std::string fname(tjoin("m_u8.bin"));
+  q.save(fname, true);
+  auto any = load_any(fname);
+  ASSERT_TRUE(std::holds_alternative<std::shared_ptr<CSRT<std::uint8_t>>>(any));
+  ASSERT_EQ(q, *std::get<std::shared_ptr<CSRT<std::uint8_t>>>(any));
+  auto mapped = load_any(fname, true);
+  ASSERT_EQ(q, *std::get<std::shared_ptr<CSRT<std::uint8_t>>>(mapped));
+  // and are converted when loaded as floats
+  std::unique_ptr<CSR> ml{CSR::load(fname)};
+  ASSERT_EQ(q.astype<float>(), *ml);
+  ASSERT_THROW(CSR::load_mmap(fname), std::runtime_error);
+
+  fname = tjoin("m_f16.bin");
+  h.save(fname);
+  ASSERT_EQ(h, *std::get<std::shared_ptr<CSRT<float16>>>(load_any(fname)));
+  std::unique_ptr<CSRWide> wide{CSRWide::load(fname)};
+  ASSERT_EQ(wide->_data, h.astype<float>()._data);
+
+  auto any_bf = astype(load_any(fname), DType::bfloat16);
+  ASSERT_EQ(h.astype<bfloat16>(),
+            *std::get<std::shared_ptr<CSRT<bfloat16>>>(any_bf));
+}
+
+TEST(CSRCheck, Pattern) {
+  auto m = CSR::random(100, 53, 0.6).astype<pattern>(1.F).astype<float>();
+  auto p = m.astype<pattern>();
+  ASSERT_TRUE(p._data.empty());
+  ASSERT_EQ(p._scale, 1.F);
+  check_slice_kernels(p);
+
+  std::vector<int> ixs{3, -1, 50, 3, 0};
+  auto n = ixs.size() * m._ncols;
+  std::vector<float> expected(n);
+  std::vector<float> out(n);
+  m.slice(ixs.data(), ixs.size(), expected.data());
+  p.slice(ixs.data(), ixs.size(), out.data());
+  ASSERT_EQ(out, expected);
+  ASSERT_EQ(p.slice_csr(ixs.data(), ixs.size()).astype<float>(),
+            m.slice_csr(ixs.data(), ixs.size()));
+
+  // a configured constant
+  auto twos = p.astype<pattern>(2.F);
+  twos.slice(ixs.data(), ixs.size(), out.data());
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(out[i], 2 * expected[i]);
+  }
+  ASSERT_THROW(get_simple_csr().astype<pattern>(), std::runtime_error);
+
+  // files have no data section
+  std::string fname(tjoin("m_pattern.bin"));
+  twos.save(fname, true);
+  std::string fname_float(tjoin("m_float.bin"));
+  m.save(fname_float);
+  ASSERT_LT(fs::file_size(fname) + m.nnz() * sizeof(float) / 2,
+            fs::file_size(fname_float));
+  auto any = load_any(fname);
+  ASSERT_EQ(twos, *std::get<std::shared_ptr<CSRT<pattern>>>(any));
+  auto mapped = load_any(fname, true);
+  ASSERT_EQ(twos, *std::get<std::shared_ptr<CSRT<pattern>>>(mapped));
+  std::unique_ptr<CSR> ml{CSR::load(fname)};
+  ASSERT_EQ(*ml, twos.astype<float>());
+
+  // counts of a pattern adjacency are the ones of its values
+  auto adj = std::make_shared<CSR>(m);
+  auto pattern_adj = std::make_shared<CSRT<pattern>>(p);
+  auto labels = std::make_shared<CSR>(CSR::random(53, 7, 0.6));
+  ASSERT_EQ(*std::get<std::shared_ptr<CSR>>(label_counts(adj, labels)),
+            *std::get<std::shared_ptr<CSR>>(label_counts(pattern_adj, labels)));
+}
+
+TEST(CSRCheck, Generators) {
+  auto m = uniform_csr<CSR>(2000, 1000, 0.1, 1);
+  ASSERT_EQ(m._nrows, 2000);
+  ASSERT_EQ(m._ncols, 1000);
+  ASSERT_NEAR(static_cast<double>(m.nnz()), 2e5, 2e3);
+  ASSERT_NO_THROW(CSR(m._data, m._indices, m._indptr, 2000, 1000));
+  ASSERT_EQ(m, uniform_csr<CSR>(2000, 1000, 0.1, 1));
+  ASSERT_FALSE(m == uniform_csr<CSR>(2000, 1000, 0.1, 2));
+  // blocks are independent of the number of threads
+  tbb::task_arena arena(1);
+  arena.execute([&m] { ASSERT_EQ(m, uniform_csr<CSR>(2000, 1000, 0.1, 1)); });
+
+  ASSERT_EQ(uniform_csr<CSR>(30, 20, 1, 1).nnz(), 600);
+  ASSERT_EQ(uniform_csr<CSR>(30, 20, 0, 1).nnz(), 0);
+  ASSERT_THROW(uniform_csr<CSR>(30, 20, 1.5, 1), std::runtime_error);
+
+  std::ostringstream os;
+  ASSERT_EQ(write_uniform_edges(os, 2000, 1000, 0.1, 1), m.nnz());
+  ASSERT_EQ(os.str().size(), m.nnz() * sizeof(edge_type));
+
+  PowerLawParams params{2., 2, 100};
+  auto p = power_law_csr<CSRT<pattern>>(5000, 300, params, 3);
+  ASSERT_EQ(p, power_law_csr<CSRT<pattern>>(5000, 300, params, 3));
+  size_t max_degree = 0;
+  for (size_t i = 0; i < p._nrows; ++i) {
+    auto begin = p._indices.begin() + p._indptr[i];
+    auto end = p._indices.begin() + p._indptr[i + 1];
+    auto degree = static_cast<size_t>(end - begin);
+    ASSERT_GE(degree, params.min_degree);
+    ASSERT_LE(degree, params.max_degree);
+    ASSERT_TRUE(std::adjacent_find(begin, end, std::greater_equal<>()) == end);
+    max_degree = std::max(max_degree, degree);
+  }
+  // the tail is heavy: P(d >= 100) = 2%
+  ASSERT_EQ(max_degree, params.max_degree);
+  std::ostringstream pos;
+  ASSERT_EQ(write_power_law_edges(pos, 5000, 300, params, 3), p.nnz());
+  ASSERT_THROW(power_law_csr<CSR>(10, 10, PowerLawParams{1., 1, 0}, 3),
+               std::runtime_error);
+}
+
+TEST(CSRCheck, SliceSparse) {
+  const auto m = get_simple_csr();
+  std::array<int, 4> ixs{2, 1, 0, -1};
+  auto s = m.slice_csr(ixs.data(), ixs.size());
+
+  EXPECT_EQ(s._nrows, 4);
+  EXPECT_EQ(s._ncols, 3);
+  EXPECT_EQ(s._indptr, CSR::buf_p(CSR::vec_p({0, 2, 2, 3, 5})));
+  EXPECT_EQ(s._indices, CSR::buf_i(CSR::vec_i({0, 1, 0, 0, 1})));
+  EXPECT_EQ(s._data, CSR::buf_v(CSR::vec_v({4, 5, 1, 4, 5})));
+
+  // empty rows only
+  std::array<int, 2> empty{1, 1};
+  auto e = m.slice_csr(empty.data(), empty.size());
+  EXPECT_EQ(e.nnz(), 0);
+  EXPECT_EQ(e._nrows, 2);
+}
+
+TEST(CSRCheck, BatchPipeline) {
+  AnyCSR m = std::make_shared<CSR>(get_simple_csr());
+  std::vector<int> ixs{0, 2, -3, 1, 2};
+  std::vector<size_t> offsets{0, 3, 3, 5};
+  BatchPipeline pipeline(m, ixs, offsets, 1);
+
+  std::vector<std::vector<float>> res{
+      {1, 0, 0, 4, 5, 0, 1, 0, 0}, {}, {0, 0, 0, 4, 5, 0}};
+  Batch batch{};
+  for (size_t b = 0; b < res.size(); ++b) {
+    ASSERT_TRUE(pipeline.next(batch));
+    ASSERT_EQ(batch.index, b);
+    ASSERT_TRUE(std::equal(batch.ixs, batch.ixs + batch.size,
+                           ixs.begin() + offsets[b]));
+    std::vector<float> data(batch.data, batch.data + batch.size * 3);
+    ASSERT_EQ(data, res[b]);
+  }
+  ASSERT_TRUE(pipeline.done());
+  ASSERT_FALSE(pipeline.next(batch));
+
+  BatchPipeline failing(m, {0, 3, 1}, {0, 1, 2, 3});
+  ASSERT_TRUE(failing.next(batch));
+  ASSERT_THROW(failing.next(batch), std::runtime_error);
+  ASSERT_TRUE(failing.next(batch));
+}
+
+TEST(CSRCheck, BatchPipelineShuffled) {
+  AnyCSR m = std::make_shared<CSR>(CSR::random(100, 10, 0.5));
+  std::unique_ptr<BatchPipeline> pipeline{
+      BatchPipeline::shuffled(m, 16, 42, true, 3)};
+  const auto &csr = *std::get<std::shared_ptr<CSR>>(m);
+
+  std::vector<float> expected;
+  std::vector<int> seen;
+  Batch batch{};
+  while (pipeline->next(batch, false) || !pipeline->done()) {
+    if (batch.data == nullptr) {
+      continue; // polled before the batch was ready
+    }
+    ASSERT_EQ(batch.size, 16);
+    expected.resize(batch.size * csr._ncols);
+    csr.slice(batch.ixs, batch.size, expected.data());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), batch.data));
+    seen.insert(seen.end(), batch.ixs, batch.ixs + batch.size);
+    batch = Batch{};
+  }
+  ASSERT_EQ(seen.size(), 96);
+  std::sort(seen.begin(), seen.end());
+  ASSERT_EQ(std::unique(seen.begin(), seen.end()), seen.end());
+}
+
+TEST(CSRCheck, LabelCounts) {
+  auto adj = std::make_shared<CSR>(CSR::random(50, 40, 0.8));
+  auto labels = std::make_shared<CSR>(CSR::random(40, 7, 0.6));
+
+  std::vector<int> all(50);
+  std::iota(all.begin(), all.end(), 0);
+  std::vector<float> a(50 * 40);
+  std::vector<float> l(40 * 7);
+  adj->slice(all.data(), 50, a.data());
+  labels->slice(all.data(), 40, l.data());
+  std::vector<float> expected(50 * 7, 0.F);
+  for (size_t i = 0; i < 50; ++i) {
+    for (size_t j = 0; j < 40; ++j) {
+      for (size_t t = 0; t < 7; ++t) {
+        expected[i * 7 + t] += a[i * 40 + j] * l[j * 7 + t];
+      }
+    }
+  }
+
+  auto counts = std::get<std::shared_ptr<CSR>>(label_counts(adj, labels));
+  ASSERT_EQ(counts->_nrows, 50);
+  ASSERT_EQ(counts->_ncols, 7);
+  std::vector<float> dense(50 * 7);
+  counts->slice(all.data(), 50, dense.data());
+  for (size_t i = 0; i < dense.size(); ++i) {
+    ASSERT_FLOAT_EQ(dense[i], expected[i]);
+  }
+  for (size_t i = 0; i < 50; ++i) {
+    auto begin = counts->_indices.begin() + counts->_indptr[i];
+    auto end = counts->_indices.begin() + counts->_indptr[i + 1];
+    ASSERT_TRUE(std::is_sorted(begin, end));
+  }
+
+  // a batch of nodes, sparse and dense
+  std::vector<int> ixs{3, -1, 3, 17};
+  auto batch = std::get<std::shared_ptr<CSR>>(
+      label_counts(adj, labels, ixs.data(), ixs.size()));
+  ASSERT_EQ(*batch, counts->slice_csr(ixs.data(), ixs.size()));
+  std::vector<float> out(ixs.size() * 7, -1.F);
+  label_counts(adj, labels, ixs.data(), ixs.size(), out.data());
+  std::vector<float> sliced(ixs.size() * 7);
+  counts->slice(ixs.data(), ixs.size(), sliced.data());
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_FLOAT_EQ(out[i], sliced[i]);
+  }
+
+  // an empty batch has no rows
+  auto empty = std::get<std::shared_ptr<CSR>>(
+      label_counts(adj, labels, ixs.data(), 0));
+  ASSERT_EQ(empty->_nrows, 0);
+  ASSERT_EQ(empty->_ncols, 7);
+  ASSERT_EQ(*empty, counts->slice_csr(ixs.data(), 0));
+  label_counts(adj, labels, ixs.data(), 0, out.data());
+
+  ASSERT_THROW(label_counts(labels, adj), std::runtime_error);
+}
+
+TEST(CSRCheck, LabelCounter) {
+  size_t n = 40;
+  size_t nlabels = 6;
+  auto adj = std::make_shared<CSR>(CSR::random(n, n, 0.8));
+  auto labels = std::make_shared<CSR>(CSR::random(n, nlabels, 0.7));
+
+  std::vector<int> all(n);
+  std::iota(all.begin(), all.end(), 0);
+  std::vector<float> a(n * n);
+  std::vector<float> l(n * nlabels);
+  adj->slice(all.data(), n, a.data());
+  labels->slice(all.data(), n, l.data());
+
+  LabelCounter counter(adj, labels);
+  ASSERT_EQ(*std::get<std::shared_ptr<CSR>>(counter.to_csr()),
+            *std::get<std::shared_ptr<CSR>>(label_counts(adj, labels)));
+
+  // labels are stored ones, whatever their values
+  std::vector<bool> has(n * nlabels, false);
+  for (size_t j = 0; j < n; ++j) {
+    for (auto k = labels->_indptr[j]; k < labels->_indptr[j + 1]; ++k) {
+      has[j * nlabels + labels->_indices[k]] = true;
+    }
+  }
+
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<std::int64_t> node(0, n - 1);
+  std::uniform_int_distribution<std::int64_t> label(-1, nlabels - 1);
+  for (int round = 0; round < 5; ++round) {
+    std::vector<LabelChange> changes(7);
+    for (auto &c : changes) {
+      // an old label the node has, a new one it does not have
+      do {
+        c = {node(rng), label(rng), label(rng)};
+      } while ((c.old_label >= 0 && !has[c.node * nlabels + c.old_label]) ||
+               (c.new_label >= 0 && c.new_label != c.old_label &&
+                has[c.node * nlabels + c.new_label]));
+      if (c.old_label == c.new_label) {
+        continue;
+      }
+      float value = 1;
+      if (c.old_label >= 0) {
+        value = l[c.node * nlabels + c.old_label];
+        l[c.node * nlabels + c.old_label] = 0;
+        has[c.node * nlabels + c.old_label] = false;
+      }
+      if (c.new_label >= 0) {
+        l[c.node * nlabels + c.new_label] = value;
+        has[c.node * nlabels + c.new_label] = true;
+      }
+    }
+    counter.update(changes.data(), changes.size());
+
+    std::vector<float> out(n * nlabels);
+    counter.slice(all.data(), n, out.data());
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t t = 0; t < nlabels; ++t) {
+        float expected = 0;
+        for (size_t j = 0; j < n; ++j) {
+          expected += a[i * n + j] * l[j * nlabels + t];
+        }
+        ASSERT_NEAR(out[i * nlabels + t], expected, 1e-4);
+      }
+    }
+  }
+
+  // counts of the current labels, with their values
+  std::vector<float> values;
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint32_t> indptr{0};
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t t = 0; t < nlabels; ++t) {
+      if (has[j * nlabels + t]) {
+        values.push_back(l[j * nlabels + t]);
+        indices.push_back(t);
+      }
+    }
+    indptr.push_back(indices.size());
+  }
+  auto current = std::make_shared<CSR>(std::move(values), std::move(indices),
+                                       std::move(indptr), n, nlabels);
+  auto counts = std::get<std::shared_ptr<CSR>>(counter.to_csr());
+  auto expected = std::get<std::shared_ptr<CSR>>(label_counts(adj, current));
+  ASSERT_EQ(counts->_indptr, expected->_indptr);
+  ASSERT_EQ(counts->_indices, expected->_indices);
+  for (size_t k = 0; k < counts->nnz(); ++k) {
+    ASSERT_NEAR(counts->_data[k], expected->_data[k], 1e-4);
+  }
+
+  LabelChange bad{0, 0, static_cast<std::int64_t>(nlabels)};
+  ASSERT_THROW(counter.update(&bad, 1), std::runtime_error);
+
+  // labels the node does not have, or already has, are not changed
+  std::int64_t v = 0;
+  std::int64_t missing_label = -1;
+  std::int64_t present_label = -1;
+  for (; v < static_cast<std::int64_t>(n); ++v) {
+    missing_label = present_label = -1;
+    for (size_t t = 0; t < nlabels; ++t) {
+      (has[v * nlabels + t] ? present_label : missing_label) = t;
+    }
+    if (missing_label >= 0 && present_label >= 0) {
+      break;
+    }
+  }
+  ASSERT_LT(v, static_cast<std::int64_t>(n));
+  LabelChange missing{v, missing_label, -1};
+  ASSERT_THROW(counter.update(&missing, 1), std::runtime_error);
+  LabelChange present{v, -1, present_label};
+  ASSERT_THROW(counter.update(&present, 1), std::runtime_error);
+  // a change checked later in the batch leaves earlier ones undone too
+  std::vector<LabelChange> batch{{v, present_label, -1}, missing};
+  ASSERT_THROW(counter.update(batch.data(), batch.size()), std::runtime_error);
+  auto after = std::get<std::shared_ptr<CSR>>(counter.to_csr());
+  ASSERT_EQ(after->_indices, counts->_indices);
+  ASSERT_EQ(after->_data, counts->_data);
+}
+
+TEST(CSRCheck, SampleBlocks) {
+  auto adj = std::make_shared<CSR>(CSR::random(60, 60, 0.7));
+  std::vector<int> seeds{5, -1, 17};
+  std::vector<int> fanouts{4, -1, 2};
+  auto blocks = sample_blocks(adj, seeds.data(), seeds.size(), fanouts, 42);
+  ASSERT_EQ(blocks.size(), fanouts.size());
+  ASSERT_EQ(blocks[0].dst_nodes, std::vector<int>({5, 59, 17}));
+
+  for (size_t h = 0; h < blocks.size(); ++h) {
+    auto &b = blocks[h];
+    if (h > 0) {
+      ASSERT_EQ(b.dst_nodes, blocks[h - 1].src_nodes);
+    }
+    ASSERT_TRUE(std::equal(b.dst_nodes.begin(), b.dst_nodes.end(),
+                           b.src_nodes.begin()));
+    for (size_t i = 0; i < b.dst_nodes.size(); ++i) {
+      auto node = b.dst_nodes[i];
+      std::vector<std::uint32_t> row(
+          adj->_indices.begin() + adj->_indptr[node],
+          adj->_indices.begin() + adj->_indptr[node + 1]);
+      std::vector<std::uint32_t> neighbors;
+      for (auto e = b.indptr[i]; e < b.indptr[i + 1]; ++e) {
+        neighbors.push_back(b.src_nodes.at(b.indices[e]));
+      }
+      auto k = fanouts[h] < 0 ? row.size()
+                              : std::min(row.size(), size_t(fanouts[h]));
+      ASSERT_EQ(neighbors.size(), k);
+      std::sort(neighbors.begin(), neighbors.end());
+      ASSERT_TRUE(std::adjacent_find(neighbors.begin(), neighbors.end()) ==
+                  neighbors.end());
+      ASSERT_TRUE(std::includes(row.begin(), row.end(), neighbors.begin(),
+                                neighbors.end()));
+    }
+  }
+
+  // same seed, same sample
+  auto again = sample_blocks(adj, seeds.data(), seeds.size(), fanouts, 42);
+  for (size_t h = 0; h < blocks.size(); ++h) {
+    ASSERT_EQ(again[h].src_nodes, blocks[h].src_nodes);
+    ASSERT_EQ(again[h].indices, blocks[h].indices);
+  }
+
+  // features of the last hop
+  auto &src = blocks.back().src_nodes;
+  std::vector<float> features(src.size() * adj->_ncols);
+  adj->slice(src.data(), src.size(), features.data());
+
+  auto rect = std::make_shared<CSR>(CSR::random(6, 5, 0.5));
+  ASSERT_THROW(sample_blocks(rect, seeds.data(), 1, fanouts, 0),
+               std::runtime_error);
+}
+
 TEST(CSRCheck, SaveLoad) {
   auto m = get_simple_csr();
-  std::string fname(pjoin("m.bin"));
+  std::string fname(tjoin("m.bin"));
   m.save(fname);
   std::unique_ptr<CSR> ml{CSR::load(fname)};
 
   ASSERT_EQ(m, *ml);
 }
 
+TEST(CSRCheck, LoadVersion1) {
+  auto m = get_simple_csr();
+  std::string fname(tjoin("m_v1.bin"));
+  {
+    std::ofstream os(fname, std::ios::binary);
+    ASSERT_TRUE(os);
+    std::uint32_t shape[2] = {3, 3};
+    os.write(reinterpret_cast<const char *>(shape), sizeof(shape));
+    auto write = [&os](const auto &v) {
+      auto len = static_cast<std::uint32_t>(v.size());
+      os.write(reinterpret_cast<const char *>(&len), sizeof(len));
+      os.write(reinterpret_cast<const char *>(v.data()),
+               v.size() * sizeof(v[0]));
+    };
+    write(m._data);
+    write(m._indices);
+    write(m._indptr);
+  }
+
+  std::unique_ptr<CSR> ml{CSR::load(fname)};
+  ASSERT_EQ(m, *ml);
+  std::unique_ptr<CSR> mm{CSR::load_mmap(fname)};
+  ASSERT_EQ(m, *mm);
+  ASSERT_EQ(CSR::load_indptr(fname), CSR::vec_p({0, 1, 1, 3}));
+}
+
+TEST(CSRCheck, SaveLoadVersion2) {
+  auto m = get_simple_csr();
+  std::string fname(tjoin("m_v2.bin"));
+  m.save(fname, true);
+
+  {
+    std::ifstream is(fname, std::ios::binary);
+    CSRFileHeader h{};
+    ASSERT_TRUE(read_csr_header(is, h));
+    EXPECT_EQ(h.version, CSRFileHeader::VERSION);
+    EXPECT_TRUE(h.has(CSRFileHeader::VALIDATED));
+    EXPECT_TRUE(h.has(CSRFileHeader::CHECKSUM));
+    EXPECT_EQ(h.checksum, m.checksum());
+    for (auto &section : h.sections) {
+      EXPECT_EQ(section.offset % CSRFileHeader::ALIGNMENT, 0);
+    }
+
+    // a length whose size in bytes wraps around does not fit either
+    auto size = fs::file_size(fname);
+    auto crafted = h;
+    auto &indices = crafted.sections[CSRFileHeader::INDICES];
+    indices.length = (std::uint64_t{1} << 62U) + 1;
+    ASSERT_NO_THROW(h.check(size));
+    ASSERT_THROW(crafted.check(size), std::runtime_error);
+  }
+
+  ASSERT_EQ(CSR::load_indptr(fname), CSR::vec_p({0, 1, 1, 3}));
+  std::unique_ptr<CSR> ml{CSR::load(fname)};
+  ASSERT_EQ(m, *ml);
+
+  // corrupt last byte of indptr
+  {
+    std::fstream fs(fname, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(-1, std::ios::end);
+    fs.put(1);
+  }
+  ASSERT_THROW(CSR::load(fname), std::runtime_error);
+  ASSERT_THROW(CSR::load_mmap(fname), std::runtime_error);
+}
+
+TEST(CSRCheck, Validation) {
+  using vec_f = std::vector<float>;
+  using vec_u = std::vector<std::uint32_t>;
+  // rows go back
+  ASSERT_THROW(CSR(vec_f{1, 4, 5}, vec_u{0, 0, 1}, vec_u{0, 2, 1, 3}, 3, 3),
+               std::runtime_error);
+  // column out of range of the shape
+  ASSERT_THROW(CSR(vec_f{1, 4, 5}, vec_u{0, 0, 3}, vec_u{0, 1, 1, 3}, 3, 3),
+               std::runtime_error);
+  // index pointer does not match rows
+  ASSERT_THROW(CSR(vec_f{1, 4, 5}, vec_u{0, 0, 1}, vec_u{0, 1, 1, 3}, 4, 3),
+               std::runtime_error);
+  // shape is inferred from rows
+  CSR inferred(vec_f{1, 4, 5}, vec_u{0, 0, 1}, vec_u{0, 1, 1, 3});
+  ASSERT_EQ(inferred._nrows, 3);
+  ASSERT_EQ(inferred._ncols, 2);
+
+  // a corrupted column index of a file marked as validated is only caught
+  // when the file is not trusted
+  auto m = get_simple_csr();
+  std::string fname(tjoin("m_trusted.bin"));
+  for (auto checksum : {false, true}) {
+    m.save(fname, checksum);
+    {
+      std::fstream fs(fname, std::ios::binary | std::ios::in | std::ios::out);
+      CSRFileHeader h{};
+      ASSERT_TRUE(read_csr_header(fs, h));
+      fs.seekp(static_cast<std::streamoff>(
+          h.sections[CSRFileHeader::INDICES].offset +
+          2 * sizeof(std::uint32_t)));
+      std::uint32_t col = 7;
+      fs.write(reinterpret_cast<const char *>(&col), sizeof(col));
+    }
+    ASSERT_THROW(CSR::load(fname), std::runtime_error);
+    ASSERT_THROW(CSR::load_mmap(fname), std::runtime_error);
+    ASSERT_THROW(load_any(fname), std::runtime_error);
+    if (checksum) {
+      ASSERT_THROW(CSR::load(fname, {}, true), std::runtime_error);
+      ASSERT_THROW(CSR::load_mmap(fname, true), std::runtime_error);
+    } else {
+      std::unique_ptr<CSR> ml{CSR::load(fname, {}, true)};
+      ASSERT_EQ(ml->_indices[2], 7U);
+      std::unique_ptr<CSR> mm{CSR::load_mmap(fname, true)};
+      ASSERT_EQ(mm->_indices[2], 7U);
+      ASSERT_NO_THROW(load_any(fname, true, {}, true));
+    }
+  }
+
+  // arrays nobody has checked are not marked as validated, nor are shards
+  // of them, so trusted loads still check them
+  using vec_f = std::vector<float>;
+  using vec_u = std::vector<std::uint32_t>;
+  CSR unchecked(vec_f{1, 4, 5}, vec_u{0, 0, 7}, vec_u{0, 1, 1, 3}, 3, 3,
+                false);
+  auto is_validated = [](const std::string &f) {
+    std::ifstream is(f, std::ios::binary);
+    CSRFileHeader h{};
+    EXPECT_TRUE(read_csr_header(is, h));
+    return h.has(CSRFileHeader::VALIDATED);
+  };
+  unchecked.save(fname);
+  ASSERT_FALSE(is_validated(fname));
+  ASSERT_THROW(CSR::load(fname, {}, true), std::runtime_error);
+  ASSERT_THROW(CSR::load_mmap(fname, true), std::runtime_error);
+  auto sharded = tjoin("m_trusted_sharded.bin");
+  unchecked.save_sharded(sharded, 2);
+  ASSERT_FALSE(is_validated(shard_fname(sharded, 0)));
+  m.save_sharded(sharded, 2);
+  ASSERT_TRUE(is_validated(shard_fname(sharded, 1)));
+  auto placed = m.place({});
+  placed.save(fname);
+  ASSERT_TRUE(is_validated(fname));
+}
+
+TEST(CSRCheck, Sharded) {
+  auto m = uniform_csr<CSR>(1000, 50, 0.2, 5);
+  auto fname = tjoin("m_sharded.bin");
+  m.save_sharded(fname, 128);
+
+  ShardedCSR sharded(fname, 2);
+  ASSERT_EQ(sharded.nrows(), 1000);
+  ASSERT_EQ(sharded.ncols(), 50);
+  ASSERT_EQ(sharded.nshards(), 8);
+  ASSERT_EQ(sharded.nnz(), m.nnz());
+  ASSERT_TRUE(std::equal(m._indptr.begin(), m._indptr.end(),
+                         sharded.indptr().begin()));
+  ASSERT_EQ(sharded.resident(), 0);
+
+  // rows of every shard in random order, each shard is loaded once
+  std::vector<int> ixs(300);
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> uni(-1000, 999);
+  std::generate(ixs.begin(), ixs.end(), [&] { return uni(rng); });
+  ixs[0] = 0;
+  ixs[1] = -1;
+  for (size_t k = 0; k < sharded.nshards(); ++k) {
+    ixs[k + 2] = static_cast<int>(k * 128);
+  }
+  std::vector<float> expected(ixs.size() * m._ncols);
+  m.slice(ixs.data(), ixs.size(), expected.data());
+  std::vector<float> out(expected.size(), -1.F);
+  sharded.slice(ixs.data(), ixs.size(), out.data());
+  ASSERT_EQ(out, expected);
+  ASSERT_EQ(sharded.loads(), 8);
+  ASSERT_EQ(sharded.resident(), 2);
+  ASSERT_EQ(sharded.slice_nnz(ixs.data(), ixs.size()),
+            m.slice_nnz(ixs.data(), ixs.size()));
+
+  // the last two shards stay resident
+  std::array<int, 2> last{999, 800};
+  sharded.slice(last.data(), last.size(), out.data());
+  ASSERT_EQ(sharded.loads(), 8);
+  std::array<int, 1> bad{1000};
+  ASSERT_THROW(sharded.slice(bad.data(), bad.size(), out.data()),
+               std::runtime_error);
+
+  // shards keep their value type
+  auto p = m.astype<pattern>(1.F);
+  p.save_sharded(fname, 300, true);
+  ShardedCSR sharded_pattern(fname, 1, true);
+  ASSERT_EQ(sharded_pattern.nshards(), 4);
+  sharded_pattern.slice(ixs.data(), ixs.size(), out.data());
+  p.slice(ixs.data(), ixs.size(), expected.data());
+  ASSERT_EQ(out, expected);
+}
+
+TEST(CSRCheck, Projection) {
+  auto m = uniform_csr<CSR>(500, 300, 0.1, 7);
+  std::vector<int> ixs{3, -1, 250, 3, 0, 499};
+  std::vector<float> full(ixs.size() * m._ncols);
+  m.slice(ixs.data(), ixs.size(), full.data());
+
+  // permuted columns, negative ones count from the end
+  std::vector<std::int64_t> columns{299, 0, 17, -2, 150, 1};
+  ColumnProjection proj(m._ncols, columns.data(), columns.size());
+  ASSERT_EQ(proj.size(), columns.size());
+  ASSERT_EQ(proj.columns()[3], 298);
+  std::vector<float> expected(ixs.size() * columns.size());
+  for (size_t i = 0; i < ixs.size(); ++i) {
+    for (size_t c = 0; c < proj.size(); ++c) {
+      expected[i * proj.size() + c] = full[i * m._ncols + proj.columns()[c]];
+    }
+  }
+  std::vector<float> out(expected.size(), -1.F);
+  m.slice(ixs.data(), ixs.size(), proj, out.data());
+  ASSERT_EQ(out, expected);
+
+  // layouts and value types project the same columns
+  m.astype<pattern>(1.F).slice(ixs.data(), ixs.size(), proj, out.data());
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_EQ(out[i], expected[i] != 0 ? 1.F : 0.F);
+  }
+  CSRLarge large(m._data, m._indices,
+                 Buffer<std::uint64_t>(std::vector<std::uint64_t>(
+                     m._indptr.begin(), m._indptr.end())),
+                 m._nrows, m._ncols);
+  std::fill(out.begin(), out.end(), -1.F);
+  large.slice(ixs.data(), ixs.size(), proj, out.data());
+  ASSERT_EQ(out, expected);
+
+  // wider than a block of remapped columns
+  std::vector<std::int64_t> all(m._ncols);
+  std::iota(all.rbegin(), all.rend(), 0);
+  ColumnProjection reversed(m._ncols, all.data(), all.size());
+  std::vector<float> out_all(full.size());
+  m.slice(ixs.data(), ixs.size(), reversed, out_all.data());
+  for (size_t i = 0; i < ixs.size(); ++i) {
+    ASSERT_TRUE(std::equal(out_all.begin() + i * m._ncols,
+                           out_all.begin() + (i + 1) * m._ncols,
+                           full.rbegin() + (ixs.size() - 1 - i) * m._ncols));
+  }
+
+  std::vector<std::int64_t> dup{1, 5, 1};
+  ASSERT_THROW(ColumnProjection(m._ncols, dup.data(), dup.size()),
+               std::runtime_error);
+  std::vector<std::int64_t> outside{300};
+  ASSERT_THROW(ColumnProjection(m._ncols, outside.data(), outside.size()),
+               std::runtime_error);
+  ColumnProjection narrow(10, dup.data(), 2);
+  ASSERT_THROW(m.slice(ixs.data(), ixs.size(), narrow, out.data()),
+               std::runtime_error);
+  std::array<int, 1> bad{500};
+  ASSERT_THROW(m.slice(bad.data(), bad.size(), proj, out.data()),
+               std::runtime_error);
+}
+
+TEST(CSRCheck, FromArrays) {
+  auto m = uniform_csr<CSR>(200, 70, 0.1, 3);
+  std::vector<std::uint64_t> indptr64(m._indptr.begin(), m._indptr.end());
+  int released = 0;
+  std::shared_ptr<const void> owner(nullptr,
+                                    [&released](const void *) { ++released; });
+  CSRArrays arrays;
+  arrays.data = m._data.data();
+  arrays.indices = m._indices.data();
+  arrays.indptr = indptr64.data();
+  arrays.nrows = m._nrows;
+  arrays.ncols = m._ncols;
+  arrays.nnz = m.nnz();
+  arrays.indptr_dtype = DType::uint64;
+
+  // arrays are viewed and released with the last matrix sharing them
+  auto any = from_arrays(arrays, std::move(owner));
+  auto &large = *std::get<std::shared_ptr<CSRLarge>>(any);
+  ASSERT_EQ(large._indices.data(), m._indices.data());
+  ASSERT_EQ(large._indptr.data(), indptr64.data());
+  ASSERT_TRUE(std::equal(m._data.begin(), m._data.end(), large._data.begin()));
+  auto half = astype(any, DType::float16);
+  any = AnyCSR{};
+  ASSERT_EQ(released, 0);
+  half = AnyCSR{};
+  ASSERT_EQ(released, 1);
+
+  // copies own their arrays
+  arrays.indptr = m._indptr.data();
+  arrays.indptr_dtype = DType::uint32;
+  auto copied = from_arrays(arrays, nullptr, true);
+  auto &compact = *std::get<std::shared_ptr<CSR>>(copied);
+  ASSERT_NE(compact._indices.data(), m._indices.data());
+  ASSERT_EQ(compact, m);
+
+  // a pattern has no values
+  arrays.data = nullptr;
+  arrays.dtype = DType::pattern;
+  arrays.scale = 2.F;
+  auto p = from_arrays(arrays, nullptr);
+  ASSERT_EQ(*std::get<std::shared_ptr<CSRT<pattern>>>(p),
+            m.astype<pattern>(2.F));
+
+  // signed indices wrap around and fail validation
+  std::vector<std::int32_t> indices(m._indices.begin(), m._indices.end());
+  indices[5] = -1;
+  arrays.indices = indices.data();
+  ASSERT_THROW(from_arrays(arrays, nullptr), std::runtime_error);
+  arrays.index_dtype = DType::uint64;
+  ASSERT_THROW(from_arrays(arrays, nullptr), std::runtime_error);
+  arrays.ncols = 0;
+  arrays.index_dtype = DType::uint32;
+  ASSERT_THROW(from_arrays(arrays, nullptr), std::runtime_error);
+}
+
+TEST(CSRCheck, SliceServer) {
+  auto m = uniform_csr<CSR>(1000, 40, 0.1, 11);
+  auto path = (fs::temp_directory_path() / "gscounting_test.sock").string();
+  SliceServer server(std::make_shared<CSR>(m), path, 2);
+  ASSERT_THROW(SliceClient("/nonexistent/gscounting.sock"),
+               std::runtime_error);
+
+  std::vector<int> ixs(300);
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> uni(-1000, 999);
+  std::generate(ixs.begin(), ixs.end(), [&] { return uni(rng); });
+  std::vector<float> expected(ixs.size() * m._ncols);
+  m.slice(ixs.data(), ixs.size(), expected.data());
+
+  // 7 rows a slot, batches are pipelined over 3 slots
+  SliceClient client(path, 3, 7 * m._ncols * sizeof(float));
+  ASSERT_EQ(client.nrows(), 1000);
+  ASSERT_EQ(client.ncols(), 40);
+  ASSERT_EQ(client.slot_rows(), 7);
+  std::vector<float> out(expected.size(), -1.F);
+  client.slice(ixs.data(), ixs.size(), out.data());
+  ASSERT_EQ(out, expected);
+
+  // rows in the ring
+  auto rows = client.slice(ixs.data(), 7);
+  ASSERT_TRUE(std::equal(rows, rows + 7 * m._ncols, expected.begin()));
+  ASSERT_THROW(client.slice(ixs.data(), 8), std::runtime_error);
+
+  // errors of the server are rethrown, the connection stays usable
+  auto bad = ixs;
+  bad[100] = 1000;
+  ASSERT_THROW(client.slice(bad.data(), bad.size(), out.data()),
+               std::runtime_error);
+  ASSERT_THROW(client.slice(bad.data() + 100, 1), std::runtime_error);
+  std::fill(out.begin(), out.end(), -1.F);
+  client.slice(ixs.data(), ixs.size(), out.data());
+  ASSERT_EQ(out, expected);
+
+  // clients of several threads share the server
+  std::vector<std::thread> threads;
+  std::vector<int> matches(4, 0);
+  for (size_t t = 0; t < matches.size(); ++t) {
+    threads.emplace_back([&, t] {
+      SliceClient c(path, 2);
+      std::vector<float> o(expected.size());
+      for (int k = 0; k < 10; ++k) {
+        c.slice(ixs.data(), ixs.size(), o.data());
+        matches[t] += static_cast<int>(o == expected);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(matches, std::vector<int>(matches.size(), 10));
+
+  server.stop();
+  ASSERT_FALSE(fs::exists(path));
+  ASSERT_THROW(client.slice(ixs.data(), ixs.size(), out.data()),
+               std::runtime_error);
+}
+
+TEST(CSRCheck, IndexWidths) {
+  std::vector<std::uint64_t> indptr = {0, 1, 1, 3};
+  std::vector<std::uint32_t> indices = {0, 0, 1};
+  std::vector<float> data = {1, 4, 5};
+  CSRLarge m(std::move(data), std::move(indices), std::move(indptr), 3, 3);
+  std::string fname(tjoin("m_large.bin"));
+  m.save(fname, true);
+
+  // copies are narrowed to the compact layout
+  auto any = load_any(fname);
+  ASSERT_TRUE(std::holds_alternative<std::shared_ptr<CSR>>(any));
+  ASSERT_EQ(get_simple_csr(), *std::get<std::shared_ptr<CSR>>(any));
+
+  // views keep the stored one
+  auto mapped = load_any(fname, true);
+  ASSERT_TRUE(std::holds_alternative<std::shared_ptr<CSRLarge>>(mapped));
+  ASSERT_EQ(m, *std::get<std::shared_ptr<CSRLarge>>(mapped));
+
+  std::unique_ptr<CSRWide> wide{CSRWide::load(fname)};
+  std::array<int, 3> ixs{0, 2, -3};
+  wide->slice(ixs.data(), ixs.size());
+  CSRWide::vec_slice res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  ASSERT_EQ(wide->slice_data, res);
+  ASSERT_THROW(CSRWide::load_mmap(fname), std::runtime_error);
+}
+
+TEST(CSRCheck, SaveLoadMmap) {
+  auto m = get_simple_csr();
+  std::string fname(tjoin("m_mmap.bin"));
+  m.save(fname);
+  std::unique_ptr<CSR> ml{CSR::load_mmap(fname)};
+
+  ASSERT_EQ(m, *ml);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  ml->slice(ixs.data(), ixs.size());
+  CSR::vec_slice res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  ASSERT_EQ(ml->slice_data, res);
+}
+
+TEST(CSRCheck, Placement) {
+  // arrays and slices span several huge pages
+  auto m = CSR::random(2000, 1000, 0.5);
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> uni(0, 1999);
+  std::vector<int> ixs(1000);
+  std::generate(ixs.begin(), ixs.end(), [&] { return uni(rng); });
+  m.slice(ixs.data(), ixs.size());
+
+  for (auto pages : {PageSize::normal, PageSize::transparent}) {
+    for (auto numa : {NumaPolicy::local, NumaPolicy::interleave,
+                      NumaPolicy::replicate}) {
+      auto p = m.place({pages, numa});
+      ASSERT_EQ(p, m);
+      ASSERT_NE(p._indices.data(), m._indices.data());
+      if (numa == NumaPolicy::replicate) {
+        ASSERT_EQ(p._replicas->size(), static_cast<size_t>(numa_nodes()));
+        ASSERT_EQ(&p._local(), &(*p._replicas)[static_cast<size_t>(
+                                   current_numa_node() % numa_nodes())]);
+      } else {
+        ASSERT_EQ(&p._local(), &p);
+      }
+      p.slice(ixs.data(), ixs.size());
+      ASSERT_EQ(p.slice_data, m.slice_data);
+      p.slice(ixs.data(), ixs.size()); // reuses placed slice buffer
+      ASSERT_EQ(p.slice_data, m.slice_data);
+      check_slice_kernels(p);
+    }
+  }
+
+  // the huge page pool is usually empty, then allocation throws
+  try {
+    ASSERT_EQ(m.place({PageSize::huge, NumaPolicy::local}), m);
+  } catch (const std::runtime_error &) {
+  }
+
+  std::string fname(tjoin("m_placed.bin"));
+  m.save(fname);
+  Placement placement{PageSize::transparent, NumaPolicy::replicate};
+  std::unique_ptr<CSR> ml{CSR::load(fname, placement)};
+  ASSERT_EQ(*ml, m);
+  ASSERT_TRUE(ml->_replicas);
+  auto any = load_any(fname, false, placement);
+  ASSERT_EQ(*std::get<std::shared_ptr<CSR>>(any), m);
+  ASSERT_THROW(load_any(fname, true, placement), std::runtime_error);
+}
+
+TEST(CSRCheck, Stats) {
+  auto m = CSR::random(1000, 100, 0.5);
+  std::vector<int> ixs(700);
+  std::iota(ixs.begin(), ixs.end(), -300);
+  std::vector<float> out(ixs.size() * m._ncols);
+  std::string fname(tjoin("m_stats.bin"));
+
+  reset_stats();
+  set_stats_enabled(true);
+  m.slice(ixs.data(), ixs.size(), out.data());
+  m.slice(ixs.data(), ixs.size(), out.data(), true);
+  m.save(fname);
+  std::unique_ptr<CSR> ml{CSR::load(fname)};
+  std::unique_ptr<CSR> mm{CSR::load_mmap(fname)};
+  set_stats_enabled(false);
+  m.slice(ixs.data(), ixs.size(), out.data());
+
+  auto slice = stats_snapshot(Stat::slice);
+  ASSERT_EQ(slice.calls, 2U);
+  ASSERT_EQ(slice.rows, 2 * ixs.size());
+  ASSERT_EQ(slice.bytes, 2 * out.size() * sizeof(float));
+  ASSERT_GE(slice.total_ns, slice.max_ns);
+  ASSERT_GT(slice.max_ns, 0U);
+  ASSERT_EQ(std::accumulate(std::begin(slice.histogram),
+                            std::end(slice.histogram), std::uint64_t{0}),
+            2U);
+  for (auto phase : {Stat::slice_validate, Stat::slice_fill,
+                     Stat::slice_scatter}) {
+    auto s = stats_snapshot(phase);
+    ASSERT_GE(s.calls, 2U);
+    ASSERT_EQ(s.rows, 2 * ixs.size()) << stat_name(phase);
+  }
+  ASSERT_EQ(stats_snapshot(Stat::slice_fill).bytes, slice.bytes);
+  for (auto io : {Stat::save, Stat::load, Stat::map}) {
+    auto s = stats_snapshot(io);
+    ASSERT_EQ(s.calls, 1U) << stat_name(io);
+    ASSERT_EQ(s.rows, m._nrows);
+    ASSERT_EQ(s.bytes, fs::file_size(fname));
+  }
+
+  // runs are sorted and merged 2 at a time
+  std::ifstream fin(tjoin("edgelist_big.bin"), std::ios::binary);
+  auto dir = tjoin("stats_runs");
+  fs::create_directories(dir);
+  set_stats_enabled(true);
+  {
+    ExternalSorter<edge_type> sorter(
+        dir, EDGE_LIST_LENGTH * sizeof(edge_type) / 4, 2);
+    size_t n = 0;
+    for (auto &item : sorter.sort_unstable(fin)) {
+      (void)item;
+      ++n;
+    }
+    ASSERT_EQ(n, EDGE_LIST_LENGTH);
+  }
+  set_stats_enabled(false);
+  fs::remove_all(dir);
+  ASSERT_EQ(stats_snapshot(Stat::sort_run).calls, 4U);
+  ASSERT_EQ(stats_snapshot(Stat::sort_run).rows, EDGE_LIST_LENGTH);
+  ASSERT_EQ(stats_snapshot(Stat::sort_merge).calls, 2U);
+  ASSERT_EQ(stats_snapshot(Stat::sort_merge).rows, EDGE_LIST_LENGTH);
+
+  reset_stats();
+  ASSERT_EQ(stats_snapshot(Stat::slice).calls, 0U);
+  ASSERT_EQ(stats_snapshot(Stat::slice).histogram[0], 0U);
+}
+
 TEST(CSRCheck, DISABLED_Performance) {
   size_t nrows = 100000;
   auto m(CSR::random(nrows, 1000, 0.5));
@@ -167,9 +1560,143 @@ TEST(CSRCheck, DISABLED_Performance) {
 }
 
 TEST(C_API, CSRMatrix) {
-  auto fname = pjoin("m.bin");
-  LoadArgs load_args = {fname.c_str(), nullptr, 0, 0};
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  EXPECT_EQ(load_args.nrows_out, 3);
+  EXPECT_EQ(load_args.ncols_out, 3);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  SliceArgs args = {load_args.handle_out, ixs.data(), ixs.size(), nullptr};
+
+  ASSERT_EQ(DenseMatrixSliceCSRMatrix(&args), 0);
+
+  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  for (size_t i = 0; i < res.size(); ++i) {
+    EXPECT_EQ(res[i], args.data_out[i]);
+  }
+
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
+TEST(C_API, Sharded) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+  auto sharded_fname = tjoin("m_sharded_c.bin");
+  ASSERT_EQ(
+      CSRMatrixSaveSharded(load_args.handle_out, sharded_fname.c_str(), 2), 0);
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+
+  ShardedLoadArgs sharded_args{};
+  sharded_args.fname = sharded_fname.c_str();
+  sharded_args.max_resident = 1;
+  ASSERT_EQ(ShardedCSRLoad(&sharded_args), 0);
+  EXPECT_EQ(sharded_args.nrows_out, 3);
+  EXPECT_EQ(sharded_args.ncols_out, 3);
+  EXPECT_EQ(sharded_args.nshards_out, 2);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> out(9);
+  SliceArgs args = {sharded_args.handle_out, ixs.data(), ixs.size(),
+                    out.data()};
+  ASSERT_EQ(DenseMatrixSliceShardedCSRInto(&args), 0);
+  ASSERT_EQ(out, std::vector<float>({1, 0, 0, 4, 5, 0, 1, 0, 0}));
+  ASSERT_EQ(ShardedCSRFree(sharded_args.handle_out), 0);
+}
+
+TEST(C_API, Projection) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  std::array<std::int64_t, 2> columns{-2, 0};
+  ProjectionArgs proj_args = {3, columns.data(), columns.size(), nullptr};
+  ASSERT_EQ(ColumnProjectionCreate(&proj_args), 0);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> out(6);
+  ProjectedSliceArgs args = {load_args.handle_out, proj_args.handle_out,
+                             ixs.data(), ixs.size(), out.data()};
+  ASSERT_EQ(DenseMatrixSliceCSRMatrixProjectedInto(&args), 0);
+  ASSERT_EQ(out, std::vector<float>({0, 1, 5, 4, 0, 1}));
+  ASSERT_EQ(ColumnProjectionFree(proj_args.handle_out), 0);
+
+  std::array<std::int64_t, 1> outside{3};
+  ProjectionArgs bad_args = {3, outside.data(), outside.size(), nullptr};
+  ASSERT_EQ(ColumnProjectionCreate(&bad_args), -1);
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
+TEST(C_API, FromArrays) {
+  std::vector<float> data = {1, 4, 5};
+  std::vector<std::uint32_t> indices = {0, 0, 1};
+  std::vector<std::uint32_t> indptr = {0, 1, 1, 3};
+  int released = 0;
+  FromArraysArgs from_args = {data.data(), indices.data(), indptr.data(),
+                              3, 3, 3, 1, 2, 2, 1.F, 0, 0,
+                              [](void *ctx) { ++*static_cast<int *>(ctx); },
+                              &released, nullptr};
+  ASSERT_EQ(CSRMatrixFromArrays(&from_args), 0);
+  ASSERT_EQ(released, 0);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> out(9);
+  SliceArgs args = {from_args.handle_out, ixs.data(), ixs.size(), out.data()};
+  ASSERT_EQ(DenseMatrixSliceCSRMatrixInto(&args), 0);
+  ASSERT_EQ(out, std::vector<float>({1, 0, 0, 4, 5, 0, 1, 0, 0}));
+  ASSERT_EQ(CSRMatrixFree(from_args.handle_out), 0);
+  ASSERT_EQ(released, 1);
+
+  // failures release the arrays too
+  indices[2] = 3;
+  ASSERT_EQ(CSRMatrixFromArrays(&from_args), -1);
+  ASSERT_EQ(released, 2);
+}
+
+TEST(C_API, SliceServer) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
   ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+  auto path = (fs::temp_directory_path() / "gscounting_c_api.sock").string();
+  SliceServerArgs server_args{};
+  server_args.handle = load_args.handle_out;
+  server_args.path = path.c_str();
+  server_args.nthreads = 1;
+  ASSERT_EQ(SliceServerStart(&server_args), 0);
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+
+  RemoteCSRArgs remote_args{};
+  remote_args.path = path.c_str();
+  ASSERT_EQ(RemoteCSRConnect(&remote_args), 0);
+  EXPECT_EQ(remote_args.nrows_out, 3);
+  EXPECT_EQ(remote_args.ncols_out, 3);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  SliceArgs args = {remote_args.handle_out, ixs.data(), ixs.size(), nullptr};
+  ASSERT_EQ(DenseMatrixSliceRemoteCSR(&args), 0);
+  ASSERT_TRUE(std::equal(res.begin(), res.end(), args.data_out));
+
+  std::vector<float> out(9);
+  args.data_out = out.data();
+  ASSERT_EQ(DenseMatrixSliceRemoteCSRInto(&args), 0);
+  ASSERT_EQ(out, res);
+
+  ASSERT_EQ(RemoteCSRFree(remote_args.handle_out), 0);
+  ASSERT_EQ(SliceServerStop(server_args.handle_out), 0);
+}
+
+TEST(C_API, CSRMatrixMap) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixMapFromFile(&load_args), 0);
 
   EXPECT_EQ(load_args.nrows_out, 3);
   EXPECT_EQ(load_args.ncols_out, 3);
@@ -187,6 +1714,137 @@ TEST(C_API, CSRMatrix) {
   ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
 }
 
+TEST(C_API, SliceInto) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float> out(ixs.size() * load_args.ncols_out, -1);
+  SliceArgs args = {load_args.handle_out, ixs.data(), ixs.size(), out.data()};
+  ASSERT_EQ(DenseMatrixSliceCSRMatrixInto(&args), 0);
+
+  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  EXPECT_EQ(out, res);
+
+  args.data_out = nullptr;
+  EXPECT_EQ(DenseMatrixSliceCSRMatrixInto(&args), -1);
+
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
+TEST(C_API, ReducedPrecision) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  ConvertArgs convert = {load_args.handle_out, 4, 0.F, nullptr};
+  ASSERT_EQ(CSRMatrixConvert(&convert), 0);
+
+  std::array<int, 3> ixs{0, 2, -3};
+  std::vector<float16> out(ixs.size() * load_args.ncols_out);
+  SliceAsArgs args = {convert.handle_out, ixs.data(), ixs.size(), 4,
+                      out.data()};
+  ASSERT_EQ(DenseMatrixSliceCSRMatrixIntoAs(&args), 0);
+  std::vector<float> res{1, 0, 0, 4, 5, 0, 1, 0, 0};
+  for (size_t i = 0; i < res.size(); ++i) {
+    EXPECT_EQ(static_cast<float>(out[i]), res[i]);
+  }
+
+  args.dtype = 6; // not an output dtype
+  EXPECT_EQ(DenseMatrixSliceCSRMatrixIntoAs(&args), -1);
+  convert.dtype = 3;
+  EXPECT_EQ(CSRMatrixConvert(&convert), -1);
+
+  ASSERT_EQ(CSRMatrixFree(args.handle), 0);
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
+TEST(C_API, LabelCounts) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  // the matrix is both adjacency and labels
+  LabelCountArgs args = {load_args.handle_out, load_args.handle_out, nullptr, 0,
+                         nullptr, nullptr, 0, 0};
+  ASSERT_EQ(CSRMatrixLabelCounts(&args), 0);
+  ASSERT_EQ(args.nrows_out, 3);
+  ASSERT_EQ(args.ncols_out, 3);
+
+  std::array<int, 3> ixs{0, 1, 2};
+  std::vector<float> out(ixs.size() * args.ncols_out, -1);
+  SliceArgs slice_args = {args.handle_out, ixs.data(), ixs.size(), out.data()};
+  ASSERT_EQ(DenseMatrixSliceCSRMatrixInto(&slice_args), 0);
+  std::vector<float> res{1, 0, 0, 0, 0, 0, 4, 0, 0};
+  EXPECT_EQ(out, res);
+  ASSERT_EQ(CSRMatrixFree(args.handle_out), 0);
+
+  std::fill(out.begin(), out.end(), -1);
+  args.idxset = ixs.data();
+  args.len = ixs.size();
+  args.data_out = out.data();
+  ASSERT_EQ(DenseMatrixLabelCountsInto(&args), 0);
+  EXPECT_EQ(out, res);
+
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
+TEST(C_API, Stats) {
+  auto fname = tjoin("m.bin");
+  ASSERT_EQ(StatsReset(), 0);
+  ASSERT_EQ(StatsSetEnabled(1), 0);
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+  ASSERT_EQ(StatsSetEnabled(0), 0);
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+
+  StatsArgs args{};
+  args.stat = static_cast<int>(Stat::load);
+  ASSERT_EQ(StatsGet(&args), 0);
+  ASSERT_STREQ(args.name_out, "load");
+  ASSERT_EQ(args.calls_out, 1);
+  ASSERT_EQ(args.rows_out, 3);
+  ASSERT_EQ(args.bytes_out, fs::file_size(fname));
+  args.stat = GSC_NUM_STATS;
+  ASSERT_EQ(StatsGet(&args), -1);
+  ASSERT_EQ(StatsReset(), 0);
+}
+
+TEST(C_API, SliceSparse) {
+  auto fname = tjoin("m.bin");
+  LoadArgs load_args{};
+  load_args.fname = fname.c_str();
+  ASSERT_EQ(CSRMatrixLoadFromFile(&load_args), 0);
+
+  std::array<int, 3> ixs{2, 1, 0};
+  SparseSliceArgs args = {load_args.handle_out, ixs.data(), ixs.size(), 0,
+                          nullptr, nullptr, nullptr};
+  ASSERT_EQ(CSRMatrixSliceNNZ(&args), 0);
+  ASSERT_EQ(args.nnz, 3);
+
+  std::vector<std::int64_t> indptr(ixs.size() + 1);
+  std::vector<std::int64_t> indices(args.nnz);
+  std::vector<float> data(args.nnz);
+  args.indptr_out = indptr.data();
+  args.indices_out = indices.data();
+  args.data_out = data.data();
+  ASSERT_EQ(CSRMatrixSliceSparse(&args), 0);
+
+  EXPECT_EQ(indptr, std::vector<std::int64_t>({0, 2, 2, 3}));
+  EXPECT_EQ(indices, std::vector<std::int64_t>({0, 1, 0}));
+  EXPECT_EQ(data, std::vector<float>({4, 5, 1}));
+
+  args.nnz = 1;
+  EXPECT_EQ(CSRMatrixSliceSparse(&args), -1);
+
+  ASSERT_EQ(CSRMatrixFree(load_args.handle_out), 0);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,202 @@
+#include "text_parser.hpp"
+#include "tools.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tbb/parallel_pipeline.h"
+
+using edge_type = EdgeItem<std::uint32_t>;
+using adj_type = AdjItem<std::uint32_t>;
+
+auto operator<<(std::ostream &os, const ParseStats &stats) -> std::ostream & {
+  os << stats.lines << " lines, " << stats.records << " records, "
+     << stats.malformed << " malformed, " << stats.bytes << " bytes in "
+     << stats.seconds << " s (" << stats.throughput() << " MB/s)";
+  return os;
+}
+
+// ----------------------------------------------------------------------------
+// Line parsers
+// ----------------------------------------------------------------------------
+
+static auto skip_blanks(const char *p, const char *end) -> const char * {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+/// Parses an unsigned integer at `p`, which must be followed by a blank
+/// or the end of line, and moves `p` past it
+static auto parse_field(const char *&p, const char *end, std::uint32_t &value)
+    -> bool {
+  auto [ptr, ec] = std::from_chars(p, end, value);
+  if (ec != std::errc() || (ptr < end && *ptr != ' ' && *ptr != '\t')) {
+    return false;
+  }
+  p = skip_blanks(ptr, end);
+  return true;
+}
+
+static auto parse_line(const char *p, const char *end, edge_type &edge)
+    -> bool {
+  return parse_field(p, end, edge.first) && parse_field(p, end, edge.second) &&
+         p == end;
+}
+
+static auto parse_line(const char *p, const char *end, adj_type &row) -> bool {
+  if (!parse_field(p, end, row.source)) {
+    return false;
+  }
+  row.targets.clear();
+  for (std::uint32_t target; p < end; row.targets.push_back(target)) {
+    if (!parse_field(p, end, target)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// Chunked parsing
+// ----------------------------------------------------------------------------
+
+namespace {
+/// Records of a chunk and its malformed lines, numbered within the chunk
+template <class T> struct ParsedChunk {
+  std::vector<T> records;
+  std::size_t lines{0};
+  std::size_t malformed{0};
+  std::vector<std::size_t> malformed_lines;
+};
+} // namespace
+
+template <class T>
+static void parse_chunk(const char *p, const char *end, ParsedChunk<T> &out) {
+  T record;
+  while (p < end) {
+    auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    auto next = eol == nullptr ? end : eol + 1;
+    eol = eol == nullptr ? end : eol;
+    if (eol > p && eol[-1] == '\r') {
+      --eol;
+    }
+
+    out.lines++;
+    auto begin = skip_blanks(p, eol);
+    if (begin != eol) {
+      if (parse_line(begin, eol, record)) {
+        out.records.push_back(std::move(record));
+      } else {
+        out.malformed++;
+        if (out.malformed_lines.size() < ParseStats::MAX_REPORTED) {
+          out.malformed_lines.push_back(out.lines);
+        }
+      }
+    }
+    p = next;
+  }
+}
+
+template <class T>
+static auto parse_text(const std::string &text_fname,
+                       const std::string &bin_fname, std::size_t chunk_size)
+    -> ParseStats {
+  auto start = std::chrono::steady_clock::now();
+
+  MappedFile text(text_fname);
+  std::ofstream os(bin_fname, std::ios::binary);
+  if (!os) {
+    std::ostringstream ss;
+    ss << "Could not save " << bin_fname;
+    throw std::runtime_error(ss.str());
+  }
+
+  // chunks end right after a newline
+  const char *end = text.data() + text.size();
+  std::vector<const char *> bounds{text.data()};
+  chunk_size = std::max(chunk_size, std::size_t{1});
+  while (static_cast<std::size_t>(end - bounds.back()) > chunk_size) {
+    auto p = bounds.back() + chunk_size;
+    auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    bounds.push_back(eol == nullptr ? end : eol + 1);
+  }
+  if (bounds.back() != end) {
+    bounds.push_back(end);
+  }
+
+  ParseStats stats;
+  stats.bytes = text.size();
+  std::size_t nchunks = bounds.size() - 1;
+  std::size_t next = 0;
+
+  using chunk_ptr = std::shared_ptr<ParsedChunk<T>>;
+  auto ntokens = 2 * std::max(std::thread::hardware_concurrency(), 1U);
+  tbb::parallel_pipeline(
+      ntokens,
+      tbb::make_filter<void, std::size_t>(
+          tbb::filter_mode::serial_in_order,
+          [&](tbb::flow_control &fc) -> std::size_t {
+            if (next == nchunks) {
+              fc.stop();
+              return 0;
+            }
+            return next++;
+          }) &
+          tbb::make_filter<std::size_t, chunk_ptr>(
+              tbb::filter_mode::parallel,
+              [&](std::size_t i) {
+                auto chunk = std::make_shared<ParsedChunk<T>>();
+                parse_chunk(bounds[i], bounds[i + 1], *chunk);
+                return chunk;
+              }) &
+          tbb::make_filter<chunk_ptr, void>(
+              tbb::filter_mode::serial_in_order, [&](const chunk_ptr &chunk) {
+                T::encode_block(os, chunk->records.data(),
+                                chunk->records.size());
+                for (auto line : chunk->malformed_lines) {
+                  if (stats.malformed_lines.size() < ParseStats::MAX_REPORTED) {
+                    stats.malformed_lines.push_back(stats.lines + line);
+                  }
+                }
+                stats.lines += chunk->lines;
+                stats.records += chunk->records.size();
+                stats.malformed += chunk->malformed;
+              }));
+
+  os.close();
+  if (!os) {
+    std::ostringstream ss;
+    ss << "Could not save " << bin_fname;
+    throw std::runtime_error(ss.str());
+  }
+
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return stats;
+}
+
+auto parse_edges(const std::string &text_fname, const std::string &bin_fname,
+                 std::size_t chunk_size) -> ParseStats {
+  return parse_text<edge_type>(text_fname, bin_fname, chunk_size);
+}
+
+auto parse_adjacency(const std::string &text_fname,
+                     const std::string &bin_fname, std::size_t chunk_size)
+    -> ParseStats {
+  return parse_text<adj_type>(text_fname, bin_fname, chunk_size);
+}
@@ -2,16 +2,23 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <fstream>
 #include <iostream>
 #include <istream>
 #include <iterator>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 // ----------------------------------------------------------------------------
 // Edge and adjacency items definition
 // ----------------------------------------------------------------------------
@@ -29,6 +36,24 @@ auto EdgeItem<T>::decode(std::istream &is, EdgeItem<T> &edge) -> bool {
   return is.good();
 }
 
+template <class T>
+auto EdgeItem<T>::encode_block(std::ostream &os, const EdgeItem<T> *edges,
+                               std::size_t n) -> bool {
+  static_assert(sizeof(EdgeItem<T>) == 2 * sizeof(T), "edges are not packed");
+  os.write(reinterpret_cast<const char *>(edges),
+           static_cast<std::streamsize>(n * sizeof(EdgeItem<T>)));
+  return os.good();
+}
+
+template <class T>
+auto EdgeItem<T>::decode_block(std::istream &is, EdgeItem<T> *edges,
+                               std::size_t n) -> std::size_t {
+  is.read(reinterpret_cast<char *>(edges),
+          static_cast<std::streamsize>(n * sizeof(EdgeItem<T>)));
+  // a trailing partial edge is dropped, same as with `decode`
+  return static_cast<std::size_t>(is.gcount()) / sizeof(EdgeItem<T>);
+}
+
 auto operator>>(std::istream &is, EdgeItem<std::uint32_t> &edge)
     -> std::istream & {
   is >> edge.first >> edge.second;
@@ -62,6 +87,87 @@ auto AdjItem<T>::decode(std::istream &is, AdjItem<T> &row) -> bool {
   return is.good();
 }
 
+template <class T>
+auto AdjItem<T>::encode_block(std::ostream &os, const AdjItem<T> *rows,
+                              std::size_t n) -> bool {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    total += 2 + rows[i].targets.size();
+  }
+
+  std::vector<T> block;
+  block.reserve(total);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto &row = rows[i];
+    block.push_back(static_cast<T>(row.targets.size()));
+    block.push_back(row.source);
+    block.insert(block.end(), row.targets.begin(), row.targets.end());
+  }
+
+  os.write(reinterpret_cast<const char *>(block.data()),
+           static_cast<std::streamsize>(block.size() * sizeof(T)));
+  return os.good();
+}
+
+template <class T>
+auto AdjItem<T>::decode_block(std::istream &is, AdjItem<T> *rows,
+                              std::size_t n) -> std::size_t {
+  constexpr std::size_t block_words = std::size_t{1} << 16U;
+
+  std::size_t i = 0;
+  auto start = is.tellg();
+  if (n == 0 || start == std::streampos(-1)) {
+    // bytes read past the last row could not be given back
+    while (i < n && decode(is, rows[i])) {
+      ++i;
+    }
+    return i;
+  }
+
+  std::vector<T> block;
+  std::size_t pos = 0; // first word of the rows not parsed yet
+  std::streamoff erased = 0;
+  bool end = false;
+  while (true) {
+    while (i < n && block.size() - pos >= 2 &&
+           block.size() - pos - 2 >= static_cast<std::size_t>(block[pos])) {
+      auto first = block.begin() + static_cast<std::ptrdiff_t>(pos + 2);
+      rows[i].source = block[pos + 1];
+      rows[i].targets.assign(first, first + block[pos]);
+      pos += 2 + static_cast<std::size_t>(block[pos]);
+      ++i;
+    }
+    if (i == n || end) {
+      break;
+    }
+
+    // carry a partial row over to the next read, which holds all of it
+    erased += static_cast<std::streamoff>(pos * sizeof(T));
+    block.erase(block.begin(),
+                block.begin() + static_cast<std::ptrdiff_t>(pos));
+    pos = 0;
+    auto want = block_words;
+    if (block.size() >= 2) {
+      want = std::max(want, 2 + static_cast<std::size_t>(block[0]) -
+                                block.size());
+    }
+    auto size = block.size();
+    block.resize(size + want);
+    is.read(reinterpret_cast<char *>(block.data() + size),
+            static_cast<std::streamsize>(want * sizeof(T)));
+    // a trailing partial row is dropped, same as with `decode`
+    block.resize(size + static_cast<std::size_t>(is.gcount()) / sizeof(T));
+    end = !is.good();
+  }
+
+  if (i == n) {
+    // rows after the last one are read by the next call
+    is.clear();
+    is.seekg(start + erased + static_cast<std::streamoff>(pos * sizeof(T)));
+  }
+  return i;
+}
+
 template <class T>
 auto operator>>(std::istream &is, AdjItem<T> &row) -> std::istream & {
   std::string line;
@@ -102,3 +208,33 @@ template <class T> auto read_vec(const std::string &fname) -> std::vector<T> {
   fin.read(reinterpret_cast<char *>(buffer.data()), size);
   return buffer;
 }
+
+MappedFile::MappedFile(const std::string &fname) {
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open " + fname);
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Could not stat " + fname);
+  }
+  _size = static_cast<std::size_t>(st.st_size);
+
+  if (_size != 0) {
+    void *p = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Could not mmap " + fname);
+    }
+    _data = static_cast<const char *>(p);
+  }
+  ::close(fd); // the mapping keeps its own reference to the file
+}
+
+MappedFile::~MappedFile() {
+  if (_data != nullptr) {
+    ::munmap(const_cast<char *>(_data), _size);
+  }
+}